@@ -7,6 +7,9 @@
 #define LIKELY_EXT(x) __builtin_expect(x, 1)
 #define UNLIKELY_EXT(x) __builtin_expect(x, 0)
 #endif
+#if __has_builtin(__builtin_prefetch)
+#define PREFETCH_EXT(x) __builtin_prefetch(x)
+#endif
 #endif
 #endif
 
@@ -16,5 +19,8 @@
 #if !defined(UNLIKELY_EXT)
 #define UNLIKELY_EXT(x) x
 #endif
+#if !defined(PREFETCH_EXT)
+#define PREFETCH_EXT(x)
+#endif
 
 #endif
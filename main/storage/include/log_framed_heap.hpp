@@ -0,0 +1,50 @@
+#ifndef SUPERNOVA_STORAGE_LOG_FRAMED_HEAP_HPP
+#define SUPERNOVA_STORAGE_LOG_FRAMED_HEAP_HPP
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+#include "log_framed_memory.hpp"
+
+namespace supernova {
+namespace storage {
+
+class log_framed_heap_owner;
+
+// For the other threads of the process owning the log
+class log_framed_heap_reader : private boost::noncopyable
+{
+public:
+    log_framed_heap_reader(const log_framed_heap_owner& owner);
+    ~log_framed_heap_reader();
+    boost::optional<log_payload> read(const log_index& index) const;
+    boost::optional<log_index> get_front_index() const;
+    boost::optional<log_index> get_back_index() const;
+    log_index get_max_index() const;
+    std::size_t get_free_size() const;
+private:
+    log_framed_reader_handle reader_handle_;
+};
+
+// The log lives in an anonymous mapping of this process and goes away with the owner
+class log_framed_heap_owner : private boost::noncopyable
+{
+public:
+    log_framed_heap_owner(std::size_t size, std::size_t average_size);
+    ~log_framed_heap_owner();
+    boost::optional<log_index> append(const void* payload, std::size_t size);
+    boost::optional<log_payload> read(const log_index& index) const;
+    boost::optional<log_index> get_front_index() const;
+    boost::optional<log_index> get_back_index() const;
+    log_index get_max_index() const;
+    std::size_t get_free_size() const;
+private:
+    friend class log_framed_heap_reader;
+    boost::interprocess::mapped_region region_;
+    log_framed_owner_handle owner_handle_;
+    log_framed_reader_handle reader_handle_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
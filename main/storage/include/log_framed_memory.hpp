@@ -0,0 +1,57 @@
+#ifndef SUPERNOVA_STORAGE_LOG_FRAMED_MEMORY_HPP
+#define SUPERNOVA_STORAGE_LOG_FRAMED_MEMORY_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <supernova/storage/about.hpp>
+#include "mode.hpp"
+#include "log_memory.hpp"
+
+namespace supernova {
+namespace storage {
+
+// The payload bytes of a frame as they lie in the memory
+typedef boost::iterator_range<const char*> log_payload;
+
+const version LOG_FRAMED_MIN_SUPPORTED_VERSION(1, 1, 1, 0);
+const version LOG_FRAMED_MAX_SUPPORTED_VERSION(1, 1, 1, 0);
+
+// A log of payloads of any size, each one stored in a frame of its length followed by the bytes,
+// padded to a multiple of 8 bytes. A side table holds the offset of the frame of each index,
+// so reading an index does not have to walk the frames before it.
+// The log stops when full, whether it runs out of bytes or of indexes first.
+class log_framed_reader_handle : private boost::noncopyable
+{
+public:
+    log_framed_reader_handle(const boost::interprocess::mapped_region& region);
+    ~log_framed_reader_handle();
+    boost::optional<log_payload> read(const log_index& index) const;
+    boost::optional<log_index> get_front_index() const;
+    boost::optional<log_index> get_back_index() const;
+    log_index get_max_index() const;
+    // The bytes left for frames
+    std::size_t get_free_size() const;
+private:
+    const boost::interprocess::mapped_region& region_;
+};
+
+class log_framed_owner_handle : private boost::noncopyable
+{
+public:
+    // The region is split between the frames and the side table as if every payload
+    // was of the average size, which an existing log keeps from when it was created
+    log_framed_owner_handle(open_mode mode, boost::interprocess::mapped_region& region, std::size_t average_size);
+    ~log_framed_owner_handle();
+    // Fails when the frame does not fit, even though a smaller one may still do
+    boost::optional<log_index> append(const void* payload, std::size_t size);
+private:
+    boost::interprocess::mapped_region& region_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
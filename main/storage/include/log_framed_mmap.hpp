@@ -0,0 +1,55 @@
+#ifndef SUPERNOVA_STORAGE_LOG_FRAMED_MMAP_HPP
+#define SUPERNOVA_STORAGE_LOG_FRAMED_MMAP_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/noncopyable.hpp>
+#include "log_framed_memory.hpp"
+
+namespace supernova {
+namespace storage {
+
+class log_framed_mmap_reader : private boost::noncopyable
+{
+public:
+    log_framed_mmap_reader(const boost::filesystem::path& path);
+    ~log_framed_mmap_reader();
+    boost::optional<log_payload> read(const log_index& index) const;
+    boost::optional<log_index> get_front_index() const;
+    boost::optional<log_index> get_back_index() const;
+    log_index get_max_index() const;
+    std::size_t get_free_size() const;
+private:
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    log_framed_reader_handle reader_handle_;
+};
+
+class log_framed_mmap_owner : private boost::noncopyable
+{
+public:
+    log_framed_mmap_owner(const boost::filesystem::path& path, std::size_t size, std::size_t average_size);
+    ~log_framed_mmap_owner();
+    boost::optional<log_index> append(const void* payload, std::size_t size);
+    boost::optional<log_payload> read(const log_index& index) const;
+    boost::optional<log_index> get_front_index() const;
+    boost::optional<log_index> get_back_index() const;
+    log_index get_max_index() const;
+    std::size_t get_free_size() const;
+private:
+    bool exists_;
+    boost::interprocess::file_lock flock_;
+    boost::interprocess::scoped_lock<boost::interprocess::file_lock> slock_;
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    log_framed_owner_handle owner_handle_;
+    log_framed_reader_handle reader_handle_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SUPERNOVA_STORAGE_LOG_HEAP_HPP
+#define SUPERNOVA_STORAGE_LOG_HEAP_HPP
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/noncopyable.hpp>
+#include "log_memory.hpp"
+
+namespace supernova {
+namespace storage {
+
+template <class entry_t> class log_heap_owner;
+
+// For the other threads of the process owning the log
+template <class entry_t>
+class log_heap_reader : private boost::noncopyable
+{
+public:
+    log_heap_reader(const log_heap_owner<entry_t>& owner);
+    ~log_heap_reader();
+    inline boost::optional<const entry_t&> read(const log_index& index) const;
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline bool is_overwritten(const log_index& index) const;
+    inline boost::optional<log_index> get_front_index() const;
+    inline boost::optional<log_index> get_back_index() const;
+    inline log_index get_max_index() const;
+    inline bool wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const;
+    inline log_index set_checkpoint(const log_index& index);
+private:
+    log_reader_handle<entry_t> reader_handle_;
+};
+
+// The log lives in an anonymous mapping of this process, so nothing has to be created
+// or removed by name and the log goes away with the owner
+template <class entry_t>
+class log_heap_owner : private boost::noncopyable
+{
+public:
+    log_heap_owner(std::size_t size, log_overflow overflow = log_stops_when_full);
+    ~log_heap_owner();
+    inline boost::optional<log_index> append(const entry_t& entry);
+    template <class iterator_t> inline boost::optional<log_index> append_batch(iterator_t first, iterator_t last);
+    inline log_index truncate_front(const log_index& index);
+    inline boost::optional<const entry_t&> read(const log_index& index) const;
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline bool is_overwritten(const log_index& index) const;
+    inline boost::optional<log_index> get_front_index() const;
+    inline boost::optional<log_index> get_back_index() const;
+    inline log_index get_max_index() const;
+private:
+    friend class log_heap_reader<entry_t>;
+    boost::interprocess::mapped_region region_;
+    log_owner_handle<entry_t> owner_handle_;
+    log_reader_handle<entry_t> reader_handle_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
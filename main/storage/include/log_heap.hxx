@@ -0,0 +1,140 @@
+#ifndef SUPERNOVA_STORAGE_LOG_HEAP_HXX
+#define SUPERNOVA_STORAGE_LOG_HEAP_HXX
+
+#include "log_heap.hpp"
+#include <boost/interprocess/anonymous_shared_memory.hpp>
+#include "mode.hpp"
+#include "log_memory.hxx"
+
+namespace bip = boost::interprocess;
+
+namespace supernova {
+namespace storage {
+
+template <class entry_t>
+log_heap_reader<entry_t>::log_heap_reader(const log_heap_owner<entry_t>& owner) :
+    reader_handle_(owner.region_, const_cast<bip::mapped_region*>(&owner.region_))
+{ }
+
+template <class entry_t>
+log_heap_reader<entry_t>::~log_heap_reader()
+{ }
+
+template <class entry_t>
+boost::optional<const entry_t&> log_heap_reader<entry_t>::read(const log_index& index) const
+{
+    return reader_handle_.read(index);
+}
+
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_heap_reader<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    return reader_handle_.read_range(from, count);
+}
+
+template <class entry_t>
+bool log_heap_reader<entry_t>::is_overwritten(const log_index& index) const
+{
+    return reader_handle_.is_overwritten(index);
+}
+
+template <class entry_t>
+boost::optional<log_index> log_heap_reader<entry_t>::get_front_index() const
+{
+    return reader_handle_.get_front_index();
+}
+
+template <class entry_t>
+boost::optional<log_index> log_heap_reader<entry_t>::get_back_index() const
+{
+    return reader_handle_.get_back_index();
+}
+
+template <class entry_t>
+log_index log_heap_reader<entry_t>::get_max_index() const
+{
+    return reader_handle_.get_max_index();
+}
+
+template <class entry_t>
+bool log_heap_reader<entry_t>::wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const
+{
+    return reader_handle_.wait_for(index, timeout);
+}
+
+template <class entry_t>
+log_index log_heap_reader<entry_t>::set_checkpoint(const log_index& index)
+{
+    return reader_handle_.set_checkpoint(index);
+}
+
+template <class entry_t>
+log_heap_owner<entry_t>::log_heap_owner(std::size_t size, log_overflow overflow) :
+    region_(bip::anonymous_shared_memory(size)),
+    owner_handle_(open_new, region_, overflow),
+    reader_handle_(region_)
+{ }
+
+template <class entry_t>
+log_heap_owner<entry_t>::~log_heap_owner()
+{ }
+
+template <class entry_t>
+boost::optional<log_index> log_heap_owner<entry_t>::append(const entry_t& entry)
+{
+    return owner_handle_.append(entry);
+}
+
+template <class entry_t>
+template <class iterator_t>
+boost::optional<log_index> log_heap_owner<entry_t>::append_batch(iterator_t first, iterator_t last)
+{
+    return owner_handle_.append_batch(first, last);
+}
+
+template <class entry_t>
+log_index log_heap_owner<entry_t>::truncate_front(const log_index& index)
+{
+    return owner_handle_.truncate_front(index);
+}
+
+template <class entry_t>
+boost::optional<const entry_t&> log_heap_owner<entry_t>::read(const log_index& index) const
+{
+    return reader_handle_.read(index);
+}
+
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_heap_owner<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    return reader_handle_.read_range(from, count);
+}
+
+template <class entry_t>
+bool log_heap_owner<entry_t>::is_overwritten(const log_index& index) const
+{
+    return reader_handle_.is_overwritten(index);
+}
+
+template <class entry_t>
+boost::optional<log_index> log_heap_owner<entry_t>::get_front_index() const
+{
+    return reader_handle_.get_front_index();
+}
+
+template <class entry_t>
+boost::optional<log_index> log_heap_owner<entry_t>::get_back_index() const
+{
+    return reader_handle_.get_back_index();
+}
+
+template <class entry_t>
+log_index log_heap_owner<entry_t>::get_max_index() const
+{
+    return reader_handle_.get_max_index();
+}
+
+} // namespace storage
+} // namespace supernova
+
+#endif
@@ -2,9 +2,11 @@
 #define SUPERNOVA_STORAGE_LOG_MEMORY_HPP
 
 #include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/optional.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <supernova/storage/about.hpp>
 #include "mode.hpp"
 
@@ -13,31 +15,90 @@ namespace storage {
 
 typedef boost::uint64_t log_index;
 
-const version LOG_MIN_SUPPORTED_VERSION(1, 1, 1, 1);
-const version LOG_MAX_SUPPORTED_VERSION(1, 1, 1, 1);
+// The number of readers of a log that can hold a checkpoint at the same time
+static const std::size_t LOG_CHECKPOINT_LIMIT = 16;
+
+// How long setting a checkpoint waits for a truncation of another live process to finish, in milliseconds
+static const long LOG_TRUNCATION_WAIT_LIMIT = 1000;
+
+template <class entry_t> struct log_container;
+
+// What appends do once every slot has been used
+enum log_overflow
+{
+    // Appends fail until truncate_front frees the slots below the front index
+    log_stops_when_full,
+    // The oldest entries are overwritten. Indexes go on counting up,
+    // the slot of an index being the index modulo the number of slots.
+    log_wraps_around
+};
+
+const version LOG_MIN_SUPPORTED_VERSION(1, 1, 1, 9);
+const version LOG_MAX_SUPPORTED_VERSION(1, 1, 1, 9);
 
 template <class entry_t>
 class log_reader_handle : private boost::noncopyable
 {
 public:
     log_reader_handle(const boost::interprocess::mapped_region& region);
+    // Waiting and checkpoints take a writable mapping of at least the header of the same log,
+    // as readers count themselves in as waiters and record their checkpoints there.
+    // Without one, as for a reader only allowed to read the log, they throw storage_error.
+    log_reader_handle(const boost::interprocess::mapped_region& region, boost::interprocess::mapped_region* header_region);
     ~log_reader_handle();
     boost::optional<const entry_t&> read(const log_index& index) const;
+    // The entries from the index onwards, up to count of them, as they lie in the memory.
+    // Stops short at the first entry not yet published, so it may be empty.
+    // Also stops short at the end of the slots, when the log wraps around.
+    boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    // Whether a later entry has taken the slot of the index. When the log wraps around, an entry
+    // returned by read or read_range can be overwritten while in use, so it is only good
+    // if this is still false once the reader is done with it.
+    bool is_overwritten(const log_index& index) const;
+    // Once the log has been truncated past every entry, the front index is one past the back index
     boost::optional<log_index> get_front_index() const;
     boost::optional<log_index> get_back_index() const;
+    // The number of slots less one when the log wraps around
     log_index get_max_index() const;
+    log_overflow get_overflow() const;
+    // Blocks until the commit count passes the index or the timeout runs out, and returns whether it did.
+    // Producers only make the system call to wake readers when some are waiting.
+    bool wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const;
+    // Keeps truncate_front from moving the front past the index, until moved on or the reader goes away.
+    // The first call takes one of the LOG_CHECKPOINT_LIMIT checkpoints of the log, or throws busy_condition.
+    // Also throws busy_condition when a truncation keeps the checkpoint from being checked against the front,
+    // in which case the checkpoint is left set at the index.
+    // Returns the index held, which is the front index instead when the log has been truncated past the index.
+    log_index set_checkpoint(const log_index& index);
 private:
     const boost::interprocess::mapped_region& region_;
+    boost::interprocess::mapped_region* header_region_;
+    boost::optional<std::size_t> checkpoint_;
 };
 
 template <class entry_t>
 class log_owner_handle : private boost::noncopyable
 {
 public:
-    log_owner_handle(open_mode mode, boost::interprocess::mapped_region& region);
+    // An existing log keeps the overflow it was created with
+    log_owner_handle(open_mode mode, boost::interprocess::mapped_region& region, log_overflow overflow = log_stops_when_full);
     ~log_owner_handle();
+    // An append that finds the log full still uses up an index, which readers never see an entry at
+    // and the commit count passes over once truncate_front has made room for it.
     boost::optional<log_index> append(const entry_t& entry);
+    // Reserves consecutive slots for the whole run in one step and returns the index of its first entry.
+    // When the log fills up part way, only the leading front + max_index + 1 - first of the entries are appended.
+    // When it wraps around, the batch overwrites the oldest entries like as many appends would.
+    template <class iterator_t> boost::optional<log_index> append_batch(iterator_t first, iterator_t last);
+    // Moves the front index up to the index, but not past the checkpoint of any reader nor past the back of the log,
+    // and returns the front index reached. A log that stops when full then reuses the slots below the front.
+    log_index truncate_front(const log_index& index);
 private:
+    static bool claim(log_container<entry_t>* container, log_index index);
+    static void skip(log_container<entry_t>* container, log_index index);
+    static void publish(log_container<entry_t>* container, log_index index);
+    static bool can_commit(log_index marker, log_index index, log_index slots, log_index limit);
+    static void advance_commit(log_container<entry_t>* container);
     boost::interprocess::mapped_region& region_;
 };
 
@@ -2,55 +2,171 @@
 #define SUPERNOVA_STORAGE_LOG_MEMORY_HXX
 
 #include "log_memory.hpp"
+#include <algorithm>
+#include <iterator>
 #include <boost/atomic.hpp>
-#include <boost/chrono/chrono.hpp>
-#include <boost/random/mersenne_twister.hpp>
-#include <boost/random/uniform_int_distribution.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/thread/thread_time.hpp>
 #include <supernova/core/compiler_extensions.hpp>
 #include <supernova/storage/exception.hpp>
 
 namespace bip = boost::interprocess;
-namespace bra = boost::random;
 
 namespace supernova {
 namespace storage {
 
 extern const char* LOG_TYPE_TAG;
 
+// Futex calls on a word of memory shared between processes
+void wait_log_futex(boost::atomic<boost::uint32_t>& word, boost::uint32_t value, const boost::posix_time::time_duration& timeout);
+void wake_log_futex(boost::atomic<boost::uint32_t>& word);
+
+// Set in a commit marker while the producer holding it copies its entry into the slot
+static const log_index LOG_MARKER_WRITING = static_cast<log_index>(1) << 63;
+// In a log that stops when full, the number of laps after the entry in the slot whose indexes went to appends
+// that found the log full. There are no more of them than producers racing past a full log at once.
+static const unsigned LOG_MARKER_SKIP_SHIFT = 56;
+static const log_index LOG_MARKER_SKIPS = static_cast<log_index>(0x7F) << LOG_MARKER_SKIP_SHIFT;
+static const log_index LOG_MARKER_INDEX = ~(LOG_MARKER_WRITING | LOG_MARKER_SKIPS);
+
+// Whether the entry of the index is the one in the slot, ready to be read
+inline bool is_log_index_published(log_index marker, log_index index)
+{
+    return (marker & ~LOG_MARKER_SKIPS) == index + 1;
+}
+
+// Published, or taken by the entry of a later lap
+inline bool is_log_index_settled(log_index marker, log_index index)
+{
+    return is_log_index_published(marker, index) || (marker & LOG_MARKER_INDEX) > index + 1;
+}
+
+// Handed out to an append that found the log full, and so never to be published
+inline bool is_log_index_skipped(log_index marker, log_index index, log_index slots)
+{
+    log_index held = marker & LOG_MARKER_INDEX;
+    return !(marker & LOG_MARKER_WRITING) && held < index + 1 && (index + 1 - held) % slots == 0 &&
+	    (index + 1 - held) / slots <= (marker & LOG_MARKER_SKIPS) >> LOG_MARKER_SKIP_SHIFT;
+}
+
+// One checkpoint per reader holding one, each the index plus one of the first entry its reader still needs, or 0 when free.
+// The process of the reader is recorded with it, so the checkpoint of a reader that went away
+// without releasing it stops holding the front back once its process has exited,
+// as long as readers run in the same pid namespace as the owner.
+// Truncations count themselves in while they read the checkpoints and move the front, and readers
+// wait them out after setting a checkpoint before checking it against the front. Either a truncation
+// then sees the checkpoint or the reader sees where the truncation moved the front to.
+struct log_checkpoint_table
+{
+    void init();
+    boost::optional<std::size_t> claim(log_index index);
+    void move(std::size_t id, log_index index);
+    void release(std::size_t id);
+    void begin_truncation();
+    void end_truncation();
+    // Returns false when a truncation of a live process has not finished within LOG_TRUNCATION_WAIT_LIMIT.
+    // A truncation left behind by a process that exited half way is cleared instead of waited for.
+    bool wait_for_truncations();
+    // The lowest of the checkpoints and the bound, releasing those of processes no longer running on the way.
+    // Only called between begin_truncation and end_truncation.
+    log_index get_lowest(log_index bound);
+    // The pid of the process truncating in the upper half, and the number of its truncations under way in the lower half
+    boost::atomic<boost::uint64_t> truncation_marker;
+    boost::atomic<log_index> checkpoints[LOG_CHECKPOINT_LIMIT];
+    // 0 until the process claiming the checkpoint has recorded itself
+    boost::atomic<boost::int32_t> owner_pids[LOG_CHECKPOINT_LIMIT];
+};
+
 #ifdef LEVEL1_DCACHE_LINESIZE
 
 struct log_header
 {
-    log_header(const version& ver, boost::uint64_t regsize, log_index maxidx);
-    log_index get_null_index() const;
+    log_header(const version& ver, boost::uint64_t regsize, log_index maxidx, log_overflow ovf);
+    log_index get_committed_count() const;
     boost::uint16_t endianess_indicator;
     char memory_type_tag[48];
     version memory_version;
     boost::uint16_t header_size;
     boost::uint64_t region_size;
     log_index max_index;
-    boost::atomic<log_index> back_index;
+    boost::uint8_t overflow;
+    // The number of indexes handed out to appends. When the log wraps around it runs ahead
+    // of the entries published, as it does past the indexes skipped by appends to a full log,
+    // so it is never used as a bound by readers.
+    boost::atomic<log_index> reserve_count;
+    // Every entry below it has been fully written, or overwritten since. Producers finish out of order,
+    // so whichever one publishes the entry at the commit count carries it forward.
+    boost::atomic<log_index> commit_count __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
+    // The number of readers blocked in wait_for, read by producers each time they advance the commit count
+    boost::atomic<boost::uint32_t> waiter_count;
+    // Bumped by producers before waking the waiters, for the futex to tell a wake up missed from none
+    boost::atomic<boost::uint32_t> wake_sequence;
+    // Moved up by truncate_front, never past the commit count. A log that stops when full
+    // takes no more than max_index + 1 entries from it on, overwriting the slots of the entries below it.
+    boost::atomic<log_index> front_index __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
+    log_checkpoint_table checkpoint_table __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
 } __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
 
 #endif
 
+// Maps the header of the log for writing into the region given, or returns 0 when the log is only open for reading
+template <class mappable_t>
+bip::mapped_region* map_log_header(const mappable_t& mappable, bip::mode_t mode, bip::mapped_region& header_region)
+{
+    if (mode != bip::read_write)
+    {
+	return 0;
+    }
+    bip::mapped_region writable(mappable, bip::read_write, 0U, sizeof(log_header));
+    header_region.swap(writable);
+    return &header_region;
+}
+
+// The entries are followed by one commit marker per slot, holding the index plus one
+// of the entry last published in the slot, so a reader never returns an entry still being copied
+// nor, once the log has wrapped around, mistakes the entry of an earlier lap for the one it asked for
 template <class entry_t>
 struct log_container
 {
-    log_container(const version& ver, boost::uint64_t regsize);
+    typedef boost::atomic<log_index> marker_type;
+    log_container(const version& ver, boost::uint64_t regsize, log_overflow overflow);
+    static std::size_t get_slot_count(boost::uint64_t regsize);
+    inline marker_type* get_commit_markers();
+    inline const marker_type* get_commit_markers() const;
     log_header header;
     entry_t log[];
 };
 
 template <class entry_t>
-log_container<entry_t>::log_container(const version& ver, boost::uint64_t regsize) :
-    header(
-	ver,
-	regsize,
-	((regsize - sizeof(log_container<entry_t>)) / sizeof(entry_t)) - 1)
-{ }
+log_container<entry_t>::log_container(const version& ver, boost::uint64_t regsize, log_overflow overflow) :
+    header(ver, regsize, get_slot_count(regsize) - 1, overflow)
+{
+    marker_type* markers = get_commit_markers();
+    for (log_index slot = 0; slot <= header.max_index; ++slot)
+    {
+	new (&markers[slot]) marker_type(0U);
+    }
+}
+
+template <class entry_t>
+std::size_t log_container<entry_t>::get_slot_count(boost::uint64_t regsize)
+{
+    // Allows for the padding needed to align the markers after the last entry
+    std::size_t usable = regsize - sizeof(log_container<entry_t>) - (sizeof(marker_type) - 1);
+    return usable / (sizeof(entry_t) + sizeof(marker_type));
+}
+
+template <class entry_t>
+typename log_container<entry_t>::marker_type* log_container<entry_t>::get_commit_markers()
+{
+    std::size_t end = reinterpret_cast<std::size_t>(&log[header.max_index + 1]);
+    return reinterpret_cast<marker_type*>((end + sizeof(marker_type) - 1) & ~(sizeof(marker_type) - 1));
+}
+
+template <class entry_t>
+const typename log_container<entry_t>::marker_type* log_container<entry_t>::get_commit_markers() const
+{
+    return const_cast<log_container<entry_t>*>(this)->get_commit_markers();
+}
 
 template <class entry_t>
 void check(const bip::mapped_region& region)
@@ -93,22 +209,34 @@ void check(const bip::mapped_region& region)
         throw malformed_db_error("Wrong region size")
                 << info_component_identity("log_memory");
     }
-    std::size_t expected_max = ((region.get_size() - sizeof(log_container<entry_t>)) / sizeof(entry_t)) - 1;
+    std::size_t expected_max = log_container<entry_t>::get_slot_count(region.get_size()) - 1;
     if (UNLIKELY_EXT(expected_max != container->header.max_index))
     {
         throw malformed_db_error("Log entry size mismatch")
                 << info_component_identity("log_memory");
     }
-    log_index back = container->header.back_index.load(boost::memory_order_consume);
-    if (UNLIKELY_EXT(back != container->header.get_null_index() && container->header.max_index < back))
+    if (UNLIKELY_EXT(container->header.overflow > log_wraps_around))
     {
-        throw malformed_db_error("Back index is greater than maximum allowed index")
+        throw malformed_db_error("Unknown overflow")
+                << info_component_identity("log_memory");
+    }
+    if (UNLIKELY_EXT(container->header.front_index.load(boost::memory_order_acquire) >
+	    container->header.get_committed_count()))
+    {
+        throw malformed_db_error("Front index is past the commit count")
+                << info_component_identity("log_memory");
+    }
+    if (UNLIKELY_EXT(container->header.overflow == log_stops_when_full &&
+	    container->header.get_committed_count() >
+		    container->header.front_index.load(boost::memory_order_acquire) + container->header.max_index + 1))
+    {
+        throw malformed_db_error("Commit count is greater than the number of slots")
                 << info_component_identity("log_memory");
     }
 }
 
 template <class entry_t>
-void init_log(bip::mapped_region& region)
+void init_log(bip::mapped_region& region, log_overflow overflow)
 {
     void* base = region.get_address();
     if (UNLIKELY_EXT(!base))
@@ -117,26 +245,49 @@ void init_log(bip::mapped_region& region)
 		<< info_component_identity("log_memory");
     }
     std::size_t region_size = region.get_size();
-    if (UNLIKELY_EXT(region_size < (sizeof(log_container<entry_t>) + sizeof(entry_t))))
+    if (UNLIKELY_EXT(region_size < (sizeof(log_container<entry_t>) + sizeof(entry_t) +
+	    2 * sizeof(typename log_container<entry_t>::marker_type))))
     {
         throw malformed_db_error("Region size is too small")
                 << info_component_identity("log_memory");
     }
     new (base) log_container<entry_t>(
 	    LOG_MAX_SUPPORTED_VERSION,
-	    region_size);
+	    region_size,
+	    overflow);
 }
 
 template <class entry_t>
 log_reader_handle<entry_t>::log_reader_handle(const bip::mapped_region& region) :
-    region_(region)
+    region_(region),
+    header_region_(0),
+    checkpoint_()
+{
+    check<entry_t>(region_);
+}
+
+template <class entry_t>
+log_reader_handle<entry_t>::log_reader_handle(const bip::mapped_region& region, bip::mapped_region* header_region) :
+    region_(region),
+    header_region_(header_region),
+    checkpoint_()
 {
     check<entry_t>(region_);
+    if (UNLIKELY_EXT(header_region_ && header_region_->get_size() < sizeof(log_header)))
+    {
+        throw malformed_db_error("Header region does not hold the header")
+                << info_component_identity("log_memory");
+    }
 }
 
 template <class entry_t>
 log_reader_handle<entry_t>::~log_reader_handle()
-{ }
+{
+    if (checkpoint_)
+    {
+	static_cast<log_header*>(header_region_->get_address())->checkpoint_table.release(checkpoint_.get());
+    }
+}
 
 template <class entry_t>
 boost::optional<const entry_t&> log_reader_handle<entry_t>::read(const log_index& index) const
@@ -144,24 +295,59 @@ boost::optional<const entry_t&> log_reader_handle<entry_t>::read(const log_index
     boost::optional<const entry_t&> result;
     const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
     assert(container);
-    log_index back_index = container->header.back_index.load(boost::memory_order_consume);
-    if (back_index != container->header.get_null_index() && index <= back_index)
+    log_index slot = index % (container->header.max_index + 1);
+    if (is_log_index_published(container->get_commit_markers()[slot].load(boost::memory_order_acquire), index))
     {
-	result = container->log[index];
+	result = container->log[slot];
     }
     return result;
 }
 
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_reader_handle<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
+    assert(container);
+    log_index slot = from % (container->header.max_index + 1);
+    log_index limit = std::min<log_index>(count, container->header.max_index + 1 - slot);
+    log_index last = from;
+    // Stops at the indexes skipped by appends to a full log, which the commit count passes over.
+    // Entries published out of order past the commit count are returned as well.
+    const typename log_container<entry_t>::marker_type* markers = container->get_commit_markers();
+    while (last - from < limit && is_log_index_published(markers[slot + last - from].load(boost::memory_order_acquire), last))
+    {
+	++last;
+    }
+    return boost::iterator_range<const entry_t*>(&container->log[slot], &container->log[slot + last - from]);
+}
+
+template <class entry_t>
+bool log_reader_handle<entry_t>::is_overwritten(const log_index& index) const
+{
+    const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
+    assert(container);
+    // Keeps the reads of the entry from being moved after the check
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    log_index slot = index % (container->header.max_index + 1);
+    return !is_log_index_published(container->get_commit_markers()[slot].load(boost::memory_order_relaxed), index);
+}
+
 template <class entry_t>
 boost::optional<log_index> log_reader_handle<entry_t>::get_front_index() const
 {
     const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
     assert(container);
     boost::optional<log_index> result;
-    log_index back_index = container->header.back_index.load(boost::memory_order_consume);
-    if (back_index != container->header.get_null_index())
+    log_index committed = container->header.get_committed_count();
+    log_index slots = container->header.max_index + 1;
+    if (committed)
     {
-	result = 0U;
+	log_index front = container->header.front_index.load(boost::memory_order_acquire);
+	if (container->header.overflow == log_wraps_around && committed > slots)
+	{
+	    front = std::max(front, committed - slots);
+	}
+	result = front;
     }
     return result;
 }
@@ -172,10 +358,10 @@ boost::optional<log_index> log_reader_handle<entry_t>::get_back_index() const
     const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
     assert(container);
     boost::optional<log_index> result;
-    log_index back_index = container->header.back_index.load(boost::memory_order_consume);
-    if (back_index != container->header.get_null_index())
+    log_index committed = container->header.get_committed_count();
+    if (committed)
     {
-	result = back_index;
+	result = committed - 1;
     }
     return result;
 }
@@ -189,12 +375,94 @@ log_index log_reader_handle<entry_t>::get_max_index() const
 }
 
 template <class entry_t>
-log_owner_handle<entry_t>::log_owner_handle(open_mode mode, bip::mapped_region& region) :
+log_overflow log_reader_handle<entry_t>::get_overflow() const
+{
+    const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
+    assert(container);
+    return static_cast<log_overflow>(container->header.overflow);
+}
+
+template <class entry_t>
+bool log_reader_handle<entry_t>::wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const
+{
+    const log_container<entry_t>* container = static_cast<const log_container<entry_t>*>(region_.get_address());
+    assert(container);
+    if (UNLIKELY_EXT(!header_region_))
+    {
+	throw storage_error("Log is only open for reading, so it can't be waited on")
+		<< info_component_identity("log_memory");
+    }
+    bool reached = container->header.get_committed_count() > index;
+    if (!reached)
+    {
+	log_header& header = static_cast<log_header*>(header_region_->get_address())[0];
+	boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + timeout;
+	boost::posix_time::time_duration remaining = timeout;
+	header.waiter_count.fetch_add(1, boost::memory_order_seq_cst);
+	while (!reached && (remaining.is_pos_infinity() || remaining.ticks() > 0))
+	{
+	    boost::uint32_t sequence = header.wake_sequence.load(boost::memory_order_acquire);
+	    // Pairs with the fence producers place between advancing the commit count and checking the waiter count,
+	    // so either the producer sees this waiter or the waiter sees the commit count advanced
+	    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+	    reached = container->header.get_committed_count() > index;
+	    if (!reached)
+	    {
+		wait_log_futex(header.wake_sequence, sequence, remaining);
+		if (!remaining.is_pos_infinity())
+		{
+		    remaining = deadline - boost::posix_time::microsec_clock::universal_time();
+		}
+	    }
+	}
+	header.waiter_count.fetch_sub(1, boost::memory_order_relaxed);
+    }
+    return reached;
+}
+
+template <class entry_t>
+log_index log_reader_handle<entry_t>::set_checkpoint(const log_index& index)
+{
+    if (UNLIKELY_EXT(!header_region_))
+    {
+	throw storage_error("Log is only open for reading, so no checkpoint can be set")
+		<< info_component_identity("log_memory");
+    }
+    log_header& header = *static_cast<log_header*>(header_region_->get_address());
+    if (checkpoint_)
+    {
+	header.checkpoint_table.move(checkpoint_.get(), index);
+    }
+    else
+    {
+	checkpoint_ = header.checkpoint_table.claim(index);
+	if (UNLIKELY_EXT(!checkpoint_))
+	{
+	    throw busy_condition("No log checkpoint available")
+		    << info_component_identity("log_memory");
+	}
+    }
+    if (UNLIKELY_EXT(!header.checkpoint_table.wait_for_truncations()))
+    {
+	throw busy_condition("Log truncation under way for too long")
+		<< info_component_identity("log_memory");
+    }
+    // A truncation that missed the checkpoint has already moved the front past the index
+    log_index front = header.front_index.load(boost::memory_order_seq_cst);
+    if (front > index)
+    {
+	header.checkpoint_table.move(checkpoint_.get(), front);
+    }
+    return std::max(index, front);
+}
+
+template <class entry_t>
+log_owner_handle<entry_t>::log_owner_handle(open_mode mode, bip::mapped_region& region, log_overflow overflow) :
     region_(region)
 {
     if (mode == open_new)
     {
-	init_log<entry_t>(region_);
+	init_log<entry_t>(region_, overflow);
     }
     else
     {
@@ -211,37 +479,239 @@ boost::optional<log_index> log_owner_handle<entry_t>::append(const entry_t& entr
 {
     log_container<entry_t>* container = static_cast<log_container<entry_t>*>(region_.get_address());
     assert(container);
-    bra::mt19937 seed;
-    bra::uniform_int_distribution<> generator(100, 200);
     boost::optional<log_index> result;
-    log_index expected_back_index = container->header.back_index.load(boost::memory_order_consume);
-    log_index desired_back_index = (expected_back_index == container->header.get_null_index()) ?
-	    0U :
-	    expected_back_index + 1;
-    if (LIKELY_EXT(desired_back_index <= container->header.max_index))
-    {
-	while (UNLIKELY_EXT(!container->header.back_index.compare_exchange_weak(
-		expected_back_index,
-		desired_back_index,
-		boost::memory_order_seq_cst)))
+    if (container->header.overflow == log_wraps_around)
+    {
+	log_index index = container->header.reserve_count.fetch_add(1, boost::memory_order_relaxed);
+	if (LIKELY_EXT(claim(container, index)))
+	{
+	    container->log[index % (container->header.max_index + 1)] = entry;
+	    publish(container, index);
+	}
+	advance_commit(container);
+	result = index;
+    }
+    else
+    {
+	// Checking first keeps producers hammering a full log from running the counter up without bound
+	log_index limit = container->header.front_index.load(boost::memory_order_acquire) + container->header.max_index + 1;
+	if (LIKELY_EXT(container->header.reserve_count.load(boost::memory_order_relaxed) < limit))
+	{
+	    // Every producer gets a distinct index in one step, however many race for it.
+	    // Nothing is published through the counter, so it needs no ordering.
+	    log_index index = container->header.reserve_count.fetch_add(1, boost::memory_order_relaxed);
+	    if (LIKELY_EXT(index < limit))
+	    {
+		if (index > container->header.max_index)
+		{
+		    // The slot holds an entry truncated away, which a reader may still be copying out
+		    claim(container, index);
+		}
+		container->log[index % (container->header.max_index + 1)] = entry;
+		publish(container, index);
+		result = index;
+	    }
+	    else
+	    {
+		skip(container, index);
+	    }
+	    advance_commit(container);
+	}
+    }
+    return result;
+}
+
+template <class entry_t>
+template <class iterator_t>
+boost::optional<log_index> log_owner_handle<entry_t>::append_batch(iterator_t first, iterator_t last)
+{
+    log_container<entry_t>* container = static_cast<log_container<entry_t>*>(region_.get_address());
+    assert(container);
+    boost::optional<log_index> result;
+    std::size_t count = std::distance(first, last);
+    log_index slots = container->header.max_index + 1;
+    if (count && container->header.overflow == log_wraps_around)
+    {
+	log_index index = container->header.reserve_count.fetch_add(count, boost::memory_order_relaxed);
+	result = index;
+	if (UNLIKELY_EXT(count > slots))
+	{
+	    // The leading entries would only be overwritten by the trailing ones
+	    std::advance(first, count - slots);
+	    index += count - slots;
+	}
+	for (; first != last; ++first, ++index)
+	{
+	    if (LIKELY_EXT(claim(container, index)))
+	    {
+		container->log[index % slots] = *first;
+		publish(container, index);
+	    }
+	}
+	advance_commit(container);
+    }
+    else if (count)
+    {
+	log_index limit = container->header.front_index.load(boost::memory_order_acquire) + slots;
+	if (LIKELY_EXT(container->header.reserve_count.load(boost::memory_order_relaxed) < limit))
 	{
-	    if (expected_back_index != container->header.get_null_index())
+	    // No more than the slots ever fit, so no more are reserved
+	    log_index index = container->header.reserve_count.fetch_add(std::min<log_index>(count, slots), boost::memory_order_relaxed);
+	    log_index end = index + std::min<log_index>(count, slots);
+	    if (LIKELY_EXT(index < limit))
 	    {
-		// Another writer beaten this thread to making the first append
-		desired_back_index = expected_back_index + 1;
+		result = index;
 	    }
-	    if (desired_back_index > container->header.max_index)
+	    for (; index < end; ++index)
 	    {
-		break;
+		if (index < limit)
+		{
+		    if (index > container->header.max_index)
+		    {
+			claim(container, index);
+		    }
+		    container->log[index % slots] = *first;
+		    ++first;
+		    publish(container, index);
+		}
+		else
+		{
+		    skip(container, index);
+		}
 	    }
-	    boost::this_thread::sleep_for(boost::chrono::nanoseconds(generator(seed)));
+	    advance_commit(container);
 	}
-	container->log[desired_back_index] = entry;
-	result = desired_back_index;
     }
     return result;
 }
 
+template <class entry_t>
+log_index log_owner_handle<entry_t>::truncate_front(const log_index& index)
+{
+    log_container<entry_t>* container = static_cast<log_container<entry_t>*>(region_.get_address());
+    assert(container);
+    // The checkpoints are read before the front moves, so the entries readers are done with
+    // are only overwritten after they were done reading them
+    log_checkpoint_table& table = container->header.checkpoint_table;
+    table.begin_truncation();
+    log_index target = table.get_lowest(std::min(index, container->header.get_committed_count()));
+    log_index front = container->header.front_index.load(boost::memory_order_seq_cst);
+    bool moved = false;
+    while (!moved && front < target)
+    {
+	moved = container->header.front_index.compare_exchange_weak(front, target, boost::memory_order_seq_cst);
+    }
+    table.end_truncation();
+    return moved ? target : front;
+}
+
+template <class entry_t>
+bool log_owner_handle<entry_t>::claim(log_container<entry_t>* container, log_index index)
+{
+    typename log_container<entry_t>::marker_type& marker =
+	    container->get_commit_markers()[index % (container->header.max_index + 1)];
+    log_index current = marker.load(boost::memory_order_acquire);
+    bool claimed = false;
+    // Gives up when a producer a lap or more ahead has taken the slot already,
+    // the entry then counting as appended and overwritten at once
+    while (!claimed && (current & LOG_MARKER_INDEX) < index + 1)
+    {
+	if (UNLIKELY_EXT(current & LOG_MARKER_WRITING))
+	{
+	    // A producer a lap behind is still copying its entry in
+	    boost::this_thread::yield();
+	    current = marker.load(boost::memory_order_acquire);
+	}
+	else
+	{
+	    claimed = marker.compare_exchange_weak(current, (index + 1) | LOG_MARKER_WRITING,
+		    boost::memory_order_acquire, boost::memory_order_acquire);
+	}
+    }
+    // A reader checking the marker once done with the entry has to see the slot taken
+    // before it can see any part of the new entry
+    boost::atomic_thread_fence(boost::memory_order_release);
+    return claimed;
+}
+
+template <class entry_t>
+void log_owner_handle<entry_t>::skip(log_container<entry_t>* container, log_index index)
+{
+    log_index slots = container->header.max_index + 1;
+    typename log_container<entry_t>::marker_type& marker = container->get_commit_markers()[index % slots];
+    log_index current = marker.load(boost::memory_order_acquire);
+    bool skipped = false;
+    // The index can't be handed back, so it is counted as a lap skipped after the entry still in the slot,
+    // for the commit count to pass over once the front has moved past that entry and the slot is free again.
+    // Laps are only counted on in turn, so the producer of the index a lap behind has to be done with it first.
+    while (!skipped)
+    {
+	log_index held = current & LOG_MARKER_INDEX;
+	if (UNLIKELY_EXT((current & LOG_MARKER_WRITING) ||
+		held + (((current & LOG_MARKER_SKIPS) >> LOG_MARKER_SKIP_SHIFT) + 1) * slots != index + 1))
+	{
+	    boost::this_thread::yield();
+	    current = marker.load(boost::memory_order_acquire);
+	}
+	else
+	{
+	    assert((current & LOG_MARKER_SKIPS) != LOG_MARKER_SKIPS);
+	    skipped = marker.compare_exchange_weak(current, current + (static_cast<log_index>(1) << LOG_MARKER_SKIP_SHIFT),
+		    boost::memory_order_release, boost::memory_order_acquire);
+	}
+    }
+}
+
+template <class entry_t>
+void log_owner_handle<entry_t>::publish(log_container<entry_t>* container, log_index index)
+{
+    container->get_commit_markers()[index % (container->header.max_index + 1)].store(index + 1, boost::memory_order_release);
+}
+
+template <class entry_t>
+bool log_owner_handle<entry_t>::can_commit(log_index marker, log_index index, log_index slots, log_index limit)
+{
+    return is_log_index_settled(marker, index) || (index < limit && is_log_index_skipped(marker, index, slots));
+}
+
+template <class entry_t>
+void log_owner_handle<entry_t>::advance_commit(log_container<entry_t>* container)
+{
+    const typename log_container<entry_t>::marker_type* markers = container->get_commit_markers();
+    log_index slots = container->header.max_index + 1;
+    // Carry the commit count over the whole run of indexes already settled, whoever wrote them.
+    // A failed exchange means another producer moved it on, so carry on from there.
+    // When the log stops when full, no index a lap past the commit count is ever published,
+    // and the indexes skipped by appends that found it full are passed over below the limit only.
+    log_index limit = container->header.overflow == log_stops_when_full ?
+	    container->header.front_index.load(boost::memory_order_acquire) + slots : 0U;
+    log_index committed = container->header.commit_count.load(boost::memory_order_acquire);
+    bool advanced = false;
+    while (can_commit(markers[committed % slots].load(boost::memory_order_acquire), committed, slots, limit))
+    {
+	log_index settled = committed + 1;
+	while (can_commit(markers[settled % slots].load(boost::memory_order_acquire), settled, slots, limit))
+	{
+	    ++settled;
+	}
+	if (container->header.commit_count.compare_exchange_weak(committed, settled,
+		boost::memory_order_acq_rel, boost::memory_order_acquire))
+	{
+	    committed = settled;
+	    advanced = true;
+	}
+    }
+    if (advanced)
+    {
+	boost::atomic_thread_fence(boost::memory_order_seq_cst);
+	if (UNLIKELY_EXT(container->header.waiter_count.load(boost::memory_order_relaxed)))
+	{
+	    container->header.wake_sequence.fetch_add(1, boost::memory_order_release);
+	    wake_log_futex(container->header.wake_sequence);
+	}
+    }
+}
+
 } // namespace storage
 } // namespace supernova
 
@@ -19,12 +19,19 @@ public:
     log_mmap_reader(const boost::filesystem::path& path);
     ~log_mmap_reader();
     inline boost::optional<const entry_t&> read(const log_index& index) const;
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline bool is_overwritten(const log_index& index) const;
     inline boost::optional<log_index> get_front_index() const;
     inline boost::optional<log_index> get_back_index() const;
     inline log_index get_max_index() const;
+    inline bool wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const;
+    inline log_index set_checkpoint(const log_index& index);
 private:
     boost::interprocess::file_mapping file_;
+    // Read only when the file can't be written to, in which case wait_for and set_checkpoint throw storage_error
+    boost::interprocess::mode_t mode_;
     boost::interprocess::mapped_region region_;
+    boost::interprocess::mapped_region header_region_;
     log_reader_handle<entry_t> reader_handle_;
 };
 
@@ -32,10 +39,14 @@ template <class entry_t>
 class log_mmap_owner : private boost::noncopyable
 {
 public:
-    log_mmap_owner(const boost::filesystem::path& path, std::size_t size);
+    log_mmap_owner(const boost::filesystem::path& path, std::size_t size, log_overflow overflow = log_stops_when_full);
     ~log_mmap_owner();
     inline boost::optional<log_index> append(const entry_t& entry);
+    template <class iterator_t> inline boost::optional<log_index> append_batch(iterator_t first, iterator_t last);
+    inline log_index truncate_front(const log_index& index);
     inline boost::optional<const entry_t&> read(const log_index& index) const;
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline bool is_overwritten(const log_index& index) const;
     inline boost::optional<log_index> get_front_index() const;
     inline boost::optional<log_index> get_back_index() const;
     inline log_index get_max_index() const;
@@ -13,12 +13,17 @@ namespace bip = boost::interprocess;
 namespace supernova {
 namespace storage {
 
+// Opens the file for writing if allowed to, else for reading, and returns the mode it was opened in
+bip::mode_t open_log_file(bip::file_mapping& file, const bfs::path& path);
+
 template <class entry_t>
 log_mmap_reader<entry_t>::log_mmap_reader(const bfs::path& path)
 try :
-    file_(path.string().c_str(), bip::read_only),
+    file_(),
+    mode_(open_log_file(file_, path)),
     region_(file_, bip::read_only, 0U, bfs::file_size(path)),
-    reader_handle_(region_)
+    header_region_(),
+    reader_handle_(region_, map_log_header(file_, mode_, header_region_))
 {
 }
 catch (storage_condition& cond)
@@ -42,6 +47,18 @@ boost::optional<const entry_t&> log_mmap_reader<entry_t>::read(const log_index&
     return reader_handle_.read(index);
 }
 
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_mmap_reader<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    return reader_handle_.read_range(from, count);
+}
+
+template <class entry_t>
+bool log_mmap_reader<entry_t>::is_overwritten(const log_index& index) const
+{
+    return reader_handle_.is_overwritten(index);
+}
+
 template <class entry_t>
 boost::optional<log_index> log_mmap_reader<entry_t>::get_front_index() const
 {
@@ -60,17 +77,29 @@ log_index log_mmap_reader<entry_t>::get_max_index() const
     return reader_handle_.get_max_index();
 }
 
+template <class entry_t>
+bool log_mmap_reader<entry_t>::wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const
+{
+    return reader_handle_.wait_for(index, timeout);
+}
+
+template <class entry_t>
+log_index log_mmap_reader<entry_t>::set_checkpoint(const log_index& index)
+{
+    return reader_handle_.set_checkpoint(index);
+}
+
 const bfs::path& init_file(const bfs::path& path, std::size_t size);
 
 template <class entry_t>
-log_mmap_owner<entry_t>::log_mmap_owner(const bfs::path& path, std::size_t size)
+log_mmap_owner<entry_t>::log_mmap_owner(const bfs::path& path, std::size_t size, log_overflow overflow)
 try :
     exists_(bfs::exists(path)),
     flock_(init_file(path, size).string().c_str()),
     slock_(flock_),
     file_(path.string().c_str(), bip::read_write),
     region_(file_, bip::read_write, 0U, bfs::file_size(path)),
-    owner_handle_(exists_ ? open_existing : open_new, region_),
+    owner_handle_(exists_ ? open_existing : open_new, region_, overflow),
     reader_handle_(region_)
 {
     region_.flush();
@@ -96,12 +125,37 @@ boost::optional<log_index> log_mmap_owner<entry_t>::append(const entry_t& entry)
     return owner_handle_.append(entry);
 }
 
+template <class entry_t>
+template <class iterator_t>
+boost::optional<log_index> log_mmap_owner<entry_t>::append_batch(iterator_t first, iterator_t last)
+{
+    return owner_handle_.append_batch(first, last);
+}
+
+template <class entry_t>
+log_index log_mmap_owner<entry_t>::truncate_front(const log_index& index)
+{
+    return owner_handle_.truncate_front(index);
+}
+
 template <class entry_t>
 boost::optional<const entry_t&> log_mmap_owner<entry_t>::read(const log_index& index) const
 {
     return reader_handle_.read(index);
 }
 
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_mmap_owner<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    return reader_handle_.read_range(from, count);
+}
+
+template <class entry_t>
+bool log_mmap_owner<entry_t>::is_overwritten(const log_index& index) const
+{
+    return reader_handle_.is_overwritten(index);
+}
+
 template <class entry_t>
 boost::optional<log_index> log_mmap_owner<entry_t>::get_front_index() const
 {
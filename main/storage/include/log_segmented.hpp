@@ -0,0 +1,112 @@
+#ifndef SUPERNOVA_STORAGE_LOG_SEGMENTED_HPP
+#define SUPERNOVA_STORAGE_LOG_SEGMENTED_HPP
+
+#include <map>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "log_memory.hpp"
+#include "log_mmap.hpp"
+
+namespace supernova {
+namespace storage {
+
+static const std::size_t LOG_SEGMENT_LIMIT = 1024;
+
+// Which of the full segments to delete when the log rolls over to a new one.
+// A segment goes once any one of the limits is exceeded, oldest first,
+// but the segment being appended to and those holding the checkpoint of a reader are always kept.
+struct log_retention
+{
+    log_retention();
+    // No more than the given number of segments, 0 for no limit other than LOG_SEGMENT_LIMIT less the one kept free to roll over to
+    log_retention& keep_count(std::size_t count);
+    // No segment holding only entries older than this, not_a_date_time for no limit
+    log_retention& keep_age(const boost::posix_time::time_duration& age);
+    // No more than this many bytes of segment files, 0 for no limit
+    log_retention& keep_size(boost::uint64_t size);
+    std::size_t max_count;
+    boost::posix_time::time_duration max_age;
+    boost::uint64_t max_size;
+};
+
+// A log spread over a directory of segment files of the same size, each one a log_mmap log,
+// with a manifest of the segments retained and the range of indexes each one holds.
+// Readers map the segments as they reach them.
+// A reader is meant for one thread at a time, as it keeps the segments it has mapped.
+template <class entry_t>
+class log_segmented_reader : private boost::noncopyable
+{
+public:
+    log_segmented_reader(const boost::filesystem::path& path);
+    ~log_segmented_reader();
+    inline boost::optional<const entry_t&> read(const log_index& index) const;
+    // Stops short at the end of the segment holding the index
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline boost::optional<log_index> get_front_index() const;
+    inline boost::optional<log_index> get_back_index() const;
+    inline log_index get_segment_capacity() const;
+    // Keeps truncate_front and retention from removing the segment holding the index, until moved on or the reader goes away.
+    // Returns the index held, which is the front index instead when the log has been truncated past the index.
+    // Throws busy_condition in the same cases as log_reader_handle::set_checkpoint.
+    log_index set_checkpoint(const log_index& index);
+    inline std::size_t get_mapped_count() const;
+private:
+    const log_mmap_reader<entry_t>* find_segment(boost::uint64_t sequence) const;
+    const boost::filesystem::path path_;
+    boost::interprocess::file_mapping manifest_file_;
+    boost::interprocess::mapped_region manifest_region_;
+    mutable std::map< boost::uint64_t, boost::shared_ptr< log_mmap_reader<entry_t> > > segments_;
+    boost::optional<std::size_t> checkpoint_;
+};
+
+template <class entry_t>
+class log_segmented_owner : private boost::noncopyable
+{
+public:
+    log_segmented_owner(const boost::filesystem::path& path, std::size_t segment_size, const log_retention& retention = log_retention());
+    ~log_segmented_owner();
+    // Rolls over to a new segment whenever the current one is full, so only fails by throwing.
+    // Throws busy_condition when the checkpoints of readers hold LOG_SEGMENT_LIMIT segments back from retention.
+    inline boost::optional<log_index> append(const entry_t& entry);
+    // A batch running past the end of a segment carries on in the next one,
+    // where other producers may have appended in between
+    template <class iterator_t> inline boost::optional<log_index> append_batch(iterator_t first, iterator_t last);
+    // For the age limit, which can be exceeded without the log rolling over
+    void apply_retention();
+    // Moves the front index up to the index, but not past the checkpoint of any reader nor past the back of the log,
+    // removing the segments wholly below it but for the one being appended to. Returns the front index reached.
+    log_index truncate_front(const log_index& index);
+    inline boost::optional<log_index> get_front_index() const;
+    inline boost::optional<log_index> get_back_index() const;
+    inline log_index get_segment_capacity() const;
+    inline std::size_t get_segment_count() const;
+private:
+    struct segment;
+    void roll(const boost::shared_ptr<segment>& full);
+    void apply_retention_locked();
+    void remove_front_segment_locked();
+    const boost::filesystem::path path_;
+    const log_retention retention_;
+    boost::interprocess::file_lock flock_;
+    boost::interprocess::scoped_lock<boost::interprocess::file_lock> slock_;
+    boost::interprocess::file_mapping manifest_file_;
+    boost::interprocess::mapped_region manifest_region_;
+    boost::mutex roll_mutex_;
+    // Swapped with the atomic shared_ptr functions, so producers still appending
+    // to a segment the log has rolled away from keep it mapped
+    boost::shared_ptr<segment> current_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
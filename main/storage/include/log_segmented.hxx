@@ -0,0 +1,493 @@
+#ifndef SUPERNOVA_STORAGE_LOG_SEGMENTED_HXX
+#define SUPERNOVA_STORAGE_LOG_SEGMENTED_HXX
+
+#include "log_segmented.hpp"
+#include <boost/atomic.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/locks.hpp>
+#include <supernova/core/compiler_extensions.hpp>
+#include <supernova/storage/exception.hpp>
+#include "log_mmap.hxx"
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+
+namespace supernova {
+namespace storage {
+
+struct log_segment_record
+{
+    log_index first_index;
+    // Microseconds since the epoch, which is also when the previous segment was closed
+    boost::int64_t created_at;
+};
+
+struct log_segment_manifest
+{
+    boost::uint16_t endianess_indicator;
+    char file_type_tag[48];
+    version memory_version;
+    boost::uint16_t manifest_size;
+    boost::uint64_t segment_size;
+    // Entries per segment, 0 until the first segment has been created
+    boost::atomic<log_index> segment_capacity;
+    // The segments retained, the newest one being appended to.
+    // Readers check the front again after mapping a segment, as it is removed once the front has moved past it.
+    boost::atomic<boost::uint64_t> front_sequence;
+    boost::atomic<boost::uint64_t> back_sequence;
+    // Where truncate_front has moved the front to, the segments wholly below it being removed
+    boost::atomic<log_index> front_index;
+    log_checkpoint_table checkpoint_table;
+    // By sequence modulo LOG_SEGMENT_LIMIT
+    log_segment_record records[LOG_SEGMENT_LIMIT];
+};
+
+// Returns the path of the manifest
+bfs::path init_segment_directory(const bfs::path& path, std::size_t segment_size);
+void check_segment_manifest(const log_segment_manifest* manifest, std::size_t region_size);
+bfs::path segment_path(const bfs::path& path, boost::uint64_t sequence);
+boost::int64_t get_segment_clock();
+
+template <class entry_t>
+log_segmented_reader<entry_t>::log_segmented_reader(const bfs::path& path)
+try :
+    path_(path),
+    manifest_file_((path / "manifest").string().c_str(), bip::read_write),
+    manifest_region_(manifest_file_, bip::read_write),
+    segments_(),
+    checkpoint_()
+{
+    check_segment_manifest(static_cast<const log_segment_manifest*>(manifest_region_.get_address()), manifest_region_.get_size());
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(path.string());
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(path.string());
+    throw err;
+}
+
+template <class entry_t>
+log_segmented_reader<entry_t>::~log_segmented_reader()
+{
+    if (checkpoint_)
+    {
+	static_cast<log_segment_manifest*>(manifest_region_.get_address())->checkpoint_table.release(checkpoint_.get());
+    }
+}
+
+template <class entry_t>
+const log_mmap_reader<entry_t>* log_segmented_reader<entry_t>::find_segment(boost::uint64_t sequence) const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    boost::uint64_t front = manifest->front_sequence.load(boost::memory_order_acquire);
+    // Unmap the segments the owner has deleted since
+    segments_.erase(segments_.begin(), segments_.lower_bound(front));
+    if (sequence < front || sequence > manifest->back_sequence.load(boost::memory_order_acquire))
+    {
+	return 0;
+    }
+    typename std::map< boost::uint64_t, boost::shared_ptr< log_mmap_reader<entry_t> > >::const_iterator iter = segments_.find(sequence);
+    if (iter == segments_.end())
+    {
+	try
+	{
+	    iter = segments_.insert(std::make_pair(sequence,
+		    boost::make_shared< log_mmap_reader<entry_t> >(segment_path(path_, sequence)))).first;
+	}
+	catch (bip::interprocess_exception&)
+	{
+	    if (sequence >= manifest->front_sequence.load(boost::memory_order_acquire))
+	    {
+		throw;
+	    }
+	    // Deleted while this reader was getting to it
+	    return 0;
+	}
+    }
+    return iter->second.get();
+}
+
+template <class entry_t>
+boost::optional<const entry_t&> log_segmented_reader<entry_t>::read(const log_index& index) const
+{
+    boost::optional<const entry_t&> result;
+    log_index capacity = get_segment_capacity();
+    if (LIKELY_EXT(capacity))
+    {
+	const log_mmap_reader<entry_t>* segment = find_segment(index / capacity);
+	if (segment)
+	{
+	    result = segment->read(index % capacity);
+	}
+    }
+    return result;
+}
+
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_segmented_reader<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    boost::iterator_range<const entry_t*> result;
+    log_index capacity = get_segment_capacity();
+    if (LIKELY_EXT(capacity))
+    {
+	const log_mmap_reader<entry_t>* segment = find_segment(from / capacity);
+	if (segment)
+	{
+	    result = segment->read_range(from % capacity, count);
+	}
+    }
+    return result;
+}
+
+template <class entry_t>
+boost::optional<log_index> log_segmented_reader<entry_t>::get_front_index() const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    boost::optional<log_index> result;
+    if (get_back_index())
+    {
+	result = std::max(manifest->front_index.load(boost::memory_order_acquire),
+		manifest->front_sequence.load(boost::memory_order_acquire) * get_segment_capacity());
+    }
+    return result;
+}
+
+template <class entry_t>
+boost::optional<log_index> log_segmented_reader<entry_t>::get_back_index() const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    boost::optional<log_index> result;
+    log_index capacity = get_segment_capacity();
+    boost::uint64_t back = manifest->back_sequence.load(boost::memory_order_acquire);
+    const log_mmap_reader<entry_t>* segment = capacity ? find_segment(back) : 0;
+    boost::optional<log_index> segment_back = segment ? segment->get_back_index() : boost::none;
+    if (segment_back)
+    {
+	result = back * capacity + segment_back.get();
+    }
+    else if (back)
+    {
+	// Nothing in the newest segment yet, so the one before is full
+	result = back * capacity - 1;
+    }
+    return result;
+}
+
+template <class entry_t>
+log_index log_segmented_reader<entry_t>::get_segment_capacity() const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    return manifest->segment_capacity.load(boost::memory_order_acquire);
+}
+
+template <class entry_t>
+log_index log_segmented_reader<entry_t>::set_checkpoint(const log_index& index)
+{
+    log_segment_manifest* manifest = static_cast<log_segment_manifest*>(manifest_region_.get_address());
+    if (checkpoint_)
+    {
+	manifest->checkpoint_table.move(checkpoint_.get(), index);
+    }
+    else
+    {
+	checkpoint_ = manifest->checkpoint_table.claim(index);
+	if (UNLIKELY_EXT(!checkpoint_))
+	{
+	    throw busy_condition("No log checkpoint available")
+		    << info_component_identity("log_segmented");
+	}
+    }
+    if (UNLIKELY_EXT(!manifest->checkpoint_table.wait_for_truncations()))
+    {
+	throw busy_condition("Log truncation under way for too long")
+		<< info_component_identity("log_segmented");
+    }
+    // A truncation or retention that missed the checkpoint has already moved the front past the index
+    log_index front = manifest->front_index.load(boost::memory_order_seq_cst);
+    if (front > index)
+    {
+	manifest->checkpoint_table.move(checkpoint_.get(), front);
+    }
+    return std::max(index, front);
+}
+
+template <class entry_t>
+std::size_t log_segmented_reader<entry_t>::get_mapped_count() const
+{
+    return segments_.size();
+}
+
+template <class entry_t>
+struct log_segmented_owner<entry_t>::segment : private boost::noncopyable
+{
+    segment(const bfs::path& path, boost::uint64_t seq, std::size_t size);
+    const boost::uint64_t sequence;
+    log_mmap_owner<entry_t> owner;
+};
+
+template <class entry_t>
+log_segmented_owner<entry_t>::segment::segment(const bfs::path& path, boost::uint64_t seq, std::size_t size) :
+    sequence(seq),
+    owner(segment_path(path, seq), size)
+{ }
+
+template <class entry_t>
+log_segmented_owner<entry_t>::log_segmented_owner(const bfs::path& path, std::size_t segment_size, const log_retention& retention)
+try :
+    path_(path),
+    retention_(retention),
+    flock_(init_segment_directory(path, segment_size).string().c_str()),
+    slock_(flock_),
+    manifest_file_((path / "manifest").string().c_str(), bip::read_write),
+    manifest_region_(manifest_file_, bip::read_write),
+    roll_mutex_(),
+    current_()
+{
+    log_segment_manifest* manifest = static_cast<log_segment_manifest*>(manifest_region_.get_address());
+    check_segment_manifest(manifest, manifest_region_.get_size());
+    boost::uint64_t back = manifest->back_sequence.load(boost::memory_order_acquire);
+    current_ = boost::make_shared<segment>(path, back, manifest->segment_size);
+    if (!manifest->segment_capacity.load(boost::memory_order_acquire))
+    {
+	manifest->records[0].first_index = 0U;
+	manifest->records[0].created_at = get_segment_clock();
+	manifest->segment_capacity.store(current_->owner.get_max_index() + 1, boost::memory_order_release);
+    }
+    else if (UNLIKELY_EXT(manifest->segment_capacity.load(boost::memory_order_acquire) != current_->owner.get_max_index() + 1))
+    {
+	throw malformed_db_error("Segment capacity mismatch")
+		<< info_component_identity("log_segmented");
+    }
+    manifest_region_.flush();
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(path.string());
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(path.string());
+    throw err;
+}
+
+template <class entry_t>
+log_segmented_owner<entry_t>::~log_segmented_owner()
+{ }
+
+template <class entry_t>
+boost::optional<log_index> log_segmented_owner<entry_t>::append(const entry_t& entry)
+{
+    boost::optional<log_index> result;
+    log_index capacity = get_segment_capacity();
+    while (!result)
+    {
+	boost::shared_ptr<segment> current = boost::atomic_load(&current_);
+	boost::optional<log_index> local = current->owner.append(entry);
+	if (local)
+	{
+	    result = current->sequence * capacity + local.get();
+	}
+	else
+	{
+	    roll(current);
+	}
+    }
+    return result;
+}
+
+template <class entry_t>
+template <class iterator_t>
+boost::optional<log_index> log_segmented_owner<entry_t>::append_batch(iterator_t first, iterator_t last)
+{
+    boost::optional<log_index> result;
+    log_index capacity = get_segment_capacity();
+    while (first != last)
+    {
+	boost::shared_ptr<segment> current = boost::atomic_load(&current_);
+	boost::optional<log_index> local = current->owner.append_batch(first, last);
+	if (local)
+	{
+	    if (!result)
+	    {
+		result = current->sequence * capacity + local.get();
+	    }
+	    // The entries that fitted in the segment
+	    std::advance(first, std::min<log_index>(std::distance(first, last), capacity - local.get()));
+	}
+	else
+	{
+	    roll(current);
+	}
+    }
+    return result;
+}
+
+template <class entry_t>
+void log_segmented_owner<entry_t>::roll(const boost::shared_ptr<segment>& full)
+{
+    boost::lock_guard<boost::mutex> guard(roll_mutex_);
+    if (boost::atomic_load(&current_) != full)
+    {
+	// Another producer has rolled over already
+	return;
+    }
+    log_segment_manifest* manifest = static_cast<log_segment_manifest*>(manifest_region_.get_address());
+    boost::uint64_t next = full->sequence + 1;
+    // Retention leaves a record free, so the table only fills up with segments held by checkpoints,
+    // which may have moved on since. The record of the next segment would otherwise be that of the front one.
+    if (UNLIKELY_EXT(next - manifest->front_sequence.load(boost::memory_order_acquire) >= LOG_SEGMENT_LIMIT))
+    {
+	apply_retention_locked();
+	if (next - manifest->front_sequence.load(boost::memory_order_acquire) >= LOG_SEGMENT_LIMIT)
+	{
+	    throw busy_condition("Log segments held by checkpoints fill the manifest")
+		    << info_component_identity("log_segmented");
+	}
+    }
+    boost::shared_ptr<segment> created = boost::make_shared<segment>(path_, next, manifest->segment_size);
+    log_segment_record& record = manifest->records[next % LOG_SEGMENT_LIMIT];
+    record.first_index = next * get_segment_capacity();
+    record.created_at = get_segment_clock();
+    manifest->back_sequence.store(next, boost::memory_order_release);
+    boost::atomic_store(&current_, created);
+    apply_retention_locked();
+}
+
+template <class entry_t>
+void log_segmented_owner<entry_t>::apply_retention()
+{
+    boost::lock_guard<boost::mutex> guard(roll_mutex_);
+    apply_retention_locked();
+}
+
+template <class entry_t>
+void log_segmented_owner<entry_t>::apply_retention_locked()
+{
+    log_segment_manifest* manifest = static_cast<log_segment_manifest*>(manifest_region_.get_address());
+    boost::uint64_t front = manifest->front_sequence.load(boost::memory_order_acquire);
+    boost::uint64_t back = manifest->back_sequence.load(boost::memory_order_acquire);
+    boost::int64_t now = get_segment_clock();
+    std::size_t max_count = std::min(retention_.max_count ? retention_.max_count : LOG_SEGMENT_LIMIT, LOG_SEGMENT_LIMIT - 1);
+    boost::uint64_t keep = front;
+    bool expired = true;
+    while (keep < back && expired)
+    {
+	std::size_t count = back - keep + 1;
+	// A segment stopped taking entries when the one after it was created
+	boost::int64_t closed_at = manifest->records[(keep + 1) % LOG_SEGMENT_LIMIT].created_at;
+	expired = count > max_count ||
+		(retention_.max_size && count * manifest->segment_size > retention_.max_size) ||
+		(!retention_.max_age.is_special() && now - closed_at > retention_.max_age.total_microseconds());
+	if (expired)
+	{
+	    ++keep;
+	}
+    }
+    if (keep > front)
+    {
+	// Segments expire like truncate_front removes them, so none holding a checkpoint goes
+	log_index capacity = get_segment_capacity();
+	manifest->checkpoint_table.begin_truncation();
+	keep = std::max(front, manifest->checkpoint_table.get_lowest(keep * capacity) / capacity);
+	if (manifest->front_index.load(boost::memory_order_seq_cst) < keep * capacity)
+	{
+	    manifest->front_index.store(keep * capacity, boost::memory_order_seq_cst);
+	}
+	manifest->checkpoint_table.end_truncation();
+	for (; front < keep; ++front)
+	{
+	    remove_front_segment_locked();
+	}
+    }
+}
+
+template <class entry_t>
+log_index log_segmented_owner<entry_t>::truncate_front(const log_index& index)
+{
+    boost::lock_guard<boost::mutex> guard(roll_mutex_);
+    log_segment_manifest* manifest = static_cast<log_segment_manifest*>(manifest_region_.get_address());
+    boost::optional<log_index> back = get_back_index();
+    manifest->checkpoint_table.begin_truncation();
+    log_index target = manifest->checkpoint_table.get_lowest(std::min(index, back ? back.get() + 1 : 0U));
+    log_index front = manifest->front_index.load(boost::memory_order_seq_cst);
+    if (front < target)
+    {
+	front = target;
+	manifest->front_index.store(front, boost::memory_order_seq_cst);
+    }
+    manifest->checkpoint_table.end_truncation();
+    log_index capacity = get_segment_capacity();
+    while (manifest->front_sequence.load(boost::memory_order_acquire) < manifest->back_sequence.load(boost::memory_order_acquire) &&
+	    (manifest->front_sequence.load(boost::memory_order_acquire) + 1) * capacity <= front)
+    {
+	remove_front_segment_locked();
+    }
+    return std::max(front, manifest->front_sequence.load(boost::memory_order_acquire) * capacity);
+}
+
+template <class entry_t>
+void log_segmented_owner<entry_t>::remove_front_segment_locked()
+{
+    log_segment_manifest* manifest = static_cast<log_segment_manifest*>(manifest_region_.get_address());
+    boost::uint64_t front = manifest->front_sequence.load(boost::memory_order_acquire);
+    manifest->front_sequence.store(front + 1, boost::memory_order_release);
+    boost::system::error_code error;
+    bfs::remove(segment_path(path_, front), error);
+}
+
+template <class entry_t>
+boost::optional<log_index> log_segmented_owner<entry_t>::get_front_index() const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    boost::optional<log_index> result;
+    if (get_back_index())
+    {
+	result = std::max(manifest->front_index.load(boost::memory_order_acquire),
+		manifest->front_sequence.load(boost::memory_order_acquire) * get_segment_capacity());
+    }
+    return result;
+}
+
+template <class entry_t>
+boost::optional<log_index> log_segmented_owner<entry_t>::get_back_index() const
+{
+    boost::optional<log_index> result;
+    log_index capacity = get_segment_capacity();
+    boost::shared_ptr<segment> current = boost::atomic_load(&current_);
+    boost::optional<log_index> segment_back = current->owner.get_back_index();
+    if (segment_back)
+    {
+	result = current->sequence * capacity + segment_back.get();
+    }
+    else if (current->sequence)
+    {
+	result = current->sequence * capacity - 1;
+    }
+    return result;
+}
+
+template <class entry_t>
+log_index log_segmented_owner<entry_t>::get_segment_capacity() const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    return manifest->segment_capacity.load(boost::memory_order_acquire);
+}
+
+template <class entry_t>
+std::size_t log_segmented_owner<entry_t>::get_segment_count() const
+{
+    const log_segment_manifest* manifest = static_cast<const log_segment_manifest*>(manifest_region_.get_address());
+    return manifest->back_sequence.load(boost::memory_order_acquire) - manifest->front_sequence.load(boost::memory_order_acquire) + 1;
+}
+
+} // namespace storage
+} // namespace supernova
+
+#endif
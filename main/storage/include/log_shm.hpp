@@ -17,13 +17,20 @@ public:
     log_shm_reader(const std::string& name);
     ~log_shm_reader();
     inline boost::optional<const entry_t&> read(const log_index& index) const;
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline bool is_overwritten(const log_index& index) const;
     inline boost::optional<log_index> get_front_index() const;
     inline boost::optional<log_index> get_back_index() const;
     inline log_index get_max_index() const;
+    inline bool wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const;
+    inline log_index set_checkpoint(const log_index& index);
 private:
     const std::string name_;
     boost::interprocess::shared_memory_object shm_;
+    // Read only when the memory can't be written to, in which case wait_for and set_checkpoint throw storage_error
+    boost::interprocess::mode_t mode_;
     boost::interprocess::mapped_region region_;
+    boost::interprocess::mapped_region header_region_;
     log_reader_handle<entry_t> reader_handle_;
 };
 
@@ -31,10 +38,14 @@ template <class entry_t>
 class log_shm_owner : private boost::noncopyable
 {
 public:
-    log_shm_owner(const std::string& name, std::size_t size);
+    log_shm_owner(const std::string& name, std::size_t size, log_overflow overflow = log_stops_when_full);
     ~log_shm_owner();
     inline boost::optional<log_index> append(const entry_t& entry);
+    template <class iterator_t> inline boost::optional<log_index> append_batch(iterator_t first, iterator_t last);
+    inline log_index truncate_front(const log_index& index);
     inline boost::optional<const entry_t&> read(const log_index& index) const;
+    inline boost::iterator_range<const entry_t*> read_range(const log_index& from, std::size_t count) const;
+    inline bool is_overwritten(const log_index& index) const;
     inline boost::optional<log_index> get_front_index() const;
     inline boost::optional<log_index> get_back_index() const;
     inline log_index get_max_index() const;
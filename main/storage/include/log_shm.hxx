@@ -11,12 +11,17 @@ namespace bip = boost::interprocess;
 namespace supernova {
 namespace storage {
 
+// Opens the memory for writing if allowed to, else for reading, and returns the mode it was opened in
+bip::mode_t open_log_shared_memory(bip::shared_memory_object& shm, const std::string& name);
+
 template <class entry_t>
 log_shm_reader<entry_t>::log_shm_reader(const std::string& name)
 try :
-    shm_(bip::open_only, name.c_str(), bip::read_only),
+    shm_(),
+    mode_(open_log_shared_memory(shm_, name)),
     region_(shm_, bip::read_only),
-    reader_handle_(region_)
+    header_region_(),
+    reader_handle_(region_, map_log_header(shm_, mode_, header_region_))
 {
 }
 catch (storage_condition& cond)
@@ -40,6 +45,18 @@ boost::optional<const entry_t&> log_shm_reader<entry_t>::read(const log_index& i
     return reader_handle_.read(index);
 }
 
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_shm_reader<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    return reader_handle_.read_range(from, count);
+}
+
+template <class entry_t>
+bool log_shm_reader<entry_t>::is_overwritten(const log_index& index) const
+{
+    return reader_handle_.is_overwritten(index);
+}
+
 template <class entry_t>
 boost::optional<log_index> log_shm_reader<entry_t>::get_front_index() const
 {
@@ -58,15 +75,27 @@ log_index log_shm_reader<entry_t>::get_max_index() const
     return reader_handle_.get_max_index();
 }
 
+template <class entry_t>
+bool log_shm_reader<entry_t>::wait_for(const log_index& index, const boost::posix_time::time_duration& timeout) const
+{
+    return reader_handle_.wait_for(index, timeout);
+}
+
+template <class entry_t>
+log_index log_shm_reader<entry_t>::set_checkpoint(const log_index& index)
+{
+    return reader_handle_.set_checkpoint(index);
+}
+
 bip::shared_memory_object& init_shared_memory(bip::shared_memory_object& shm, std::size_t size);
 
 template <class entry_t>
-log_shm_owner<entry_t>::log_shm_owner(const std::string& name, std::size_t size)
+log_shm_owner<entry_t>::log_shm_owner(const std::string& name, std::size_t size, log_overflow overflow)
 try :
     exists_(does_shm_exist(name)),
     shm_(bip::open_or_create, name.c_str(), bip::read_write),
     region_(init_shared_memory(shm_, size), bip::read_write, 0U, size),
-    owner_handle_(exists_ ? open_existing : open_new, region_),
+    owner_handle_(exists_ ? open_existing : open_new, region_, overflow),
     reader_handle_(region_)
 {
 }
@@ -93,12 +122,37 @@ boost::optional<log_index> log_shm_owner<entry_t>::append(const entry_t& entry)
     return owner_handle_.append(entry);
 }
 
+template <class entry_t>
+template <class iterator_t>
+boost::optional<log_index> log_shm_owner<entry_t>::append_batch(iterator_t first, iterator_t last)
+{
+    return owner_handle_.append_batch(first, last);
+}
+
+template <class entry_t>
+log_index log_shm_owner<entry_t>::truncate_front(const log_index& index)
+{
+    return owner_handle_.truncate_front(index);
+}
+
 template <class entry_t>
 boost::optional<const entry_t&> log_shm_owner<entry_t>::read(const log_index& index) const
 {
     return reader_handle_.read(index);
 }
 
+template <class entry_t>
+boost::iterator_range<const entry_t*> log_shm_owner<entry_t>::read_range(const log_index& from, std::size_t count) const
+{
+    return reader_handle_.read_range(from, count);
+}
+
+template <class entry_t>
+bool log_shm_owner<entry_t>::is_overwritten(const log_index& index) const
+{
+    return reader_handle_.is_overwritten(index);
+}
+
 template <class entry_t>
 boost::optional<log_index> log_shm_owner<entry_t>::get_front_index() const
 {
@@ -3,10 +3,10 @@
 
 #include <memory>
 #include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
 #include <boost/interprocess/interprocess_fwd.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/sync/interprocess_sharable_mutex.hpp>
-#include <boost/circular_buffer.hpp>
 
 namespace supernova {
 namespace storage {
@@ -20,19 +20,35 @@ public:
     typedef typename allocator_t::size_type size_type;
     typedef boost::interprocess::sharable_lock<boost::interprocess::interprocess_sharable_mutex> read_lock;
     typedef boost::interprocess::scoped_lock<boost::interprocess::interprocess_sharable_mutex> write_lock;
+    // The capacity must not be 0
     multi_reader_ring_buffer(size_type capacity, const allocator_t& allocator);
+    ~multi_reader_ring_buffer();
     const_element_ref_t front() const;
     void push_front(const_element_ref_t element);
+    // The constructor is called with the address of the new front slot and must placement new
+    // the element there; the element only becomes visible once the constructor has returned.
+    // It runs under the write lock, so every reader of the ring waits for it to return.
+    template <class constructor_t> void emplace_front(constructor_t constructor);
     const_element_ref_t back() const;
     void pop_back(const_element_ref_t back_element);
+    template <class predicate_t> boost::optional<const_element_ref_t> find_first(predicate_t predicate) const;
     void grow(size_type new_capacity);
     size_type capacity() const;
     size_type element_count() const;
     bool empty() const;
     bool full() const;
 private:
-    boost::interprocess::interprocess_sharable_mutex mutex_;
-    boost::circular_buffer<element_t, allocator_t> ringbuf_;
+    typedef typename allocator_t::pointer pointer_t;
+    size_type slot_index(size_type offset) const;
+    size_type previous_slot() const;
+    void destroy_back();
+    mutable boost::interprocess::interprocess_sharable_mutex mutex_;
+    // boost::circular_buffer can only copy an element in, so the slots are managed here
+    allocator_t allocator_;
+    pointer_t slots_;
+    size_type capacity_;
+    size_type first_;
+    size_type size_;
 };
 
 // TODO : replace the following with type aliases after moving to a C++11 compiler
@@ -1,11 +1,12 @@
 #ifndef SUPERNOVA_STORAGE_MULTI_READER_RING_BUFFER_HXX
 #define SUPERNOVA_STORAGE_MULTI_READER_RING_BUFFER_HXX
 
-#include <boost/circular_buffer.hpp>
 #include <boost/interprocess/managed_mapped_file.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/interprocess/sync/sharable_lock.hpp>
+#include <supernova/core/compiler_extensions.hpp>
+#include <supernova/storage/exception.hpp>
 #include "multi_reader_ring_buffer.hpp"
 
 namespace bi = boost::interprocess;
@@ -15,94 +16,199 @@ namespace storage {
 
 template <class element_t, class allocator_t>
 multi_reader_ring_buffer<element_t, allocator_t>::multi_reader_ring_buffer(size_type capacity, const allocator_t& allocator) :
-    ringbuf_(capacity, allocator)
-{ }
+    allocator_(allocator),
+    slots_(capacity ? allocator_.allocate(capacity) : pointer_t()),
+    capacity_(capacity),
+    first_(0),
+    size_(0)
+{
+    if (UNLIKELY_EXT(capacity_ == 0))
+    {
+	throw storage_error("Ring buffer capacity is 0")
+		<< info_component_identity("multi_reader_ring_buffer");
+    }
+}
 
 template <class element_t, class allocator_t>
-typename multi_reader_ring_buffer<element_t, allocator_t>::const_element_ref_t front_impl(
-	const boost::circular_buffer<element_t, allocator_t>& buf)
+multi_reader_ring_buffer<element_t, allocator_t>::~multi_reader_ring_buffer()
 {
-    // This hack is required because the circular_buffer documentation says it has
-    // an overload of the front member function returning a const reference, but 
-    // it doesn't exist in the code
-    return const_cast< boost::circular_buffer<element_t, allocator_t>& >(buf).front();
+    while (size_)
+    {
+	destroy_back();
+    }
+    if (slots_)
+    {
+	allocator_.deallocate(slots_, capacity_);
+    }
 }
 
 template <class element_t, class allocator_t>
 typename multi_reader_ring_buffer<element_t, allocator_t>::const_element_ref_t multi_reader_ring_buffer<element_t, allocator_t>::front() const
 {
-    read_lock(mutex_);
-    return front_impl<element_t, allocator_t>(ringbuf_);
+    read_lock lock(mutex_);
+    return slots_[first_];
 }
 
 template <class element_t, class allocator_t>
 void multi_reader_ring_buffer<element_t, allocator_t>::push_front(const_element_ref_t value)
 {
-    write_lock(mutex_);
-    ringbuf_.push_front(value);
+    write_lock lock(mutex_);
+    if (size_ == capacity_)
+    {
+	// same as boost::circular_buffer, a full ring overwrites its back element
+	destroy_back();
+    }
+    size_type slot = previous_slot();
+    allocator_.construct(slots_ + slot, value);
+    first_ = slot;
+    ++size_;
 }
 
 template <class element_t, class allocator_t>
-typename multi_reader_ring_buffer<element_t, allocator_t>::const_element_ref_t back_impl(
-	const boost::circular_buffer<element_t, allocator_t>& buf)
+template <class constructor_t>
+void multi_reader_ring_buffer<element_t, allocator_t>::emplace_front(constructor_t constructor)
 {
-    // This hack is required because the circular_buffer documentation says it has
-    // an overload of the back member function returning a const reference, but 
-    // it doesn't exist in the code
-    return const_cast< boost::circular_buffer<element_t, allocator_t>& >(buf).back();
+    write_lock lock(mutex_);
+    if (size_ == capacity_)
+    {
+	destroy_back();
+    }
+    size_type slot = previous_slot();
+    constructor(static_cast<void*>(&slots_[slot]));
+    first_ = slot;
+    ++size_;
 }
 
 template <class element_t, class allocator_t>
 typename multi_reader_ring_buffer<element_t, allocator_t>::const_element_ref_t multi_reader_ring_buffer<element_t, allocator_t>::back() const
 {
-    read_lock(mutex_);
-    return back_impl<element_t, allocator_t>(ringbuf_);
+    read_lock lock(mutex_);
+    return slots_[slot_index(size_ - 1)];
 }
 
 template <class element_t, class allocator_t>
 void multi_reader_ring_buffer<element_t, allocator_t>::pop_back(const_element_ref_t back_element)
 {
-    write_lock(mutex_);
-    const_element_ref_t current_back = back();
-    if (&back_element == &current_back)
+    write_lock lock(mutex_);
+    if (size_ && &back_element == &slots_[slot_index(size_ - 1)])
+    {
+	destroy_back();
+    }
+}
+
+// The elements from front to back must be partitioned by the predicate,
+// ie. all the elements failing the predicate come before all those that pass it
+template <class element_t, class allocator_t>
+template <class predicate_t>
+boost::optional<typename multi_reader_ring_buffer<element_t, allocator_t>::const_element_ref_t> multi_reader_ring_buffer<element_t, allocator_t>::find_first(predicate_t predicate) const
+{
+    read_lock lock(mutex_);
+    size_type low = 0;
+    size_type high = size_;
+    while (low < high)
     {
-	ringbuf_.pop_back();
+	size_type middle = low + ((high - low) / 2);
+	if (predicate(slots_[slot_index(middle)]))
+	{
+	    high = middle;
+	}
+	else
+	{
+	    low = middle + 1;
+	}
     }
+    boost::optional<const_element_ref_t> result;
+    if (low < size_)
+    {
+	result = slots_[slot_index(low)];
+    }
+    return result;
 }
 
 template <class element_t, class allocator_t>
 void multi_reader_ring_buffer<element_t, allocator_t>::grow(size_type new_capacity)
 {
-    write_lock(mutex_);
-    ringbuf_.set_capacity(new_capacity);
+    write_lock lock(mutex_);
+    if (new_capacity <= capacity_)
+    {
+	return;
+    }
+    pointer_t slots = allocator_.allocate(new_capacity);
+    size_type copied = 0;
+    try
+    {
+	for (; copied < size_; ++copied)
+	{
+	    allocator_.construct(slots + copied, slots_[slot_index(copied)]);
+	}
+    }
+    catch (...)
+    {
+	while (copied)
+	{
+	    allocator_.destroy(slots + --copied);
+	}
+	allocator_.deallocate(slots, new_capacity);
+	throw;
+    }
+    for (size_type offset = 0; offset < size_; ++offset)
+    {
+	allocator_.destroy(slots_ + slot_index(offset));
+    }
+    if (slots_)
+    {
+	allocator_.deallocate(slots_, capacity_);
+    }
+    slots_ = slots;
+    capacity_ = new_capacity;
+    first_ = 0;
 }
 
 template <class element_t, class allocator_t>
 typename multi_reader_ring_buffer<element_t, allocator_t>::size_type multi_reader_ring_buffer<element_t, allocator_t>::capacity() const
 {
-    read_lock(mutex_);
-    return ringbuf_.capacity();
+    read_lock lock(mutex_);
+    return capacity_;
 }
 
 template <class element_t, class allocator_t>
 typename multi_reader_ring_buffer<element_t, allocator_t>::size_type multi_reader_ring_buffer<element_t, allocator_t>::element_count() const
 {
-    read_lock(mutex_);
-    return ringbuf_.size();
+    read_lock lock(mutex_);
+    return size_;
 }
 
 template <class element_t, class allocator_t>
 bool multi_reader_ring_buffer<element_t, allocator_t>::empty() const
 {
-    read_lock(mutex_);
-    return ringbuf_.empty();
+    read_lock lock(mutex_);
+    return size_ == 0;
 }
 
 template <class element_t, class allocator_t>
 bool multi_reader_ring_buffer<element_t, allocator_t>::full() const
 {
-    read_lock(mutex_);
-    return ringbuf_.full();
+    read_lock lock(mutex_);
+    return size_ == capacity_;
+}
+
+template <class element_t, class allocator_t>
+typename multi_reader_ring_buffer<element_t, allocator_t>::size_type multi_reader_ring_buffer<element_t, allocator_t>::slot_index(size_type offset) const
+{
+    return (first_ + offset) % capacity_;
+}
+
+template <class element_t, class allocator_t>
+typename multi_reader_ring_buffer<element_t, allocator_t>::size_type multi_reader_ring_buffer<element_t, allocator_t>::previous_slot() const
+{
+    return first_ ? first_ - 1 : capacity_ - 1;
+}
+
+template <class element_t, class allocator_t>
+void multi_reader_ring_buffer<element_t, allocator_t>::destroy_back()
+{
+    allocator_.destroy(slots_ + slot_index(size_ - 1));
+    --size_;
 }
 
 } // namespace storage
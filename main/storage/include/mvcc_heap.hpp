@@ -0,0 +1,119 @@
+#ifndef SUPERNOVA_STORAGE_MVCC_HEAP_HPP
+#define SUPERNOVA_STORAGE_MVCC_HEAP_HPP
+
+#include <string>
+#include <limits>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/interprocess/indexes/iset_index.hpp>
+#include <boost/interprocess/managed_heap_memory.hpp>
+#include <boost/interprocess/mem_algo/rbtree_best_fit.hpp>
+#include <boost/interprocess/sync/mutex_family.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <supernova/storage/about.hpp>
+#include "role.hpp"
+#include "mvcc_memory.hpp"
+
+namespace supernova {
+namespace storage {
+
+// The same segment manager as the mapped file and the shared memory, so every mvcc template
+// applies unchanged, but the memory is only a block on the heap of this process
+typedef boost::interprocess::basic_managed_heap_memory<char,
+	boost::interprocess::rbtree_best_fit<boost::interprocess::mutex_family>,
+	boost::interprocess::iset_index> mvcc_heap_memory;
+
+class mvcc_heap_owner;
+
+// For the other threads of the process owning the memory, each with its own reader token
+class mvcc_heap_reader : private boost::noncopyable
+{
+public:
+    mvcc_heap_reader(mvcc_heap_owner& owner);
+    ~mvcc_heap_reader();
+    template <class element_t> bool exists(const char* key) const;
+    template <class element_t> const boost::optional<const element_t&> read(const char* key) const;
+    template <class element_t> std::size_t read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const;
+    template <class element_t> const boost::optional<const element_t&> read_at(const char* key, boost::uint64_t revision) const;
+    template <class element_t> const boost::optional<const element_t&> read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const;
+    template <class element_t> mvcc_history_iterator<element_t> history(const char* key) const;
+    template <class element_t> boost::optional<element_t> read_inline(const char* key) const;
+    bool changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const;
+    boost::uint64_t get_journal_revision() const;
+    std::size_t get_available_space() const;
+    std::size_t get_size() const;
+    reader_token_id get_reader_limit() const;
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+    reader_token_id get_reader_token_id() const;
+    boost::uint64_t get_last_read_revision() const;
+    template <class element_t> boost::uint64_t get_oldest_revision(const char* key) const;
+    template <class element_t> boost::uint64_t get_newest_revision(const char* key) const;
+#endif
+private:
+    mvcc_reader_handle<mvcc_heap_memory> reader_handle_;
+};
+
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+#include <vector>
+#endif
+
+// Nothing outside the process can open the memory and it goes away with the owner,
+// in exchange for no file or shared memory object to create and no flushing
+class mvcc_heap_owner : private boost::noncopyable
+{
+public:
+    mvcc_heap_owner(std::size_t size, reader_token_id reader_limit = MVCC_READER_LIMIT);
+    ~mvcc_heap_owner();
+    template <class element_t> bool exists(const char* key) const;
+    template <class element_t> const boost::optional<const element_t&> read(const char* key) const;
+    template <class element_t> std::size_t read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const;
+    template <class element_t> const boost::optional<const element_t&> read_at(const char* key, boost::uint64_t revision) const;
+    template <class element_t> const boost::optional<const element_t&> read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const;
+    template <class element_t> mvcc_history_iterator<element_t> history(const char* key) const;
+    template <class element_t> boost::optional<element_t> read_inline(const char* key) const;
+    bool changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const;
+    boost::uint64_t get_journal_revision() const;
+    template <class element_t> void write(const char* key, const element_t& value);
+    template <class element_t> void write(const char* key, const element_t& value, const boost::posix_time::time_duration& ttl);
+    template <class element_t> void write_coalesced(const char* key, const element_t& value);
+    template <class element_t, class functor_t> void write_with(const char* key, functor_t functor);
+    template <class element_t, class iterator_t> std::size_t write_bulk(iterator_t first, iterator_t last);
+    template <class element_t> void remove(const char* key);
+    template <class element_t> bool write_if(const char* key, const element_t& value, boost::uint64_t expected_revision);
+    template <class element_t> bool remove_if(const char* key, boost::uint64_t expected_revision);
+    template <class element_t> void write_inline(const char* key, const element_t& value);
+    template <class element_t> void remove_inline(const char* key);
+    void process_read_metadata(reader_token_id from = 0, reader_token_id to = MVCC_READER_LIMIT);
+    // Deprecated: writers register new keys themselves, so this does nothing and max_attempts is ignored
+    void process_write_metadata(std::size_t max_attempts = 0);
+    std::string collect_garbage(std::size_t max_attempts = 0);
+    std::string collect_garbage(const std::string& from, std::size_t max_attempts = 0);
+    void collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts = 0);
+    template <class element_t> void enroll_type();
+    std::size_t get_available_space() const;
+    std::size_t get_size() const;
+    reader_token_id get_reader_limit() const;
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+    reader_token_id get_reader_token_id() const;
+    boost::uint64_t get_last_read_revision() const;
+    template <class element_t> boost::uint64_t get_oldest_revision(const char* key) const;
+    template <class element_t> boost::uint64_t get_newest_revision(const char* key) const;
+    boost::uint64_t get_global_oldest_revision_read() const;
+    std::vector<std::string> get_registered_keys() const;
+    std::size_t get_pending_expiry_count() const;
+    template <class element_t> std::size_t get_history_depth(const char* key) const;
+#endif
+private:
+    friend class mvcc_heap_reader;
+    mvcc_heap_memory heap_;
+    mvcc_owner_handle<mvcc_heap_memory> owner_handle_;
+    mvcc_writer_handle<mvcc_heap_memory> writer_handle_;
+    mvcc_reader_handle<mvcc_heap_memory> reader_handle_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
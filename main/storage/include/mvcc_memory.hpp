@@ -3,9 +3,20 @@
 
 #include <string>
 #include <limits>
+#include <utility>
+#include <vector>
 #include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/ptime.hpp>
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
 #include <supernova/storage/about.hpp>
 #include "mode.hpp"
 
@@ -15,11 +26,31 @@ namespace storage {
 typedef boost::uint16_t reader_token_id;
 typedef boost::uint16_t writer_token_id;
 
-static const size_t MVCC_READER_LIMIT = (1 << std::numeric_limits<reader_token_id>::digits) - 4; // due to boost::lockfree limit
+// The default and largest reader limit. Reader tokens are reserved through a flag of their own,
+// so the limit is only bounded by the ids a reader_token_id can hold.
+static const size_t MVCC_READER_LIMIT = std::numeric_limits<reader_token_id>::max();
 static const size_t MVCC_WRITER_LIMIT = 1;
+static const size_t MVCC_READER_BATCH_SIZE = 8;
 static const size_t MVCC_MAX_KEY_LENGTH = 31;
-const version MVCC_MIN_SUPPORTED_VERSION(1, 1, 1, 1);
-const version MVCC_MAX_SUPPORTED_VERSION(1, 1, 1, 1);
+static const size_t MVCC_GC_WORKER_LIMIT = 64;
+static const size_t MVCC_INLINE_VALUE_LIMIT = 64;
+const version MVCC_MIN_SUPPORTED_VERSION(1, 1, 1, 12);
+const version MVCC_MAX_SUPPORTED_VERSION(1, 1, 1, 12);
+
+template <class memory_t> struct mvcc_reader_lease;
+struct mvcc_reader_cache_state;
+template <class value_t> class mvcc_history_iterator;
+struct mvcc_key;
+template <class value_t> struct mvcc_record;
+template <class memory_t> class mvcc_owner_handle;
+
+// A key written or removed, as recorded in the change journal
+struct mvcc_change
+{
+    std::string key;
+    boost::uint64_t revision;
+    bool removed;
+};
 
 template <class memory_t>
 class mvcc_reader_handle : private boost::noncopyable
@@ -29,8 +60,25 @@ public:
     ~mvcc_reader_handle();
     template <class value_t> inline bool exists(const char* key) const;
     template <class value_t> inline const boost::optional<const value_t&> read(const char* key) const;
+    template <class value_t> inline std::size_t read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const value_t&> >& out) const;
+    template <class value_t> inline const boost::optional<const value_t&> read_at(const char* key, boost::uint64_t revision) const;
+    // Versions are stamped with the UTC time they were written at
+    template <class value_t> inline const boost::optional<const value_t&> read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const;
+    // The iterator holds the version it points at through the reader token of this handle,
+    // so any other read through the handle, another history included, releases that version
+    // until the iterator is incremented
+    template <class value_t> inline mvcc_history_iterator<value_t> history(const char* key) const;
+    // Only for keys written with write_inline. The value is copied out so no reader token is held.
+    template <class value_t> inline boost::optional<value_t> read_inline(const char* key) const;
+    // Appends the changes made after the revision, oldest first, once per change.
+    // Returns false and appends nothing when the journal has already dropped some of them.
+    // Every key then has to be read again, following on from the journal revision taken beforehand.
+    inline bool changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const;
+    // The revision of the newest change in the journal, 0 if there is none
+    inline boost::uint64_t get_journal_revision() const;
     inline std::size_t get_available_space() const;
     inline std::size_t get_size() const;
+    inline reader_token_id get_reader_limit() const;
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
     reader_token_id get_reader_token_id() const;
     boost::uint64_t get_last_read_revision() const;
@@ -39,10 +87,37 @@ public:
     template <class value_t> std::size_t get_history_depth(const char* key) const;
 #endif
 private:
+    friend struct mvcc_reader_lease<memory_t>;
+    mvcc_reader_handle(memory_t& memory, const reader_token_id& leased_id);
     static reader_token_id acquire_reader_token(memory_t& memory);
     static void release_reader_token(memory_t& memory, const reader_token_id& id);
     memory_t& memory_;
     const reader_token_id token_id_;
+    const bool is_leased_;
+};
+
+// Hands out one reader handle per thread, recycling the reader tokens within this process.
+// Tokens are reserved from the memory in batches and given back when the cache is destroyed,
+// or by the owner once this process has exited without destroying it.
+// The handles of other threads are detached from the cache when it goes, so those threads
+// must be done reading through them by then. Their leases go away with the threads
+// without touching the cache or the memory.
+template <class memory_t>
+class mvcc_reader_token_cache : private boost::noncopyable
+{
+public:
+    mvcc_reader_token_cache(memory_t& memory, std::size_t batch_size = MVCC_READER_BATCH_SIZE);
+    ~mvcc_reader_token_cache();
+    inline mvcc_reader_handle<memory_t>& get_thread_reader();
+    std::size_t get_reserved_count() const;
+    std::size_t get_idle_count() const;
+private:
+    reader_token_id checkout();
+    memory_t& memory_;
+    const std::size_t batch_size_;
+    // Shared with the leases, which may outlive the cache on other threads
+    boost::shared_ptr<mvcc_reader_cache_state> state_;
+    boost::thread_specific_ptr< mvcc_reader_lease<memory_t> > lease_;
 };
 
 template <class memory_t>
@@ -52,18 +127,106 @@ public:
     mvcc_writer_handle(memory_t& memory);
     ~mvcc_writer_handle();
     template <class value_t> inline void write(const char* key, const value_t& value);
+    // The key is removed by the collector once the time to live has passed, unless a newer
+    // version has been written or the key removed in the meantime
+    template <class value_t> inline void write(const char* key, const value_t& value, const boost::posix_time::time_duration& ttl);
+    // Overwrites the newest version in place, under a new revision, as long as no reader has read it yet,
+    // so a key written faster than it is read only keeps the versions readers have actually seen
+    template <class value_t> inline void write_coalesced(const char* key, const value_t& value);
+    // The functor is called as void(value_t&) with a default constructed value already in place
+    // in the memory, so large values can be filled in without being copied.
+    // Readers of the key wait while it runs, so it should do nothing but fill the value in.
+    template <class value_t, class functor_t> inline void write_with(const char* key, functor_t functor);
+    // Loads a run of pairs whose first is the key, as a char* or std::string, and whose second is the value.
+    // The keys must be strictly ascending, as from a std::map, and every version loaded gets the same revision.
+    // Meant for populating a store: new keys start with a short history and are registered together.
+    // The run is checked in full before anything is loaded, so the iterators must be forward iterators at least;
+    // a stream read once has to be gathered into a container first.
+    // The journal records the load once it is complete, every key under one later revision.
+    template <class value_t, class iterator_t> inline std::size_t write_bulk(iterator_t first, iterator_t last);
     template <class value_t> inline void remove(const char* key);
+    // Only change the key when its newest revision is still the one expected, 0 standing for
+    // a key never written or removed, so producers can run optimistic read-modify-write loops
+    template <class value_t> inline bool write_if(const char* key, const value_t& value, boost::uint64_t expected_revision);
+    template <class value_t> inline bool remove_if(const char* key, boost::uint64_t expected_revision);
+    // Keeps only the newest version of the key, in a pair of slots inside the record itself
+    // rather than a history ring. The value must be copyable byte by byte and no larger than
+    // MVCC_INLINE_VALUE_LIMIT. Such keys have no history and are read with read_inline.
+    template <class value_t> inline void write_inline(const char* key, const value_t& value);
+    template <class value_t> inline void remove_inline(const char* key);
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
     writer_token_id get_writer_token_id() const;
     boost::uint64_t get_last_write_revision() const;
 #endif
 private:
+    template <class value_t, class constructor_t> void write_impl(const char* key, const constructor_t& constructor,
+	    const boost::optional<boost::posix_time::time_duration>& ttl = boost::none, bool coalesce = false);
+    template <class value_t> mvcc_record<value_t>* acquire_record(const mvcc_key& key);
     static writer_token_id acquire_writer_token(memory_t& memory);
     static void release_writer_token(memory_t& memory, const writer_token_id& id);
     memory_t& memory_;
     const writer_token_id token_id_;
 };
 
+// Where a parallel garbage collection resumes. The registry is split into contiguous ranges,
+// one per worker thread, and each range keeps its own cursor.
+// The ranges are only recomputed after new keys have been registered.
+// The workers are started with the cursors and kept until they go, so a collection
+// run every tick doesn't start any thread.
+class mvcc_gc_cursors : private boost::noncopyable
+{
+public:
+    mvcc_gc_cursors(std::size_t worker_count);
+    ~mvcc_gc_cursors();
+    std::size_t get_worker_count() const;
+private:
+    template <class memory_t> friend class mvcc_owner_handle;
+    void start_workers();
+    void stop_workers();
+    void run_worker(std::size_t range);
+    // The calling thread runs the task on the first range and a worker on each of the others.
+    // The first failure of any of them is rethrown once they are all done.
+    void run_on_ranges(const boost::function<void(std::size_t)>& task);
+    std::size_t worker_count_;
+    std::size_t registry_size_;
+    std::vector<std::size_t> range_first_;
+    std::vector<std::size_t> resume_from_;
+    boost::mutex task_mutex_;
+    boost::condition_variable task_posted_;
+    boost::condition_variable task_done_;
+    boost::function<void(std::size_t)> task_;
+    std::size_t task_generation_;
+    std::size_t tasks_pending_;
+    bool stopping_;
+    std::vector<boost::exception_ptr> task_failures_;
+    boost::thread_group workers_;
+};
+
+// The trim function of every value type this process has written or enrolled.
+// Type ids are hashed from the type name, so every process built from the same code agrees on them
+// and any owner process can collect the keys written by another one.
+class mvcc_type_table : private boost::noncopyable
+{
+public:
+    typedef void (*trim_function)(void* record, boost::uint64_t threshold);
+    // Removes the key if its newest revision is still the given one
+    typedef bool (*expire_function)(void* record, boost::uint64_t revision);
+    struct functions
+    {
+	trim_function trim;
+	expire_function expire;
+    };
+    typedef std::vector< std::pair<boost::uint64_t, functions> > snapshot_type;
+    static mvcc_type_table& instance();
+    static boost::uint64_t hash_type_name(const char* name);
+    void enroll(boost::uint64_t type_id, trim_function trim, expire_function expire);
+    void snapshot(snapshot_type& out) const;
+private:
+    mvcc_type_table();
+    mutable boost::mutex mutex_;
+    snapshot_type entries_;
+};
+
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
 #include <vector>
 #endif
@@ -72,18 +235,36 @@ template <class memory_t>
 class mvcc_owner_handle : private boost::noncopyable
 {
 public:
-    mvcc_owner_handle(open_mode mode, memory_t& memory);
+    mvcc_owner_handle(open_mode mode, memory_t& memory, reader_token_id reader_limit = MVCC_READER_LIMIT);
     ~mvcc_owner_handle();
+    // Also takes back the reader tokens of processes that exited while holding them
     inline void process_read_metadata(reader_token_id from = 0, reader_token_id to = MVCC_READER_LIMIT);
+    // Deprecated: writers register new keys themselves, so this does nothing and max_attempts is ignored
     inline void process_write_metadata(std::size_t max_attempts = 0);
+    // Every collection first removes the keys whose time to live has passed,
+    // taking them from the expiry index in deadline order, at most max_attempts of them
     inline std::string collect_garbage(std::size_t max_attempts = 0);
+    // Resumes from the key the previous collection returned, any other key starts over from the first one
     inline std::string collect_garbage(const std::string& from, std::size_t max_attempts = 0);
+    // Sweeps every range at once, the calling thread taking the first one.
+    // max_attempts applies to each range.
+    inline void collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts = 0);
+    // Keys of a type this process never writes are only collected once the type is enrolled
+    template <class value_t> inline void enroll_type();
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
     boost::uint64_t get_global_oldest_revision_read() const;
     std::vector<std::string> get_registered_keys() const;
+    std::size_t get_pending_expiry_count() const;
 #endif
 private:
+    std::size_t find_registered_index(const std::string& key, std::size_t count) const;
+    void expire_keys(const mvcc_type_table::snapshot_type& functions, std::size_t max_attempts);
+    void partition_registry(mvcc_gc_cursors& cursors, std::size_t count) const;
+    void collect_garbage_range(mvcc_gc_cursors& cursors, std::size_t range, boost::uint64_t oldest,
+	    const mvcc_type_table::snapshot_type& trims, std::size_t max_attempts);
     memory_t& memory_;
+    std::size_t resume_index_;
+    std::string resume_key_;
 };
 
 } // namespace storage
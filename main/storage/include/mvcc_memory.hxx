@@ -2,7 +2,10 @@
 #define SUPERNOVA_STORAGE_MVCC_MEMORY_HXX
 
 #include "mvcc_memory.hpp"
+#include <algorithm>
 #include <cstring>
+#include <typeinfo>
+#include <iterator>
 #include <utility>
 #include <boost/atomic.hpp>
 #include <boost/bind.hpp>
@@ -10,20 +13,30 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/function.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
-#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <boost/interprocess/offset_ptr.hpp>
 #include <boost/interprocess/segment_manager.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_sharable_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/interprocess/sync/sharable_lock.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include <boost/lockfree/policies.hpp>
 #include <boost/lockfree/queue.hpp>
 #include <boost/optional.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/ref.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/thread/locks.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/thread_time.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/has_trivial_copy.hpp>
+#include <boost/type_traits/is_convertible.hpp>
 #include <supernova/core/compiler_extensions.hpp>
 #include <supernova/storage/exception.hpp>
-#include "multi_reader_ring_buffer.hpp"
-#include "multi_reader_ring_buffer.hxx"
 
 namespace bip = boost::interprocess;
 namespace bpt = boost::posix_time;
@@ -35,9 +48,19 @@ namespace storage {
 typedef boost::uint64_t mvcc_revision;
 typedef boost::uint8_t history_depth;
 static const size_t DEFAULT_HISTORY_DEPTH = 1 <<  std::numeric_limits<history_depth>::digits;
+// Loaded keys start with a short history that grows once they are written again
+static const size_t MVCC_BULK_HISTORY_DEPTH = 4;
 static const char* RESOURCE_POOL_KEY = "@@RESOURCE_POOL@@";
 static const char* HEADER_KEY = "@@HEADER@@";
 static const char* MVCC_FILE_TYPE_TAG = "supernova::storage::mvcc_memory";
+static const size_t MVCC_REGISTRY_CHUNK_SIZE = 1024;
+static const size_t MVCC_REGISTRY_CHUNK_LIMIT = 4096;
+// No trim function is ever enrolled for it since inline records have no history to collect
+static const boost::uint64_t MVCC_INLINE_TYPE_ID = 0;
+static const size_t MVCC_JOURNAL_CAPACITY = 1024;
+static const size_t MVCC_EXPIRY_COMPACT_MIN = 1024;
+// read_many resolves this many keys before reading any of them
+static const size_t MVCC_READ_MANY_GROUP_SIZE = 8;
 
 struct mvcc_key
 {
@@ -50,19 +73,6 @@ struct mvcc_key
     char c_str[MVCC_MAX_KEY_LENGTH + 1];
 };
 
-template <class memory_t>
-struct mvcc_deleter
-{
-    typedef boost::function<void(memory_t&, const char*, mvcc_revision)> delete_function;
-    mvcc_deleter();
-    mvcc_deleter(const mvcc_key& k, const delete_function& fn);
-    mvcc_deleter(const mvcc_deleter<memory_t>& other);
-    ~mvcc_deleter();
-    mvcc_deleter& operator=(const mvcc_deleter<memory_t>& other);
-    mvcc_key key;
-    delete_function function;
-};
-
 // TODO: replace the following with type aliases after moving to a C++11 compiler
 
 template <class value_t, class memory_t = bip::managed_mapped_file>
@@ -71,13 +81,6 @@ struct mvcc_allocator
     typedef bip::allocator<value_t, typename memory_t::segment_manager> type;
 };
 
-template <class key_t, class value_t, class memory_t = bip::managed_mapped_file>
-struct mvcc_map
-{
-    typedef typename mvcc_allocator<std::pair<const key_t, value_t>, memory_t>::type allocator_t;
-    typedef boost::interprocess::map<key_t, value_t, std::less<key_t>, allocator_t> type;
-};
-
 template <class value_t, size_t size, class memory_t = bip::managed_mapped_file>
 struct mvcc_queue 
 {
@@ -87,19 +90,29 @@ struct mvcc_queue
     typedef boost::lockfree::queue<value_t, capacity, fixed, allocator_t> type;
 };
 
+boost::int32_t get_process_id();
+// Whether no process runs under the id any more, a process of another user still counting as running
+bool is_process_gone(boost::int32_t pid);
+
 struct mvcc_header
 {
     boost::uint16_t endianess_indicator;
     char file_type_tag[48];
     version memory_version;
     boost::uint16_t header_size;
-    mvcc_header();
+    reader_token_id reader_limit;
+    mvcc_header(reader_token_id limit);
 };
 
 #ifdef LEVEL1_DCACHE_LINESIZE
 
 struct mvcc_reader_token
 {
+    mvcc_reader_token();
+    boost::atomic<bool> reserved;
+    // The process holding the token, 0 until it has recorded itself, so the owner can take back
+    // the tokens of a process that exited without giving them back
+    boost::atomic<boost::int32_t> owner_pid;
     boost::optional<mvcc_revision> last_read_revision;
     boost::optional<bpt::ptime> last_read_timestamp;
 } __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
@@ -115,41 +128,227 @@ struct mvcc_writer_token
 template <class memory_t>
 struct mvcc_owner_token
 {
-    typedef typename mvcc_map<mvcc_key, mvcc_deleter<memory_t>, memory_t>::type registry_map;
-    mvcc_owner_token(memory_t* file);
     boost::optional<reader_token_id> oldest_reader_id_found;
     boost::optional<mvcc_revision> oldest_revision_found;
     boost::optional<bpt::ptime> oldest_timestamp_found;
-    registry_map registry;
+};
+
+template <class memory_t>
+struct mvcc_registry_entry
+{
+    typedef typename memory_t::handle_t handle_t;
+    mvcc_registry_entry();
+    boost::atomic<bool> published;
+    mvcc_key key;
+    boost::uint64_t type_id;
+    handle_t record;
+};
+
+// Every key in the order it was first written. A writer claims a slot with a single fetch_add
+// and publishes it once filled in, so registering a key never waits for the owner.
+// Chunks are allocated on first use and never move, and are referred to by handle
+// so that every process can resolve them.
+template <class memory_t>
+struct mvcc_registry
+{
+    typedef typename memory_t::handle_t handle_t;
+    mvcc_registry();
+    boost::atomic<std::size_t> claimed;
+    boost::atomic<handle_t> chunks[MVCC_REGISTRY_CHUNK_LIMIT];
+};
+
+template <class memory_t>
+struct mvcc_expiry_entry
+{
+    typedef typename memory_t::handle_t handle_t;
+    mvcc_expiry_entry(const bpt::ptime& d, const mvcc_revision& r, const mvcc_key& k, boost::uint64_t t, handle_t h);
+    // Ordered so that a heap built with it keeps the earliest deadline at the front
+    bool operator<(const mvcc_expiry_entry& other) const;
+    bpt::ptime deadline;
+    mvcc_revision revision;
+    mvcc_key key;
+    boost::uint64_t type_id;
+    handle_t record;
+};
+
+// Every version written with a time to live, as a binary heap on the deadline.
+// Entries are not taken out when the key is written again or removed; the collector
+// only drops them once due, after finding that they no longer match the newest revision.
+// Once the heap outgrows compact_size only the newest entry of each key is kept,
+// so keys rewritten with a long time to live don't grow it without bound.
+template <class memory_t>
+struct mvcc_expiry_index
+{
+    typedef mvcc_expiry_entry<memory_t> entry_type;
+    typedef bip::vector<entry_type, typename mvcc_allocator<entry_type, memory_t>::type> heap_type;
+    mvcc_expiry_index(typename memory_t::segment_manager* manager);
+    void push(const entry_type& entry);
+    void compact();
+    bip::interprocess_mutex mutex;
+    heap_type heap;
+    std::size_t compact_size;
+};
+
+// The sequence is odd while the slot is being filled in and twice the position plus 2 once complete,
+// so a reader can tell a slot that has since been reused
+struct mvcc_journal_entry
+{
+    mvcc_journal_entry();
+    boost::atomic<boost::uint64_t> sequence;
+    mvcc_revision revision;
+    bool removed;
+    mvcc_key key;
+};
+
+// The latest changes in revision order, in a ring that overwrites the oldest one.
+// The mutex keeps the writer and expiry in the collector from appending out of order.
+struct mvcc_change_journal
+{
+    mvcc_change_journal(mvcc_journal_entry* e);
+    bip::interprocess_mutex mutex;
+    bip::offset_ptr<mvcc_journal_entry> entries;
+    boost::atomic<boost::uint64_t> appended;
+    boost::atomic<mvcc_revision> overwritten_revision;
 };
 
 template <class memory_t>
 struct mvcc_resource_pool
 {
-    mvcc_resource_pool(memory_t* memory);
-    mvcc_reader_token reader_token_pool[MVCC_READER_LIMIT];
+    mvcc_resource_pool(memory_t* memory, reader_token_id reader_limit);
+    // boost::lockfree can only size a position independent free list at compile time,
+    // so reader tokens are reserved through their own flag instead
+    bip::offset_ptr<mvcc_reader_token> reader_token_pool;
     mvcc_writer_token writer_token_pool[MVCC_WRITER_LIMIT];
     boost::atomic<mvcc_revision> global_revision;
     mvcc_owner_token<memory_t> owner_token;
-    typename mvcc_queue<reader_token_id, MVCC_READER_LIMIT, memory_t>::type reader_free_list;
+    mvcc_registry<memory_t> registry;
+    mvcc_expiry_index<memory_t> expiry;
+    mvcc_change_journal journal;
     typename mvcc_queue<writer_token_id, MVCC_WRITER_LIMIT, memory_t>::type writer_free_list;
-    typename mvcc_queue<mvcc_deleter<memory_t>, DEFAULT_HISTORY_DEPTH, memory_t>::type deleter_list;
 };
 
 template <class value_t>
 struct mvcc_value
 {
     mvcc_value(const value_t& v, const mvcc_revision& r, const bpt::ptime& t);
+    mvcc_value(const mvcc_revision& r, const bpt::ptime& t);
     value_t value;
     mvcc_revision revision;
     bpt::ptime timestamp;
 };
 
+#ifdef LEVEL1_DCACHE_LINESIZE
+
+template <class value_t>
+void track_read(mvcc_reader_token& token, const mvcc_value<value_t>& value);
+
+#endif
+
+template <class value_t>
+struct mvcc_value_copier
+{
+    mvcc_value_copier(const value_t& v);
+    void operator()(void* address, const mvcc_revision& revision, const bpt::ptime& timestamp) const;
+    const value_t& value;
+};
+
+template <class value_t, class functor_t>
+struct mvcc_value_filler
+{
+    mvcc_value_filler(const functor_t& f);
+    void operator()(void* address, const mvcc_revision& revision, const bpt::ptime& timestamp);
+    functor_t functor;
+};
+
+// The versions of a key from the newest at the front to the oldest at the back.
+// Revisions and timestamps are kept in packed columns of their own beside the values,
+// so finding a version or checking the oldest one against the collection threshold
+// only touches the value that is handed out. Each value keeps a copy of its revision
+// and timestamp for the readers holding a reference to it.
 template <class value_t>
-struct mvcc_ring_buffer
+class mvcc_history : private boost::noncopyable
+{
+public:
+    typedef bip::managed_mapped_file::segment_manager segment_manager_t;
+    typedef std::size_t size_type;
+    // The capacity must not be 0
+    mvcc_history(size_type capacity, segment_manager_t* manager);
+    ~mvcc_history();
+    const mvcc_value<value_t>& front() const;
+    const mvcc_value<value_t>& back() const;
+    // The same as front but taking the lock once for an empty history too
+    boost::optional<const mvcc_value<value_t>&> newest() const;
+    // Also points the reader token at the version found before the lock is released, when it is older
+    // than the revision held or nothing is held yet, and records its revision as the one held.
+    // Reading a batch this way keeps every version handed out valid with a single revision on the token.
+    boost::optional<const mvcc_value<value_t>&> newest(mvcc_reader_token& token, boost::optional<mvcc_revision>& held) const;
+    // Starts loading the newest version into the cache. Only a hint, so the lock isn't taken.
+    void prefetch_newest() const;
+    mvcc_revision front_revision() const;
+    mvcc_revision back_revision() const;
+    // The constructor is called with the address of the new front value and must placement new
+    // the mvcc_value there; the version only becomes visible once the constructor has returned.
+    // It runs under the write lock, so readers of the key wait for it to return.
+    template <class constructor_t> void emplace_front(constructor_t constructor, const mvcc_revision& revision, const bpt::ptime& timestamp);
+    // The predicate is called with the newest revision, 0 when there is none, under the same lock as the change
+    template <class predicate_t, class constructor_t> bool emplace_front_if(predicate_t predicate, constructor_t constructor,
+	    const mvcc_revision& revision, const bpt::ptime& timestamp);
+    template <class predicate_t, class functor_t> bool apply_if(predicate_t predicate, functor_t functor);
+    // Replaces the newest version in place instead, when no reader has been handed it since it was written
+    template <class constructor_t> void emplace_front_coalesced(constructor_t constructor, const mvcc_revision& revision, const bpt::ptime& timestamp);
+    void pop_back();
+    // The newest version is kept whatever its revision
+    void pop_back_before(const mvcc_revision& threshold);
+    // A reader token given is pointed at the version found before the lock is released,
+    // so the collector can't drop that version between the search and the read being tracked
+    boost::optional<const mvcc_value<value_t>&> find_by_revision(const mvcc_revision& revision, mvcc_reader_token* token = 0) const;
+    boost::optional<const mvcc_value<value_t>&> find_by_timestamp(const bpt::ptime& timestamp, mvcc_reader_token* token = 0) const;
+    void grow(size_type new_capacity);
+    size_type capacity() const;
+    size_type element_count() const;
+    bool empty() const;
+    bool full() const;
+private:
+    typedef bip::sharable_lock<bip::interprocess_sharable_mutex> read_lock;
+    typedef bip::scoped_lock<bip::interprocess_sharable_mutex> write_lock;
+    template <class key_t> boost::optional<const mvcc_value<value_t>&> find_first_at_or_before(
+	    const bip::offset_ptr<key_t>& column, const key_t& key, mvcc_reader_token* token) const;
+    template <class constructor_t> void emplace_front_locked(constructor_t constructor, const mvcc_revision& revision, const bpt::ptime& timestamp);
+    mvcc_revision newest_revision_locked() const;
+    void observe(size_type offset) const;
+    static size_type values_offset(size_type capacity);
+    void attach(void* columns, size_type capacity);
+    size_type slot_index(size_type offset) const;
+    size_type previous_slot() const;
+    void destroy_back();
+    mutable bip::interprocess_sharable_mutex mutex_;
+    bip::offset_ptr<segment_manager_t> manager_;
+    // the three columns share one allocation starting with the revisions
+    bip::offset_ptr<mvcc_revision> revisions_;
+    bip::offset_ptr<bpt::ptime> timestamps_;
+    bip::offset_ptr< mvcc_value<value_t> > values_;
+    size_type capacity_;
+    size_type first_;
+    size_type size_;
+    // Set under the read lock whenever the newest version is handed out, so checking it
+    // under the write lock tells whether any reader can hold a reference to that version
+    mutable boost::atomic<bool> observed_;
+};
+
+// A removed key has no newest revision, the same as a key never written
+struct mvcc_newest_revision_is
 {
-    typedef bip::allocator<value_t, bip::managed_mapped_file::segment_manager> allocator_type;
-    typedef multi_reader_ring_buffer<value_t, allocator_type> type;
+    mvcc_newest_revision_is(const mvcc_revision& e, const boost::atomic<bool>& r);
+    bool operator()(const mvcc_revision& newest) const;
+    mvcc_revision expected;
+    const boost::atomic<bool>& removed;
+};
+
+struct mvcc_removal_marker
+{
+    mvcc_removal_marker(boost::atomic<bool>& r);
+    void operator()() const;
+    boost::atomic<bool>& removed;
 };
 
 #ifdef LEVEL1_DCACHE_LINESIZE
@@ -157,61 +356,145 @@ struct mvcc_ring_buffer
 template <class value_t>
 struct mvcc_record
 {
-    typedef typename mvcc_ring_buffer< mvcc_value<value_t> >::type ringbuf_t;
-    mvcc_record(const typename mvcc_ring_buffer< mvcc_value<value_t> >::allocator_type& allocator,
-		std::size_t depth = DEFAULT_HISTORY_DEPTH);
-    typename mvcc_ring_buffer< mvcc_value<value_t> >::type ringbuf;
+    mvcc_record(typename mvcc_history<value_t>::segment_manager_t* manager, std::size_t depth = DEFAULT_HISTORY_DEPTH);
+    mvcc_history<value_t> history;
+    boost::atomic<bool> want_removed;
+} __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
+
+// The sequence is odd while the writer is filling the slot in and 0 until the first write
+template <class value_t>
+struct mvcc_inline_slot
+{
+    mvcc_inline_slot();
+    boost::atomic<boost::uint32_t> sequence;
+    mvcc_revision revision;
+    bpt::ptime timestamp;
+    char value[sizeof(value_t)] __attribute__((aligned(__alignof__(value_t))));
+};
+
+// The writer fills in the slot readers aren't pointed at and then flips current,
+// so a reader only retries when two writes land while it is copying
+template <class value_t>
+struct mvcc_inline_record
+{
+    mvcc_inline_record();
+    boost::atomic<boost::uint32_t> current;
     boost::atomic<bool> want_removed;
+    mvcc_inline_slot<value_t> slots[2];
 } __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
 
 #endif
 
+// Walks the history of a key from the newest version to the oldest one.
+// The reader token follows the version being pointed at, so that version can't be collected.
+template <class value_t>
+class mvcc_history_iterator : public boost::iterator_facade<mvcc_history_iterator<value_t>,
+	const mvcc_value<value_t>, boost::forward_traversal_tag>
+{
+public:
+    mvcc_history_iterator();
+    mvcc_history_iterator(const mvcc_record<value_t>* record, mvcc_reader_token* token);
+private:
+    friend class boost::iterator_core_access;
+    const mvcc_value<value_t>& dereference() const;
+    void increment();
+    bool equal(const mvcc_history_iterator<value_t>& other) const;
+    void hold(const boost::optional<const mvcc_value<value_t>&>& version);
+    const mvcc_record<value_t>* record_;
+    mvcc_reader_token* token_;
+    const mvcc_value<value_t>* current_;
+};
+
 template <class memory_t>
-mvcc_deleter<memory_t>::mvcc_deleter() :
-    key(), function()
+mvcc_registry_entry<memory_t>::mvcc_registry_entry() :
+    published(false), key(), type_id(0), record(0)
 { }
 
 template <class memory_t>
-mvcc_deleter<memory_t>::mvcc_deleter(const mvcc_key& k, const delete_function& fn) :
-    key(k), function(fn)
-{ }
+mvcc_registry<memory_t>::mvcc_registry() :
+    claimed(0)
+{
+    for (std::size_t chunk = 0; chunk < MVCC_REGISTRY_CHUNK_LIMIT; ++chunk)
+    {
+	// the segment manager sits at offset 0 so no allocation ever has a 0 handle
+	chunks[chunk].store(0, boost::memory_order_relaxed);
+    }
+}
 
 template <class memory_t>
-mvcc_deleter<memory_t>::mvcc_deleter(const mvcc_deleter<memory_t>& other) :
-    key(other.key), function(other.function)
+mvcc_expiry_entry<memory_t>::mvcc_expiry_entry(const bpt::ptime& d, const mvcc_revision& r, const mvcc_key& k, boost::uint64_t t, handle_t h) :
+	deadline(d), revision(r), key(k), type_id(t), record(h)
 { }
 
 template <class memory_t>
-mvcc_deleter<memory_t>::~mvcc_deleter()
+bool mvcc_expiry_entry<memory_t>::operator<(const mvcc_expiry_entry& other) const
+{
+    return deadline > other.deadline;
+}
+
+template <class memory_t>
+mvcc_expiry_index<memory_t>::mvcc_expiry_index(typename memory_t::segment_manager* manager) :
+	mutex(), heap(manager), compact_size(MVCC_EXPIRY_COMPACT_MIN)
 { }
 
 template <class memory_t>
-mvcc_deleter<memory_t>& mvcc_deleter<memory_t>::operator=(const mvcc_deleter<memory_t>& other)
+void mvcc_expiry_index<memory_t>::push(const entry_type& entry)
 {
-    if (this != &other)
+    heap.push_back(entry);
+    std::push_heap(heap.begin(), heap.end());
+    if (UNLIKELY_EXT(heap.size() > compact_size))
     {
-	key = other.key;
-	function = other.function;
+	compact();
     }
-    return *this;
 }
 
 template <class memory_t>
-mvcc_owner_token<memory_t>::mvcc_owner_token(memory_t* memory) :
-    registry(std::less<typename registry_map::key_type>(), memory->get_segment_manager())
-{ }
+struct mvcc_expiry_newest_first
+{
+    bool operator()(const mvcc_expiry_entry<memory_t>& lhs, const mvcc_expiry_entry<memory_t>& rhs) const
+    {
+	return lhs.record < rhs.record || (lhs.record == rhs.record && lhs.revision > rhs.revision);
+    }
+};
+
+template <class memory_t>
+struct mvcc_expiry_same_record
+{
+    bool operator()(const mvcc_expiry_entry<memory_t>& lhs, const mvcc_expiry_entry<memory_t>& rhs) const
+    {
+	return lhs.record == rhs.record;
+    }
+};
+
+template <class memory_t>
+void mvcc_expiry_index<memory_t>::compact()
+{
+    // records are never freed, so an older entry for the same record can no longer match its newest revision
+    std::sort(heap.begin(), heap.end(), mvcc_expiry_newest_first<memory_t>());
+    heap.erase(std::unique(heap.begin(), heap.end(), mvcc_expiry_same_record<memory_t>()), heap.end());
+    std::make_heap(heap.begin(), heap.end());
+    compact_size = std::max(MVCC_EXPIRY_COMPACT_MIN, heap.size() * 2);
+}
 
 template <class memory_t>
-mvcc_resource_pool<memory_t>::mvcc_resource_pool(memory_t* memory) :
+mvcc_resource_pool<memory_t>::mvcc_resource_pool(memory_t* memory, reader_token_id reader_limit) :
+    reader_token_pool(static_cast<mvcc_reader_token*>(memory->allocate_aligned(
+	    sizeof(mvcc_reader_token) * reader_limit, LEVEL1_DCACHE_LINESIZE))),
     global_revision(1),
-    owner_token(memory),
-    reader_free_list(memory->get_segment_manager()),
-    writer_free_list(memory->get_segment_manager()),
-    deleter_list(memory->get_segment_manager())
+    owner_token(),
+    registry(),
+    expiry(memory->get_segment_manager()),
+    journal(static_cast<mvcc_journal_entry*>(memory->allocate_aligned(
+	    sizeof(mvcc_journal_entry) * MVCC_JOURNAL_CAPACITY, LEVEL1_DCACHE_LINESIZE))),
+    writer_free_list(memory->get_segment_manager())
 {
-    for (reader_token_id id = 0; id < MVCC_READER_LIMIT; ++id)
+    for (std::size_t position = 0; position < MVCC_JOURNAL_CAPACITY; ++position)
+    {
+	new (&journal.entries[position]) mvcc_journal_entry();
+    }
+    for (reader_token_id id = 0; id < reader_limit; ++id)
     {
-	reader_free_list.push(id);
+	new (&reader_token_pool[id]) mvcc_reader_token();
     }
     for (writer_token_id id = 0; id < MVCC_WRITER_LIMIT; ++id)
     {
@@ -225,191 +508,1139 @@ mvcc_value<value_t>::mvcc_value(const value_t& v, const mvcc_revision& r, const
 { }
 
 template <class value_t>
-mvcc_record<value_t>::mvcc_record(const typename mvcc_ring_buffer< mvcc_value<value_t> >::allocator_type& allocator, std::size_t depth) :
-	ringbuf(depth, allocator),
-	want_removed(false)
+mvcc_value<value_t>::mvcc_value(const mvcc_revision& r, const bpt::ptime& t) :
+	revision(r), timestamp(t)
 { }
 
-template <class memory_t>
-const mvcc_resource_pool<memory_t>* const_resource_pool_ptr(const memory_t& memory)
+template <class value_t>
+mvcc_value_copier<value_t>::mvcc_value_copier(const value_t& v) :
+	value(v)
+{ }
+
+template <class value_t>
+void mvcc_value_copier<value_t>::operator()(void* address, const mvcc_revision& revision, const bpt::ptime& timestamp) const
 {
-    return const_cast<memory_t&>(memory).template find< const mvcc_resource_pool<memory_t> >(RESOURCE_POOL_KEY).first;
+    new (address) mvcc_value<value_t>(value, revision, timestamp);
 }
 
-template <class memory_t>
-mvcc_resource_pool<memory_t>* mut_resource_pool_ptr(memory_t& memory)
+template <class value_t, class functor_t>
+mvcc_value_filler<value_t, functor_t>::mvcc_value_filler(const functor_t& f) :
+	functor(f)
+{ }
+
+template <class value_t, class functor_t>
+void mvcc_value_filler<value_t, functor_t>::operator()(void* address, const mvcc_revision& revision, const bpt::ptime& timestamp)
 {
-    return memory.template find< mvcc_resource_pool<memory_t> >(RESOURCE_POOL_KEY).first;
+    mvcc_value<value_t>* slot = new (address) mvcc_value<value_t>(revision, timestamp);
+    try
+    {
+	functor(slot->value);
+    }
+    catch (...)
+    {
+	slot->~mvcc_value<value_t>();
+	throw;
+    }
 }
 
-template <class memory_t>
-const mvcc_resource_pool<memory_t>& const_resource_pool_ref(const memory_t& memory)
+template <class value_t>
+mvcc_history<value_t>::mvcc_history(size_type capacity, segment_manager_t* manager) :
+	manager_(manager),
+	revisions_(),
+	timestamps_(),
+	values_(),
+	capacity_(capacity),
+	first_(0),
+	size_(0),
+	observed_(false)
 {
-    return *const_resource_pool_ptr(memory);
+    if (UNLIKELY_EXT(capacity_ == 0))
+    {
+	throw storage_error("History capacity is 0")
+		<< info_component_identity("mvcc_memory");
+    }
+    attach(manager_->allocate(values_offset(capacity_) + sizeof(mvcc_value<value_t>) * capacity_), capacity_);
 }
 
-template <class memory_t>
-mvcc_resource_pool<memory_t>& mut_resource_pool_ref(memory_t& memory)
+template <class value_t>
+mvcc_history<value_t>::~mvcc_history()
 {
-    return *mut_resource_pool_ptr(memory);
+    while (size_)
+    {
+	destroy_back();
+    }
+    if (revisions_)
+    {
+	manager_->deallocate(revisions_.get());
+    }
 }
 
-template <class memory_t>
-const mvcc_header* const_header_ptr(const memory_t& memory)
+template <class value_t>
+const mvcc_value<value_t>& mvcc_history<value_t>::front() const
 {
-    return const_cast<memory_t&>(memory).template find<const mvcc_header>(HEADER_KEY).first;
+    read_lock lock(mutex_);
+    observe(0);
+    return values_[first_];
 }
 
-template <class memory_t>
-mvcc_header* mut_header_ptr(memory_t& memory)
+template <class value_t>
+boost::optional<const mvcc_value<value_t>&> mvcc_history<value_t>::newest() const
 {
-    return memory.template find<mvcc_header>(HEADER_KEY).first;
+    read_lock lock(mutex_);
+    boost::optional<const mvcc_value<value_t>&> result;
+    if (size_)
+    {
+	observe(0);
+	result = values_[first_];
+    }
+    return result;
 }
 
-template <class memory_t>
-const mvcc_header& const_header_ref(const memory_t& memory)
+template <class value_t>
+boost::optional<const mvcc_value<value_t>&> mvcc_history<value_t>::newest(mvcc_reader_token& token,
+	boost::optional<mvcc_revision>& held) const
 {
-    return *const_header_ptr(memory);
+    read_lock lock(mutex_);
+    boost::optional<const mvcc_value<value_t>&> result;
+    if (size_)
+    {
+	observe(0);
+	result = values_[first_];
+	if (!held || result->revision < held.get())
+	{
+	    // popping a version takes the write lock, so it can't happen before the read is tracked
+	    track_read(token, result.get());
+	    held = result->revision;
+	}
+    }
+    return result;
 }
 
-template <class memory_t>
-mvcc_header& mut_header_ref(memory_t& memory)
+template <class value_t>
+void mvcc_history<value_t>::prefetch_newest() const
 {
-    return *mut_header_ptr(memory);
+    PREFETCH_EXT(&values_[first_]);
 }
 
-template <class memory_t, class value_t>
-const mvcc_record<value_t>* const_record_ptr(const memory_t& memory, const char* key)
+template <class value_t>
+const mvcc_value<value_t>& mvcc_history<value_t>::back() const
 {
-    return const_cast<memory_t&>(memory).template find< const mvcc_record<value_t> >(key).first;
+    read_lock lock(mutex_);
+    return values_[slot_index(size_ - 1)];
 }
 
-template <class memory_t, class value_t>
-mvcc_record<value_t>* mut_record_ptr(memory_t& memory, const char* key)
+template <class value_t>
+mvcc_revision mvcc_history<value_t>::front_revision() const
 {
-    return memory.template find< mvcc_record<value_t> >(key).first;
+    read_lock lock(mutex_);
+    return revisions_[first_];
 }
 
-template <class memory_t, class value_t>
-const mvcc_record<value_t>& const_record_ref(const memory_t& memory, const char* key)
+template <class value_t>
+mvcc_revision mvcc_history<value_t>::back_revision() const
 {
-    return *const_record_ptr(memory);
+    read_lock lock(mutex_);
+    return revisions_[slot_index(size_ - 1)];
 }
 
-template <class memory_t, class value_t>
-mvcc_record<value_t>& mut_record_ref(memory_t& memory, const char* key)
+template <class value_t>
+template <class constructor_t>
+void mvcc_history<value_t>::emplace_front(constructor_t constructor, const mvcc_revision& revision, const bpt::ptime& timestamp)
 {
-    return *mut_record_ptr(memory);
+    write_lock lock(mutex_);
+    emplace_front_locked(constructor, revision, timestamp);
 }
 
-template <class memory_t, class value_t>
-void delete_oldest(memory_t& memory, const char* key, mvcc_revision threshold)
+template <class value_t>
+template <class predicate_t, class constructor_t>
+bool mvcc_history<value_t>::emplace_front_if(predicate_t predicate, constructor_t constructor,
+	const mvcc_revision& revision, const bpt::ptime& timestamp)
 {
-    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory, key);
-    if (record)
+    write_lock lock(mutex_);
+    if (!predicate(newest_revision_locked()))
     {
-	const mvcc_value<value_t>& value = record->ringbuf.back();
-	if ((record->ringbuf.element_count() > 1 && value.revision < threshold) || record->want_removed)
-	{
-	    record->ringbuf.pop_back(value);
-	}
+	return false;
     }
+    emplace_front_locked(constructor, revision, timestamp);
+    return true;
 }
 
-template <class memory_t>
-void check(const memory_t& memory)
+template <class value_t>
+template <class predicate_t, class functor_t>
+bool mvcc_history<value_t>::apply_if(predicate_t predicate, functor_t functor)
 {
-    const mvcc_header* header = const_header_ptr(memory);
-    if (UNLIKELY_EXT(!header))
+    write_lock lock(mutex_);
+    if (!predicate(newest_revision_locked()))
     {
-	throw malformed_db_error("Could not find header")
-		<< info_component_identity("mvcc_memory")
-		<< info_data_identity(HEADER_KEY);
+	return false;
     }
-    // If endianess is different the indicator will be 65280 instead of 255
-    if (UNLIKELY_EXT(header->endianess_indicator != std::numeric_limits<boost::uint8_t>::max()))
+    functor();
+    return true;
+}
+
+template <class value_t>
+template <class constructor_t>
+void mvcc_history<value_t>::emplace_front_coalesced(constructor_t constructor, const mvcc_revision& revision, const bpt::ptime& timestamp)
+{
+    write_lock lock(mutex_);
+    if (!size_ || observed_.load(boost::memory_order_relaxed))
     {
-	throw unsupported_db_error("Memory requires byte swapping")
-		<< info_component_identity("mvcc_memory")
-		<< info_version_found(header->memory_version);
+	emplace_front_locked(constructor, revision, timestamp);
+	return;
     }
-    if (UNLIKELY_EXT(strncmp(header->file_type_tag, MVCC_FILE_TYPE_TAG, sizeof(header->file_type_tag))))
+    // clamped against the version below, as emplace_front_locked clamps against the newest one
+    bpt::ptime stamp(size_ > 1 && timestamp < timestamps_[slot_index(1)] ? timestamps_[slot_index(1)] : timestamp);
+    values_[first_].~mvcc_value<value_t>();
+    try
     {
-	throw malformed_db_error("Incorrect file type tag found")
-		<< info_component_identity("mvcc_memory")
-		<< info_data_identity(HEADER_KEY);
+	constructor(static_cast<void*>(&values_[first_]));
     }
-    if (UNLIKELY_EXT(header->memory_version < MVCC_MIN_SUPPORTED_VERSION ||
-	    header->memory_version > MVCC_MAX_SUPPORTED_VERSION))
+    catch (...)
     {
-	throw unsupported_db_error("Unsuported memory version")
-		<< info_component_identity("mvcc_memory")
-		<< info_version_found(header->memory_version)
-		<< info_min_supported_version(MVCC_MIN_SUPPORTED_VERSION)
-		<< info_max_supported_version(MVCC_MAX_SUPPORTED_VERSION);
+	// the slot no longer holds a value so the version it held is dropped
+	first_ = slot_index(1);
+	--size_;
+	throw;
     }
-    if (UNLIKELY_EXT(sizeof(mvcc_header) != header->header_size))
+    revisions_[first_] = revision;
+    timestamps_[first_] = stamp;
+}
+
+template <class value_t>
+template <class constructor_t>
+void mvcc_history<value_t>::emplace_front_locked(constructor_t constructor, const mvcc_revision& revision, const bpt::ptime& timestamp)
+{
+    // find_by_timestamp relies on the timestamps never going down, even if the clock is set back
+    bpt::ptime stamp(size_ && timestamp < timestamps_[first_] ? timestamps_[first_] : timestamp);
+    if (size_ == capacity_)
     {
-	throw malformed_db_error("Wrong header size")
-		<< info_component_identity("mvcc_memory")
-		<< info_data_identity(HEADER_KEY);
+	// a full history overwrites its oldest version
+	destroy_back();
     }
+    size_type slot = previous_slot();
+    constructor(static_cast<void*>(&values_[slot]));
+    revisions_[slot] = revision;
+    new (&timestamps_[slot]) bpt::ptime(stamp);
+    first_ = slot;
+    ++size_;
+    observed_.store(false, boost::memory_order_relaxed);
 }
 
-template <class memory_t>
-void init(memory_t& memory)
+template <class value_t>
+void mvcc_history<value_t>::pop_back()
 {
-    memory.template construct<mvcc_header>(HEADER_KEY)();
-    memory.template construct< mvcc_resource_pool<memory_t> >(RESOURCE_POOL_KEY)(&memory);
+    write_lock lock(mutex_);
+    if (size_)
+    {
+	destroy_back();
+    }
 }
 
-template <class memory_t>
-mvcc_reader_handle<memory_t>::mvcc_reader_handle(memory_t& memory) :
-    memory_(memory), token_id_(acquire_reader_token(memory))
+template <class value_t>
+void mvcc_history<value_t>::pop_back_before(const mvcc_revision& threshold)
 {
-    check(memory);
+    write_lock lock(mutex_);
+    if (size_ > 1 && revisions_[slot_index(size_ - 1)] < threshold)
+    {
+	destroy_back();
+    }
 }
 
-template <class memory_t>
-mvcc_reader_handle<memory_t>::~mvcc_reader_handle()
+template <class value_t>
+boost::optional<const mvcc_value<value_t>&> mvcc_history<value_t>::find_by_revision(const mvcc_revision& revision, mvcc_reader_token* token) const
+{
+    return find_first_at_or_before(revisions_, revision, token);
+}
+
+template <class value_t>
+boost::optional<const mvcc_value<value_t>&> mvcc_history<value_t>::find_by_timestamp(const bpt::ptime& timestamp, mvcc_reader_token* token) const
+{
+    return find_first_at_or_before(timestamps_, timestamp, token);
+}
+
+template <class value_t>
+void mvcc_history<value_t>::grow(size_type new_capacity)
 {
+    write_lock lock(mutex_);
+    if (new_capacity <= capacity_)
+    {
+	return;
+    }
+    void* columns = manager_->allocate(values_offset(new_capacity) + sizeof(mvcc_value<value_t>) * new_capacity);
+    mvcc_revision* revisions = static_cast<mvcc_revision*>(columns);
+    bpt::ptime* timestamps = reinterpret_cast<bpt::ptime*>(revisions + new_capacity);
+    mvcc_value<value_t>* values = reinterpret_cast<mvcc_value<value_t>*>(static_cast<char*>(columns) + values_offset(new_capacity));
+    size_type copied = 0;
     try
     {
-	release_reader_token(memory_, token_id_);
+	for (; copied < size_; ++copied)
+	{
+	    new (&values[copied]) mvcc_value<value_t>(values_[slot_index(copied)]);
+	    revisions[copied] = revisions_[slot_index(copied)];
+	    new (&timestamps[copied]) bpt::ptime(timestamps_[slot_index(copied)]);
+	}
     }
-    catch(...)
+    catch (...)
     {
-	// do nothing
+	while (copied)
+	{
+	    values[--copied].~mvcc_value<value_t>();
+	}
+	manager_->deallocate(columns);
+	throw;
+    }
+    for (size_type offset = 0; offset < size_; ++offset)
+    {
+	values_[slot_index(offset)].~mvcc_value<value_t>();
+    }
+    if (revisions_)
+    {
+	manager_->deallocate(revisions_.get());
     }
+    attach(columns, new_capacity);
+    capacity_ = new_capacity;
+    first_ = 0;
 }
 
-template <class memory_t>
 template <class value_t>
-bool mvcc_reader_handle<memory_t>::exists(const char* key) const
+typename mvcc_history<value_t>::size_type mvcc_history<value_t>::capacity() const
 {
-    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
-    return record && !record->ringbuf.empty() && !record->want_removed;
+    read_lock lock(mutex_);
+    return capacity_;
 }
 
-template <class memory_t>
 template <class value_t>
-const boost::optional<const value_t&> mvcc_reader_handle<memory_t>::read(const char* key) const
+typename mvcc_history<value_t>::size_type mvcc_history<value_t>::element_count() const
 {
-    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
-    boost::optional<const value_t&> result;
-    if (record && !record->ringbuf.empty() && !record->want_removed)
-    {
-	const mvcc_value<value_t>& value = record->ringbuf.front();
-	result = value.value;
+    read_lock lock(mutex_);
+    return size_;
+}
+
+template <class value_t>
+bool mvcc_history<value_t>::empty() const
+{
+    read_lock lock(mutex_);
+    return size_ == 0;
+}
+
+template <class value_t>
+bool mvcc_history<value_t>::full() const
+{
+    read_lock lock(mutex_);
+    return size_ == capacity_;
+}
+
+// The column is in descending order from the front, so the search is for the first
+// key at or before the one given
+template <class value_t>
+template <class key_t>
+boost::optional<const mvcc_value<value_t>&> mvcc_history<value_t>::find_first_at_or_before(
+	const bip::offset_ptr<key_t>& column, const key_t& key, mvcc_reader_token* token) const
+{
+    read_lock lock(mutex_);
+    const key_t* keys = column.get();
+    size_type low = 0;
+    size_type high = size_;
+    while (low < high)
+    {
+	size_type middle = low + ((high - low) / 2);
+	if (keys[slot_index(middle)] <= key)
+	{
+	    high = middle;
+	}
+	else
+	{
+	    low = middle + 1;
+	}
+    }
+    boost::optional<const mvcc_value<value_t>&> result;
+    if (low < size_)
+    {
+	observe(low);
+	result = values_[slot_index(low)];
+	if (token)
+	{
+	    // popping a version takes the write lock, so it can't happen before the read is tracked
+	    track_read(*token, result.get());
+	}
+    }
+    return result;
+}
+
+template <class value_t>
+mvcc_revision mvcc_history<value_t>::newest_revision_locked() const
+{
+    return size_ ? revisions_[first_] : 0;
+}
+
+template <class value_t>
+void mvcc_history<value_t>::observe(size_type offset) const
+{
+    // checked first so readers of a hot key don't keep writing to its cache line
+    if (offset == 0 && !observed_.load(boost::memory_order_relaxed))
+    {
+	observed_.store(true, boost::memory_order_relaxed);
+    }
+}
+
+template <class value_t>
+typename mvcc_history<value_t>::size_type mvcc_history<value_t>::values_offset(size_type capacity)
+{
+    size_type offset = (sizeof(mvcc_revision) + sizeof(bpt::ptime)) * capacity;
+    size_type alignment = boost::alignment_of< mvcc_value<value_t> >::value;
+    return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+template <class value_t>
+void mvcc_history<value_t>::attach(void* columns, size_type capacity)
+{
+    revisions_ = static_cast<mvcc_revision*>(columns);
+    timestamps_ = reinterpret_cast<bpt::ptime*>(revisions_.get() + capacity);
+    values_ = reinterpret_cast<mvcc_value<value_t>*>(static_cast<char*>(columns) + values_offset(capacity));
+}
+
+template <class value_t>
+typename mvcc_history<value_t>::size_type mvcc_history<value_t>::slot_index(size_type offset) const
+{
+    return (first_ + offset) % capacity_;
+}
+
+template <class value_t>
+typename mvcc_history<value_t>::size_type mvcc_history<value_t>::previous_slot() const
+{
+    return first_ ? first_ - 1 : capacity_ - 1;
+}
+
+template <class value_t>
+void mvcc_history<value_t>::destroy_back()
+{
+    values_[slot_index(size_ - 1)].~mvcc_value<value_t>();
+    --size_;
+}
+
+template <class value_t>
+mvcc_record<value_t>::mvcc_record(typename mvcc_history<value_t>::segment_manager_t* manager, std::size_t depth) :
+	history(depth, manager),
+	want_removed(false)
+{ }
+
+template <class value_t>
+mvcc_inline_slot<value_t>::mvcc_inline_slot() :
+	sequence(0), revision(0), timestamp()
+{ }
+
+template <class value_t>
+mvcc_inline_record<value_t>::mvcc_inline_record() :
+	// the first write goes to slot 0
+	current(1),
+	want_removed(false)
+{ }
+
+template <class value_t>
+void track_read(mvcc_reader_token& token, const mvcc_value<value_t>& value)
+{
+    token.last_read_timestamp.reset(value.timestamp);
+    token.last_read_revision.reset(value.revision);
+}
+
+template <class value_t>
+mvcc_history_iterator<value_t>::mvcc_history_iterator() :
+	record_(0), token_(0), current_(0)
+{ }
+
+template <class value_t>
+mvcc_history_iterator<value_t>::mvcc_history_iterator(const mvcc_record<value_t>* record, mvcc_reader_token* token) :
+	record_(record), token_(token), current_(0)
+{
+    hold(record_->history.find_by_revision(std::numeric_limits<mvcc_revision>::max(), token_));
+}
+
+template <class value_t>
+const mvcc_value<value_t>& mvcc_history_iterator<value_t>::dereference() const
+{
+    return *current_;
+}
+
+template <class value_t>
+void mvcc_history_iterator<value_t>::increment()
+{
+    if (UNLIKELY_EXT(current_->revision == 0))
+    {
+	hold(boost::none);
+    }
+    else
+    {
+	// searching by revision rather than position keeps the walk stable while the writer pushes new versions
+	hold(record_->history.find_by_revision(current_->revision - 1, token_));
+    }
+}
+
+template <class value_t>
+bool mvcc_history_iterator<value_t>::equal(const mvcc_history_iterator<value_t>& other) const
+{
+    return current_ == other.current_;
+}
+
+template <class value_t>
+void mvcc_history_iterator<value_t>::hold(const boost::optional<const mvcc_value<value_t>&>& version)
+{
+    if (version)
+    {
+	current_ = &version.get();
+    }
+    else
+    {
+	record_ = 0;
+	token_ = 0;
+	current_ = 0;
+    }
+}
+
+template <class memory_t>
+const mvcc_resource_pool<memory_t>* const_resource_pool_ptr(const memory_t& memory)
+{
+    return const_cast<memory_t&>(memory).template find< const mvcc_resource_pool<memory_t> >(RESOURCE_POOL_KEY).first;
+}
+
+template <class memory_t>
+mvcc_resource_pool<memory_t>* mut_resource_pool_ptr(memory_t& memory)
+{
+    return memory.template find< mvcc_resource_pool<memory_t> >(RESOURCE_POOL_KEY).first;
+}
+
+template <class memory_t>
+const mvcc_resource_pool<memory_t>& const_resource_pool_ref(const memory_t& memory)
+{
+    return *const_resource_pool_ptr(memory);
+}
+
+template <class memory_t>
+mvcc_resource_pool<memory_t>& mut_resource_pool_ref(memory_t& memory)
+{
+    return *mut_resource_pool_ptr(memory);
+}
+
+template <class memory_t>
+const mvcc_header* const_header_ptr(const memory_t& memory)
+{
+    return const_cast<memory_t&>(memory).template find<const mvcc_header>(HEADER_KEY).first;
+}
+
+template <class memory_t>
+mvcc_header* mut_header_ptr(memory_t& memory)
+{
+    return memory.template find<mvcc_header>(HEADER_KEY).first;
+}
+
+template <class memory_t>
+const mvcc_header& const_header_ref(const memory_t& memory)
+{
+    return *const_header_ptr(memory);
+}
+
+template <class memory_t>
+mvcc_header& mut_header_ref(memory_t& memory)
+{
+    return *mut_header_ptr(memory);
+}
+
+template <class memory_t, class value_t>
+const mvcc_record<value_t>* const_record_ptr(const memory_t& memory, const char* key)
+{
+    return const_cast<memory_t&>(memory).template find< const mvcc_record<value_t> >(key).first;
+}
+
+template <class memory_t, class value_t>
+mvcc_record<value_t>* mut_record_ptr(memory_t& memory, const char* key)
+{
+    return memory.template find< mvcc_record<value_t> >(key).first;
+}
+
+template <class memory_t, class value_t>
+const mvcc_record<value_t>& const_record_ref(const memory_t& memory, const char* key)
+{
+    return *const_record_ptr(memory);
+}
+
+template <class memory_t, class value_t>
+mvcc_record<value_t>& mut_record_ref(memory_t& memory, const char* key)
+{
+    return *mut_record_ptr(memory);
+}
+
+inline const char* key_c_str(const char* key)
+{
+    return key;
+}
+
+inline const char* key_c_str(const std::string& key)
+{
+    return key.c_str();
+}
+
+template <class memory_t, class value_t>
+const mvcc_inline_record<value_t>* const_inline_record_ptr(const memory_t& memory, const char* key)
+{
+    return const_cast<memory_t&>(memory).template find< const mvcc_inline_record<value_t> >(key).first;
+}
+
+template <class memory_t, class value_t>
+mvcc_inline_record<value_t>* mut_inline_record_ptr(memory_t& memory, const char* key)
+{
+    return memory.template find< mvcc_inline_record<value_t> >(key).first;
+}
+
+template <class memory_t>
+mvcc_registry_entry<memory_t>* acquire_registry_chunk(memory_t& memory, mvcc_registry<memory_t>& registry, std::size_t chunk)
+{
+    typename memory_t::handle_t handle = registry.chunks[chunk].load(boost::memory_order_acquire);
+    if (UNLIKELY_EXT(handle == 0))
+    {
+	mvcc_registry_entry<memory_t>* entries = static_cast<mvcc_registry_entry<memory_t>*>(
+		memory.allocate(sizeof(mvcc_registry_entry<memory_t>) * MVCC_REGISTRY_CHUNK_SIZE));
+	for (std::size_t index = 0; index < MVCC_REGISTRY_CHUNK_SIZE; ++index)
+	{
+	    new (&entries[index]) mvcc_registry_entry<memory_t>();
+	}
+	if (registry.chunks[chunk].compare_exchange_strong(handle, memory.get_handle_from_address(entries),
+		boost::memory_order_acq_rel))
+	{
+	    return entries;
+	}
+	// another writer installed the chunk first and handle now holds it
+	for (std::size_t index = 0; index < MVCC_REGISTRY_CHUNK_SIZE; ++index)
+	{
+	    entries[index].~mvcc_registry_entry<memory_t>();
+	}
+	memory.deallocate(entries);
+    }
+    return static_cast<mvcc_registry_entry<memory_t>*>(memory.get_address_from_handle(handle));
+}
+
+template <class memory_t>
+void publish_registry_entry(memory_t& memory, mvcc_registry<memory_t>& registry, std::size_t index,
+	const mvcc_key& key, boost::uint64_t type_id, typename memory_t::handle_t record)
+{
+    mvcc_registry_entry<memory_t>& entry = acquire_registry_chunk(memory, registry,
+	    index / MVCC_REGISTRY_CHUNK_SIZE)[index % MVCC_REGISTRY_CHUNK_SIZE];
+    entry.key = key;
+    entry.type_id = type_id;
+    entry.record = record;
+    entry.published.store(true, boost::memory_order_release);
+}
+
+template <class memory_t>
+void register_key(memory_t& memory, const mvcc_key& key, boost::uint64_t type_id, typename memory_t::handle_t record)
+{
+    mvcc_registry<memory_t>& registry = mut_resource_pool_ref(memory).registry;
+    std::size_t index = registry.claimed.fetch_add(1, boost::memory_order_relaxed);
+    if (UNLIKELY_EXT(index >= MVCC_REGISTRY_CHUNK_SIZE * MVCC_REGISTRY_CHUNK_LIMIT))
+    {
+	throw storage_error("Registry is full")
+		<< info_component_identity("mvcc_memory")
+		<< info_data_identity(key.c_str);
+    }
+    publish_registry_entry(memory, registry, index, key, type_id, record);
+}
+
+// Claims the slots of every key with a single fetch_add
+template <class memory_t>
+void register_keys(memory_t& memory, const std::vector<mvcc_key>& keys, boost::uint64_t type_id,
+	const std::vector<typename memory_t::handle_t>& records)
+{
+    if (keys.empty())
+    {
+	return;
+    }
+    mvcc_registry<memory_t>& registry = mut_resource_pool_ref(memory).registry;
+    std::size_t first = registry.claimed.fetch_add(keys.size(), boost::memory_order_relaxed);
+    if (UNLIKELY_EXT(first + keys.size() > MVCC_REGISTRY_CHUNK_SIZE * MVCC_REGISTRY_CHUNK_LIMIT))
+    {
+	throw storage_error("Registry is full")
+		<< info_component_identity("mvcc_memory")
+		<< info_data_identity(keys.front().c_str);
+    }
+    for (std::size_t offset = 0; offset < keys.size(); ++offset)
+    {
+	publish_registry_entry(memory, registry, first + offset, keys[offset], type_id, records[offset]);
+    }
+}
+
+// Slots claimed by a writer that has not finished filling them in are skipped
+template <class memory_t>
+const mvcc_registry_entry<memory_t>* const_registry_entry_ptr(const memory_t& memory, std::size_t index)
+{
+    const mvcc_registry<memory_t>& registry = const_resource_pool_ref(memory).registry;
+    typename memory_t::handle_t handle = registry.chunks[index / MVCC_REGISTRY_CHUNK_SIZE].load(boost::memory_order_acquire);
+    if (UNLIKELY_EXT(handle == 0))
+    {
+	return 0;
+    }
+    const mvcc_registry_entry<memory_t>& entry = static_cast<const mvcc_registry_entry<memory_t>*>(
+	    memory.get_address_from_handle(handle))[index % MVCC_REGISTRY_CHUNK_SIZE];
+    return entry.published.load(boost::memory_order_acquire) ? &entry : 0;
+}
+
+template <class memory_t>
+std::size_t registered_count(const memory_t& memory)
+{
+    return std::min(const_resource_pool_ref(memory).registry.claimed.load(boost::memory_order_acquire),
+	    MVCC_REGISTRY_CHUNK_SIZE * MVCC_REGISTRY_CHUNK_LIMIT);
+}
+
+// The caller holds the journal mutex
+template <class memory_t>
+void append_change(memory_t& memory, const mvcc_key& key, const mvcc_revision& revision, bool removed)
+{
+    mvcc_change_journal& journal = mut_resource_pool_ref(memory).journal;
+    boost::uint64_t position = journal.appended.load(boost::memory_order_relaxed);
+    mvcc_journal_entry& entry = journal.entries[position % MVCC_JOURNAL_CAPACITY];
+    if (position >= MVCC_JOURNAL_CAPACITY)
+    {
+	journal.overwritten_revision.store(entry.revision, boost::memory_order_relaxed);
+    }
+    entry.sequence.store(position * 2 + 1, boost::memory_order_release);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    entry.revision = revision;
+    entry.removed = removed;
+    entry.key = key;
+    entry.sequence.store(position * 2 + 2, boost::memory_order_release);
+    journal.appended.store(position + 1, boost::memory_order_release);
+}
+
+// The caller holds the journal mutex
+template <class memory_t, class iterator_t>
+void append_changes(memory_t& memory, iterator_t first, std::size_t count, const mvcc_revision& revision)
+{
+    for (std::size_t index = 0; index < count; ++index, ++first)
+    {
+	append_change(memory, mvcc_key(key_c_str(first->first)), revision, false);
+    }
+}
+
+template <class value_t>
+void trim_oldest(void* address, boost::uint64_t threshold)
+{
+    mvcc_record<value_t>* record = static_cast<mvcc_record<value_t>*>(address);
+    if (record->want_removed)
+    {
+	record->history.pop_back();
+    }
+    else
+    {
+	record->history.pop_back_before(threshold);
+    }
+}
+
+template <class value_t>
+bool expire_newest(void* address, boost::uint64_t revision)
+{
+    mvcc_record<value_t>* record = static_cast<mvcc_record<value_t>*>(address);
+    return record->history.apply_if(mvcc_newest_revision_is(revision, record->want_removed),
+	    mvcc_removal_marker(record->want_removed));
+}
+
+// Enrolls the type in this process on first use
+template <class value_t>
+boost::uint64_t enrolled_type_id()
+{
+    static const boost::uint64_t type_id = mvcc_type_table::hash_type_name(typeid(value_t).name());
+    static const bool enrolled = (mvcc_type_table::instance().enroll(type_id, &trim_oldest<value_t>, &expire_newest<value_t>), true);
+    (void)enrolled;
+    return type_id;
+}
+
+inline const mvcc_type_table::functions* find_type_functions(const mvcc_type_table::snapshot_type& functions, boost::uint64_t type_id)
+{
+    for (mvcc_type_table::snapshot_type::const_iterator iter = functions.begin(); iter != functions.end(); ++iter)
+    {
+	if (iter->first == type_id)
+	{
+	    return &iter->second;
+	}
+    }
+    return 0;
+}
+
+template <class memory_t>
+void trim_entry(memory_t& memory, const mvcc_registry_entry<memory_t>& entry, const mvcc_type_table::snapshot_type& trims, boost::uint64_t threshold)
+{
+    const mvcc_type_table::functions* functions = find_type_functions(trims, entry.type_id);
+    // a type never enrolled in this process can't be collected here
+    if (LIKELY_EXT(functions != 0))
+    {
+	functions->trim(memory.get_address_from_handle(entry.record), threshold);
+    }
+}
+
+template <class memory_t>
+void check(const memory_t& memory)
+{
+    const mvcc_header* header = const_header_ptr(memory);
+    if (UNLIKELY_EXT(!header))
+    {
+	throw malformed_db_error("Could not find header")
+		<< info_component_identity("mvcc_memory")
+		<< info_data_identity(HEADER_KEY);
+    }
+    // If endianess is different the indicator will be 65280 instead of 255
+    if (UNLIKELY_EXT(header->endianess_indicator != std::numeric_limits<boost::uint8_t>::max()))
+    {
+	throw unsupported_db_error("Memory requires byte swapping")
+		<< info_component_identity("mvcc_memory")
+		<< info_version_found(header->memory_version);
+    }
+    if (UNLIKELY_EXT(strncmp(header->file_type_tag, MVCC_FILE_TYPE_TAG, sizeof(header->file_type_tag))))
+    {
+	throw malformed_db_error("Incorrect file type tag found")
+		<< info_component_identity("mvcc_memory")
+		<< info_data_identity(HEADER_KEY);
+    }
+    if (UNLIKELY_EXT(header->memory_version < MVCC_MIN_SUPPORTED_VERSION ||
+	    header->memory_version > MVCC_MAX_SUPPORTED_VERSION))
+    {
+	throw unsupported_db_error("Unsuported memory version")
+		<< info_component_identity("mvcc_memory")
+		<< info_version_found(header->memory_version)
+		<< info_min_supported_version(MVCC_MIN_SUPPORTED_VERSION)
+		<< info_max_supported_version(MVCC_MAX_SUPPORTED_VERSION);
+    }
+    if (UNLIKELY_EXT(sizeof(mvcc_header) != header->header_size))
+    {
+	throw malformed_db_error("Wrong header size")
+		<< info_component_identity("mvcc_memory")
+		<< info_data_identity(HEADER_KEY);
+    }
+    if (UNLIKELY_EXT(header->reader_limit == 0 || header->reader_limit > MVCC_READER_LIMIT))
+    {
+	throw malformed_db_error("Reader limit out of range")
+		<< info_component_identity("mvcc_memory")
+		<< info_data_identity(HEADER_KEY);
+    }
+}
+
+template <class memory_t>
+void init(memory_t& memory, reader_token_id reader_limit)
+{
+    memory.template construct<mvcc_header>(HEADER_KEY)(reader_limit);
+    memory.template construct< mvcc_resource_pool<memory_t> >(RESOURCE_POOL_KEY)(&memory, reader_limit);
+}
+
+template <class memory_t>
+boost::optional<reader_token_id> reserve_reader_token(memory_t& memory, reader_token_id from = 0)
+{
+    check(memory);
+    mvcc_resource_pool<memory_t>& pool = mut_resource_pool_ref(memory);
+    reader_token_id limit = const_header_ref(memory).reader_limit;
+    boost::optional<reader_token_id> result;
+    for (reader_token_id iter = from; iter < limit && !result; ++iter)
+    {
+	bool expected = false;
+	if (!pool.reader_token_pool[iter].reserved.load(boost::memory_order_relaxed) &&
+	    pool.reader_token_pool[iter].reserved.compare_exchange_strong(
+		    expected, true, boost::memory_order_acquire))
+	{
+	    pool.reader_token_pool[iter].owner_pid.store(get_process_id(), boost::memory_order_release);
+	    result = iter;
+	}
+    }
+    return result;
+}
+
+// Forgets the last read, so a token lying idle does not hold the collection threshold back
+inline void clear_read(mvcc_reader_token& token)
+{
+    token.last_read_revision.reset();
+    token.last_read_timestamp.reset();
+}
+
+template <class memory_t>
+void unreserve_reader_token(memory_t& memory, const reader_token_id& id)
+{
+    mvcc_reader_token& token = mut_resource_pool_ref(memory).reader_token_pool[id];
+    clear_read(token);
+    token.owner_pid.store(0, boost::memory_order_relaxed);
+    token.reserved.store(false, boost::memory_order_release);
+}
+
+// The tokens of a cache, shared with the leases of the threads it handed them to
+struct mvcc_reader_cache_state : private boost::noncopyable
+{
+    mvcc_reader_cache_state() : detached(false) { }
+    boost::mutex mutex;
+    std::vector<reader_token_id> reserved;
+    std::vector<reader_token_id> idle;
+    // Set once the cache has given its tokens back, after which the leases left must not touch the memory
+    bool detached;
+};
+
+template <class memory_t>
+struct mvcc_reader_lease : private boost::noncopyable
+{
+    mvcc_reader_lease(memory_t& memory, const boost::shared_ptr<mvcc_reader_cache_state>& s, const reader_token_id& id);
+    ~mvcc_reader_lease();
+    boost::shared_ptr<mvcc_reader_cache_state> state;
+    mvcc_reader_handle<memory_t> handle;
+};
+
+template <class memory_t>
+mvcc_reader_handle<memory_t>::mvcc_reader_handle(memory_t& memory) :
+    memory_(memory), token_id_(acquire_reader_token(memory)), is_leased_(false)
+{ }
+
+template <class memory_t>
+mvcc_reader_handle<memory_t>::mvcc_reader_handle(memory_t& memory, const reader_token_id& leased_id) :
+    memory_(memory), token_id_(leased_id), is_leased_(true)
+{ }
+
+template <class memory_t>
+mvcc_reader_handle<memory_t>::~mvcc_reader_handle()
+{
+    if (is_leased_)
+    {
+	return;
+    }
+    try
+    {
+	release_reader_token(memory_, token_id_);
+    }
+    catch(...)
+    {
+	// do nothing
+    }
+}
+
+template <class memory_t>
+template <class value_t>
+bool mvcc_reader_handle<memory_t>::exists(const char* key) const
+{
+    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
+    return record && !record->history.empty() && !record->want_removed;
+}
+
+template <class memory_t>
+template <class value_t>
+const boost::optional<const value_t&> mvcc_reader_handle<memory_t>::read(const char* key) const
+{
+    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
+    boost::optional<const value_t&> result;
+    if (record && !record->history.empty() && !record->want_removed)
+    {
+	const mvcc_value<value_t>& value = record->history.front();
+	result = value.value;
 	// the mvcc_reader_token will ensure the returned reference remains valid
-	mut_resource_pool_ref(memory_).reader_token_pool[token_id_].
-		last_read_timestamp.reset(value.timestamp);
-	mut_resource_pool_ref(memory_).reader_token_pool[token_id_].
-		last_read_revision.reset(value.revision);
+	track_read(mut_resource_pool_ref(memory_).reader_token_pool[token_id_], value);
+    }
+    return result;
+}
+
+template <class memory_t>
+template <class value_t>
+std::size_t mvcc_reader_handle<memory_t>::read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const value_t&> >& out) const
+{
+    out.assign(keys.size(), boost::none);
+    mvcc_reader_token& token = mut_resource_pool_ref(memory_).reader_token_pool[token_id_];
+    // the oldest revision read so far, which the token holds for the whole batch
+    boost::optional<mvcc_revision> held;
+    std::size_t found = 0;
+    const mvcc_record<value_t>* records[MVCC_READ_MANY_GROUP_SIZE];
+    for (std::size_t first = 0; first < keys.size(); first += MVCC_READ_MANY_GROUP_SIZE)
+    {
+	// the records of a group are prefetched together so their cache misses overlap,
+	// then the newest versions they point at
+	std::size_t count = std::min(MVCC_READ_MANY_GROUP_SIZE, keys.size() - first);
+	for (std::size_t offset = 0; offset < count; ++offset)
+	{
+	    records[offset] = const_record_ptr<memory_t, value_t>(memory_, keys[first + offset]);
+	    if (records[offset])
+	    {
+		PREFETCH_EXT(records[offset]);
+	    }
+	}
+	for (std::size_t offset = 0; offset < count; ++offset)
+	{
+	    if (records[offset])
+	    {
+		records[offset]->history.prefetch_newest();
+	    }
+	}
+	for (std::size_t offset = 0; offset < count; ++offset)
+	{
+	    const mvcc_record<value_t>* record = records[offset];
+	    if (!record || record->want_removed)
+	    {
+		continue;
+	    }
+	    boost::optional<const mvcc_value<value_t>&> value = record->history.newest(token, held);
+	    if (value)
+	    {
+		out[first + offset] = value->value;
+		++found;
+	    }
+	}
+    }
+    return found;
+}
+
+template <class memory_t>
+template <class value_t>
+const boost::optional<const value_t&> mvcc_reader_handle<memory_t>::read_at(const char* key, boost::uint64_t revision) const
+{
+    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
+    boost::optional<const value_t&> result;
+    if (record && !record->want_removed)
+    {
+	// the history is ordered from the newest version at the front to the oldest at the back
+	boost::optional<const mvcc_value<value_t>&> value =
+		record->history.find_by_revision(revision, &mut_resource_pool_ref(memory_).reader_token_pool[token_id_]);
+	if (value)
+	{
+	    result = value->value;
+	}
     }
     return result;
 }
 
+template <class memory_t>
+template <class value_t>
+const boost::optional<const value_t&> mvcc_reader_handle<memory_t>::read_as_of(const char* key, const bpt::ptime& timestamp) const
+{
+    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
+    boost::optional<const value_t&> result;
+    if (record && !record->want_removed)
+    {
+	boost::optional<const mvcc_value<value_t>&> value =
+		record->history.find_by_timestamp(timestamp, &mut_resource_pool_ref(memory_).reader_token_pool[token_id_]);
+	if (value)
+	{
+	    result = value->value;
+	}
+    }
+    return result;
+}
+
+template <class memory_t>
+template <class value_t>
+mvcc_history_iterator<value_t> mvcc_reader_handle<memory_t>::history(const char* key) const
+{
+    const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
+    if (record && !record->want_removed)
+    {
+	return mvcc_history_iterator<value_t>(record, &mut_resource_pool_ref(memory_).reader_token_pool[token_id_]);
+    }
+    else
+    {
+	return mvcc_history_iterator<value_t>();
+    }
+}
+
+template <class memory_t>
+template <class value_t>
+boost::optional<value_t> mvcc_reader_handle<memory_t>::read_inline(const char* key) const
+{
+    BOOST_STATIC_ASSERT(boost::has_trivial_copy<value_t>::value);
+    const mvcc_inline_record<value_t>* record = const_inline_record_ptr<memory_t, value_t>(memory_, key);
+    boost::optional<value_t> result;
+    if (!record)
+    {
+	return result;
+    }
+    char copy[sizeof(value_t)] __attribute__((aligned(__alignof__(value_t))));
+    bool removed = false;
+    for (;;)
+    {
+	const mvcc_inline_slot<value_t>& slot = record->slots[record->current.load(boost::memory_order_acquire)];
+	boost::uint32_t sequence = slot.sequence.load(boost::memory_order_acquire);
+	if (UNLIKELY_EXT(sequence == 0))
+	{
+	    // the record exists but its first write hasn't completed yet
+	    return result;
+	}
+	if (UNLIKELY_EXT(sequence & 1))
+	{
+	    continue;
+	}
+	memcpy(copy, slot.value, sizeof(value_t));
+	removed = record->want_removed.load(boost::memory_order_relaxed);
+	boost::atomic_thread_fence(boost::memory_order_acquire);
+	if (LIKELY_EXT(slot.sequence.load(boost::memory_order_relaxed) == sequence))
+	{
+	    break;
+	}
+    }
+    if (!removed)
+    {
+	result = *reinterpret_cast<const value_t*>(copy);
+    }
+    return result;
+}
+
+template <class memory_t>
+bool mvcc_reader_handle<memory_t>::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    const mvcc_change_journal& journal = const_resource_pool_ref(memory_).journal;
+    boost::uint64_t appended = journal.appended.load(boost::memory_order_acquire);
+    boost::uint64_t oldest = (appended > MVCC_JOURNAL_CAPACITY) ? appended - MVCC_JOURNAL_CAPACITY : 0;
+    std::size_t first = out.size();
+    bool reached = false;
+    // walks back from the newest change so the cost follows the number of changes, not the capacity
+    for (boost::uint64_t position = appended; position > oldest && !reached; --position)
+    {
+	const mvcc_journal_entry& entry = journal.entries[(position - 1) % MVCC_JOURNAL_CAPACITY];
+	if (UNLIKELY_EXT(entry.sequence.load(boost::memory_order_acquire) != position * 2))
+	{
+	    // the slot has been reused since, overwritten_revision tells whether that lost anything
+	    break;
+	}
+	mvcc_change change;
+	change.revision = entry.revision;
+	change.removed = entry.removed;
+	mvcc_key key(entry.key);
+	boost::atomic_thread_fence(boost::memory_order_acquire);
+	if (UNLIKELY_EXT(entry.sequence.load(boost::memory_order_relaxed) != position * 2))
+	{
+	    break;
+	}
+	if (change.revision <= revision)
+	{
+	    reached = true;
+	}
+	else
+	{
+	    change.key = key.c_str;
+	    out.push_back(change);
+	}
+    }
+    if (!reached && journal.overwritten_revision.load(boost::memory_order_acquire) > revision)
+    {
+	out.resize(first);
+	return false;
+    }
+    std::reverse(out.begin() + first, out.end());
+    return true;
+}
+
+template <class memory_t>
+boost::uint64_t mvcc_reader_handle<memory_t>::get_journal_revision() const
+{
+    const mvcc_change_journal& journal = const_resource_pool_ref(memory_).journal;
+    for (;;)
+    {
+	boost::uint64_t appended = journal.appended.load(boost::memory_order_acquire);
+	if (appended == 0)
+	{
+	    return 0;
+	}
+	const mvcc_journal_entry& entry = journal.entries[(appended - 1) % MVCC_JOURNAL_CAPACITY];
+	mvcc_revision revision = entry.revision;
+	boost::atomic_thread_fence(boost::memory_order_acquire);
+	if (LIKELY_EXT(entry.sequence.load(boost::memory_order_relaxed) == appended * 2))
+	{
+	    return revision;
+	}
+    }
+}
+
 template <class memory_t>
 std::size_t mvcc_reader_handle<memory_t>::get_available_space() const
 {
@@ -422,27 +1653,28 @@ std::size_t mvcc_reader_handle<memory_t>::get_size() const
     return memory_.get_size();
 }
 
+template <class memory_t>
+reader_token_id mvcc_reader_handle<memory_t>::get_reader_limit() const
+{
+    return const_header_ref(memory_).reader_limit;
+}
+
 template <class memory_t>
 reader_token_id mvcc_reader_handle<memory_t>::acquire_reader_token(memory_t& memory)
 {
-    reader_token_id reservation;
-    if (UNLIKELY_EXT(!mut_resource_pool_ref(memory).reader_free_list.pop(reservation)))
+    boost::optional<reader_token_id> reservation = reserve_reader_token(memory);
+    if (UNLIKELY_EXT(!reservation))
     {
 	throw busy_condition("No reader token available")
 		<< info_component_identity("mvcc_memory");
     }
-    return reservation;
+    return reservation.get();
 }
 
 template <class memory_t>
 void mvcc_reader_handle<memory_t>::release_reader_token(memory_t& memory, const reader_token_id& id)
 {
-    bra::mt19937 seed;
-    bra::uniform_int_distribution<> generator(100, 200);
-    while (UNLIKELY_EXT(!mut_resource_pool_ref(memory).reader_free_list.push(id)))
-    {
-	boost::this_thread::sleep_for(boost::chrono::nanoseconds(generator(seed)));
-    }
+    unreserve_reader_token(memory, id);
 }
 
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
@@ -472,13 +1704,13 @@ template <class value_t>
 boost::uint64_t mvcc_reader_handle<memory_t>::get_oldest_revision(const char* key) const
 {
     const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
-    if (UNLIKELY_EXT(!record || record->ringbuf.empty()))
+    if (UNLIKELY_EXT(!record || record->history.empty()))
     {
 	return 0U;
     }
     else
     {
-	return record->ringbuf.back().revision;
+	return record->history.back_revision();
     }
 }
 
@@ -487,13 +1719,13 @@ template <class value_t>
 boost::uint64_t mvcc_reader_handle<memory_t>::get_newest_revision(const char* key) const
 {
     const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
-    if (UNLIKELY_EXT(!record || record->ringbuf.empty()))
+    if (UNLIKELY_EXT(!record || record->history.empty()))
     {
 	return 0U;
     }
     else
     {
-	return record->ringbuf.front().revision;
+	return record->history.front_revision();
     }
 }
 
@@ -502,18 +1734,114 @@ template <class value_t>
 std::size_t mvcc_reader_handle<memory_t>::get_history_depth(const char* key) const
 {
     const mvcc_record<value_t>* record = const_record_ptr<memory_t, value_t>(memory_, key);
-    if (!record || record->ringbuf.empty())
+    if (!record || record->history.empty())
     {
 	return 0U;
     }
     else
     {
-	return record->ringbuf.element_count();
+	return record->history.element_count();
     }
 }
 
 #endif
 
+template <class memory_t>
+mvcc_reader_lease<memory_t>::mvcc_reader_lease(memory_t& memory, const boost::shared_ptr<mvcc_reader_cache_state>& s,
+	const reader_token_id& id) :
+    state(s), handle(memory, id)
+{ }
+
+template <class memory_t>
+mvcc_reader_lease<memory_t>::~mvcc_reader_lease()
+{
+    try
+    {
+	boost::lock_guard<boost::mutex> guard(state->mutex);
+	if (!state->detached)
+	{
+	    clear_read(mut_resource_pool_ref(handle.memory_).reader_token_pool[handle.token_id_]);
+	    state->idle.push_back(handle.token_id_);
+	}
+    }
+    catch(...)
+    {
+	// do nothing
+    }
+}
+
+template <class memory_t>
+mvcc_reader_token_cache<memory_t>::mvcc_reader_token_cache(memory_t& memory, std::size_t batch_size) :
+    memory_(memory), batch_size_(batch_size ? batch_size : 1), state_(new mvcc_reader_cache_state())
+{
+    check(memory_);
+}
+
+template <class memory_t>
+mvcc_reader_token_cache<memory_t>::~mvcc_reader_token_cache()
+{
+    lease_.reset();
+    boost::lock_guard<boost::mutex> guard(state_->mutex);
+    state_->detached = true;
+    for (std::vector<reader_token_id>::const_iterator iter = state_->reserved.begin(); iter != state_->reserved.end(); ++iter)
+    {
+	unreserve_reader_token(memory_, *iter);
+    }
+}
+
+template <class memory_t>
+mvcc_reader_handle<memory_t>& mvcc_reader_token_cache<memory_t>::get_thread_reader()
+{
+    mvcc_reader_lease<memory_t>* lease = lease_.get();
+    if (UNLIKELY_EXT(!lease))
+    {
+	lease = new mvcc_reader_lease<memory_t>(memory_, state_, checkout());
+	lease_.reset(lease);
+    }
+    return lease->handle;
+}
+
+template <class memory_t>
+std::size_t mvcc_reader_token_cache<memory_t>::get_reserved_count() const
+{
+    boost::lock_guard<boost::mutex> guard(state_->mutex);
+    return state_->reserved.size();
+}
+
+template <class memory_t>
+std::size_t mvcc_reader_token_cache<memory_t>::get_idle_count() const
+{
+    boost::lock_guard<boost::mutex> guard(state_->mutex);
+    return state_->idle.size();
+}
+
+template <class memory_t>
+reader_token_id mvcc_reader_token_cache<memory_t>::checkout()
+{
+    boost::lock_guard<boost::mutex> guard(state_->mutex);
+    if (state_->idle.empty())
+    {
+	boost::optional<reader_token_id> reservation = reserve_reader_token(memory_);
+	for (std::size_t count = 0; reservation && count < batch_size_; ++count)
+	{
+	    state_->reserved.push_back(reservation.get());
+	    state_->idle.push_back(reservation.get());
+	    if (count + 1 < batch_size_)
+	    {
+		reservation = reserve_reader_token(memory_, reservation.get() + 1);
+	    }
+	}
+    }
+    if (UNLIKELY_EXT(state_->idle.empty()))
+    {
+	throw busy_condition("No reader token available")
+		<< info_component_identity("mvcc_memory");
+    }
+    reader_token_id result = state_->idle.back();
+    state_->idle.pop_back();
+    return result;
+}
+
 template <class memory_t>
 mvcc_writer_handle<memory_t>::mvcc_writer_handle(memory_t& memory) :
     memory_(memory), token_id_(acquire_writer_token(memory))
@@ -538,44 +1866,280 @@ mvcc_writer_handle<memory_t>::~mvcc_writer_handle()
 template <class memory_t>
 template <class value_t>
 void mvcc_writer_handle<memory_t>::write(const char* key, const value_t& value)
+{
+    write_impl<value_t>(key, mvcc_value_copier<value_t>(value));
+}
+
+template <class memory_t>
+template <class value_t>
+void mvcc_writer_handle<memory_t>::write(const char* key, const value_t& value, const bpt::time_duration& ttl)
+{
+    write_impl<value_t>(key, mvcc_value_copier<value_t>(value), ttl);
+}
+
+template <class memory_t>
+template <class value_t>
+void mvcc_writer_handle<memory_t>::write_coalesced(const char* key, const value_t& value)
+{
+    write_impl<value_t>(key, mvcc_value_copier<value_t>(value), boost::none, true);
+}
+
+template <class memory_t>
+template <class value_t, class functor_t>
+void mvcc_writer_handle<memory_t>::write_with(const char* key, functor_t functor)
+{
+    write_impl<value_t>(key, mvcc_value_filler<value_t, functor_t>(functor));
+}
+
+template <class memory_t>
+template <class value_t, class constructor_t>
+void mvcc_writer_handle<memory_t>::write_impl(const char* key, const constructor_t& constructor,
+	const boost::optional<bpt::time_duration>& ttl, bool coalesce)
 {
     mvcc_key mkey(key);
-    if (!const_record_ptr<memory_t, value_t>(memory_, mkey.c_str))
+    mvcc_record<value_t>* record = acquire_record<value_t>(mkey);
+    bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+    mvcc_revision revision = mut_resource_pool_ref(memory_).global_revision.fetch_add(
+	    1, boost::memory_order_consume);
+    bpt::ptime timestamp = bpt::microsec_clock::universal_time();
+    // the value is constructed straight into the ring slot and only published once complete
+    if (coalesce)
     {
-	bra::mt19937 seed;
-	bra::uniform_int_distribution<> generator(100, 200);
-	mvcc_deleter<memory_t> deleter(mkey, &delete_oldest<memory_t, value_t>);
-	while (UNLIKELY_EXT(!mut_resource_pool_ref(memory_).deleter_list.push(deleter)))
-	{
-	    boost::this_thread::sleep_for(boost::chrono::nanoseconds(generator(seed)));
-	}
+	record->history.emplace_front_coalesced(boost::bind<void>(constructor, _1, revision, timestamp), revision, timestamp);
+    }
+    else
+    {
+	record->history.emplace_front(boost::bind<void>(constructor, _1, revision, timestamp), revision, timestamp);
+    }
+    record->want_removed = false;
+    append_change(memory_, mkey, revision, false);
+    if (ttl)
+    {
+	// indexed only once published, otherwise the collector could find an older newest revision and drop it
+	mvcc_expiry_index<memory_t>& expiry = mut_resource_pool_ref(memory_).expiry;
+	bip::scoped_lock<bip::interprocess_mutex> expiry_lock(expiry.mutex);
+	expiry.push(mvcc_expiry_entry<memory_t>(timestamp + ttl.get(), revision, mkey,
+		enrolled_type_id<value_t>(), memory_.get_handle_from_address(record)));
+    }
+    mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
+	    last_write_timestamp.reset(timestamp);
+    mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
+	    last_write_revision.reset(revision);
+}
+
+template <class memory_t>
+template <class value_t>
+mvcc_record<value_t>* mvcc_writer_handle<memory_t>::acquire_record(const mvcc_key& key)
+{
+    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory_, key.c_str);
+    if (!record)
+    {
+	record = memory_.template construct< mvcc_record<value_t> >(key.c_str)(memory_.get_segment_manager());
+	register_key(memory_, key, enrolled_type_id<value_t>(), memory_.get_handle_from_address(record));
     }
-    mvcc_record<value_t>* record = memory_.template find_or_construct< mvcc_record<value_t> >(mkey.c_str)(
-	    memory_.get_segment_manager());
-    if (UNLIKELY_EXT(record->ringbuf.full()))
+    if (UNLIKELY_EXT(record->history.full()))
     {
 	// TODO: need a smarter growth algorithm
-	record->ringbuf.grow(record->ringbuf.capacity() * 1.5);
+	record->history.grow(record->history.capacity() * 1.5);
+    }
+    return record;
+}
+
+template <class memory_t>
+template <class value_t>
+bool mvcc_writer_handle<memory_t>::write_if(const char* key, const value_t& value, boost::uint64_t expected_revision)
+{
+    mvcc_key mkey(key);
+    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory_, mkey.c_str);
+    // checked without the write lock first so a stale expectation neither creates the key nor uses up a revision
+    if (!record ? expected_revision != 0 :
+	    !mvcc_newest_revision_is(expected_revision, record->want_removed)(record->history.empty() ? 0 : record->history.front_revision()))
+    {
+	return false;
+    }
+    record = acquire_record<value_t>(mkey);
+    bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+    mvcc_revision revision = mut_resource_pool_ref(memory_).global_revision.fetch_add(
+	    1, boost::memory_order_consume);
+    bpt::ptime timestamp = bpt::microsec_clock::universal_time();
+    if (!record->history.emplace_front_if(mvcc_newest_revision_is(expected_revision, record->want_removed),
+	    boost::bind<void>(mvcc_value_copier<value_t>(value), _1, revision, timestamp), revision, timestamp))
+    {
+	return false;
     }
-    mvcc_value<value_t> tmp(value, mut_resource_pool_ref(memory_).global_revision.fetch_add(
-	    1, boost::memory_order_consume),
-	    bpt::microsec_clock::local_time());
-    record->ringbuf.push_front(tmp);
     record->want_removed = false;
+    append_change(memory_, mkey, revision, false);
+    mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
+	    last_write_timestamp.reset(timestamp);
+    mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
+	    last_write_revision.reset(revision);
+    return true;
+}
+
+template <class memory_t>
+template <class value_t>
+bool mvcc_writer_handle<memory_t>::remove_if(const char* key, boost::uint64_t expected_revision)
+{
+    mvcc_key mkey(key);
+    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory_, mkey.c_str);
+    if (!record)
+    {
+	return expected_revision == 0;
+    }
+    bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+    if (!record->history.apply_if(mvcc_newest_revision_is(expected_revision, record->want_removed),
+	    mvcc_removal_marker(record->want_removed)))
+    {
+	return false;
+    }
+    append_change(memory_, mkey, mut_resource_pool_ref(memory_).global_revision.fetch_add(
+	    1, boost::memory_order_consume), true);
+    return true;
+}
+
+template <class memory_t>
+template <class value_t, class iterator_t>
+std::size_t mvcc_writer_handle<memory_t>::write_bulk(iterator_t first, iterator_t last)
+{
+    // the run is walked twice, once to check it and once to load it
+    BOOST_STATIC_ASSERT((boost::is_convertible<typename std::iterator_traits<iterator_t>::iterator_category,
+	    std::forward_iterator_tag>::value));
+    // checked before anything is written so a stream out of order leaves the memory untouched
+    std::size_t count = 0;
+    for (iterator_t iter = first, previous = first; iter != last; ++iter, ++count)
+    {
+	if (UNLIKELY_EXT(iter != first && !(mvcc_key(key_c_str(previous->first)) < mvcc_key(key_c_str(iter->first)))))
+	{
+	    throw storage_error("Bulk load keys are not in strictly ascending order")
+		    << info_component_identity("mvcc_memory")
+		    << info_data_identity(key_c_str(iter->first));
+	}
+	previous = iter;
+    }
+    if (count == 0)
+    {
+	return 0;
+    }
+    memory_.reserve_named_objects(count);
+    // every version loaded shares one revision and one timestamp.
+    // The journal isn't held while loading: the changes are appended together once the versions
+    // are in place, under a later revision of their own so the journal stays in revision order.
+    mvcc_revision revision = mut_resource_pool_ref(memory_).global_revision.fetch_add(
+	    1, boost::memory_order_consume);
+    bpt::ptime timestamp = bpt::microsec_clock::universal_time();
+    std::vector<mvcc_key> new_keys;
+    std::vector<typename memory_t::handle_t> new_records;
+    std::size_t written = 0;
+    try
+    {
+	for (iterator_t iter = first; iter != last; ++iter, ++written)
+	{
+	    mvcc_key mkey(key_c_str(iter->first));
+	    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory_, mkey.c_str);
+	    if (!record)
+	    {
+		record = memory_.template construct< mvcc_record<value_t> >(mkey.c_str)(
+			memory_.get_segment_manager(), MVCC_BULK_HISTORY_DEPTH);
+		new_keys.push_back(mkey);
+		new_records.push_back(memory_.get_handle_from_address(record));
+	    }
+	    if (UNLIKELY_EXT(record->history.full()))
+	    {
+		record->history.grow(record->history.capacity() * 1.5);
+	    }
+	    record->history.emplace_front(boost::bind<void>(mvcc_value_copier<value_t>(iter->second), _1, revision, timestamp),
+		    revision, timestamp);
+	    // expiry only marks a key removed while its newest version is one written with a time to live,
+	    // which a loaded version never is
+	    record->want_removed = false;
+	}
+    }
+    catch (...)
+    {
+	// the records constructed so far still have to be found by the collector, and their changes by readers
+	register_keys(memory_, new_keys, enrolled_type_id<value_t>(), new_records);
+	bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+	append_changes(memory_, first, written, mut_resource_pool_ref(memory_).global_revision.fetch_add(
+		1, boost::memory_order_consume));
+	throw;
+    }
+    register_keys(memory_, new_keys, enrolled_type_id<value_t>(), new_records);
+    {
+	bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+	append_changes(memory_, first, written, mut_resource_pool_ref(memory_).global_revision.fetch_add(
+		1, boost::memory_order_consume));
+    }
     mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
-	    last_write_timestamp.reset(tmp.timestamp);
+	    last_write_timestamp.reset(timestamp);
     mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
-	    last_write_revision.reset(tmp.revision);
+	    last_write_revision.reset(revision);
+    return count;
 }
 
 template <class memory_t>
 template <class value_t>
 void mvcc_writer_handle<memory_t>::remove(const char* key)
 {
-    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory_, key);
+    mvcc_key mkey(key);
+    mvcc_record<value_t>* record = mut_record_ptr<memory_t, value_t>(memory_, mkey.c_str);
+    if (record)
+    {
+	bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+	record->want_removed = true;
+	// a removal has no version of its own, it only takes a revision to be ordered in the journal
+	append_change(memory_, mkey, mut_resource_pool_ref(memory_).global_revision.fetch_add(
+		1, boost::memory_order_consume), true);
+    }
+}
+
+template <class memory_t>
+template <class value_t>
+void mvcc_writer_handle<memory_t>::write_inline(const char* key, const value_t& value)
+{
+    BOOST_STATIC_ASSERT(sizeof(value_t) <= MVCC_INLINE_VALUE_LIMIT);
+    // the value is copied in and out with memcpy
+    BOOST_STATIC_ASSERT(boost::has_trivial_copy<value_t>::value);
+    mvcc_key mkey(key);
+    mvcc_inline_record<value_t>* record = mut_inline_record_ptr<memory_t, value_t>(memory_, mkey.c_str);
+    if (!record)
+    {
+	record = memory_.template construct< mvcc_inline_record<value_t> >(mkey.c_str)();
+	register_key(memory_, mkey, MVCC_INLINE_TYPE_ID, memory_.get_handle_from_address(record));
+    }
+    bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
+    mvcc_revision revision = mut_resource_pool_ref(memory_).global_revision.fetch_add(
+	    1, boost::memory_order_consume);
+    bpt::ptime timestamp = bpt::microsec_clock::universal_time();
+    boost::uint32_t next = record->current.load(boost::memory_order_relaxed) ^ 1;
+    mvcc_inline_slot<value_t>& slot = record->slots[next];
+    boost::uint32_t sequence = slot.sequence.load(boost::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+    memcpy(slot.value, &value, sizeof(value_t));
+    slot.revision = revision;
+    slot.timestamp = timestamp;
+    slot.sequence.store(sequence + 2, boost::memory_order_release);
+    record->want_removed.store(false, boost::memory_order_relaxed);
+    record->current.store(next, boost::memory_order_release);
+    append_change(memory_, mkey, revision, false);
+    mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
+	    last_write_timestamp.reset(timestamp);
+    mut_resource_pool_ref(memory_).writer_token_pool[token_id_].
+	    last_write_revision.reset(revision);
+}
+
+template <class memory_t>
+template <class value_t>
+void mvcc_writer_handle<memory_t>::remove_inline(const char* key)
+{
+    mvcc_key mkey(key);
+    mvcc_inline_record<value_t>* record = mut_inline_record_ptr<memory_t, value_t>(memory_, mkey.c_str);
     if (record)
     {
+	bip::scoped_lock<bip::interprocess_mutex> lock(mut_resource_pool_ref(memory_).journal.mutex);
 	record->want_removed = true;
+	append_change(memory_, mkey, mut_resource_pool_ref(memory_).global_revision.fetch_add(
+		1, boost::memory_order_consume), true);
     }
 }
 
@@ -627,12 +2191,19 @@ boost::uint64_t mvcc_writer_handle<memory_t>::get_last_write_revision() const
 #endif
 
 template <class memory_t>
-mvcc_owner_handle<memory_t>::mvcc_owner_handle(open_mode mode, memory_t& memory) :
-    memory_(memory)
+mvcc_owner_handle<memory_t>::mvcc_owner_handle(open_mode mode, memory_t& memory, reader_token_id reader_limit) :
+    memory_(memory),
+    resume_index_(0),
+    resume_key_()
 {
     if (mode == open_new)
     {
-	boost::function<void ()> init_func(boost::bind(&init<memory_t>, boost::ref(memory_)));
+	if (UNLIKELY_EXT(reader_limit == 0 || reader_limit > MVCC_READER_LIMIT))
+	{
+	    throw storage_error("Reader limit out of range")
+		    << info_component_identity("mvcc_memory");
+	}
+	boost::function<void ()> init_func(boost::bind(&init<memory_t>, boost::ref(memory_), reader_limit));
 	memory_.get_segment_manager()->atomic_func(init_func);
     }
     else
@@ -648,7 +2219,8 @@ mvcc_owner_handle<memory_t>::~mvcc_owner_handle()
 template <class memory_t>
 void mvcc_owner_handle<memory_t>::process_read_metadata(reader_token_id from, reader_token_id to)
 {
-    if (from >= MVCC_READER_LIMIT)
+    reader_token_id limit = const_header_ref(memory_).reader_limit;
+    if (from >= limit)
     {
 	return;
     }
@@ -664,8 +2236,16 @@ void mvcc_owner_handle<memory_t>::process_read_metadata(reader_token_id from, re
 	    pool.owner_token.oldest_timestamp_found.reset();
 	}
     }
-    for (reader_token_id iter = from; iter < MVCC_READER_LIMIT && iter < to; ++iter)
+    for (reader_token_id iter = from; iter < limit && iter < to; ++iter)
     {
+	// Whoever clears the pid first gives back the token of a process that exited while holding it
+	boost::int32_t pid = pool.reader_token_pool[iter].owner_pid.load(boost::memory_order_acquire);
+	if (pid && is_process_gone(pid) &&
+		pool.reader_token_pool[iter].owner_pid.compare_exchange_strong(pid, 0, boost::memory_order_acq_rel))
+	{
+	    clear_read(pool.reader_token_pool[iter]);
+	    pool.reader_token_pool[iter].reserved.store(false, boost::memory_order_release);
+	}
 	if ((!pool.owner_token.oldest_revision_found && pool.reader_token_pool[iter].last_read_revision) || 
 	    (pool.owner_token.oldest_revision_found && pool.reader_token_pool[iter].last_read_revision &&
 	    pool.reader_token_pool[iter].last_read_revision.get() < pool.owner_token.oldest_revision_found.get()))
@@ -678,17 +2258,9 @@ void mvcc_owner_handle<memory_t>::process_read_metadata(reader_token_id from, re
 }
 
 template <class memory_t>
-void mvcc_owner_handle<memory_t>::process_write_metadata(std::size_t max_attempts)
+void mvcc_owner_handle<memory_t>::process_write_metadata(std::size_t)
 {
-    mvcc_deleter<memory_t> deleter;
-    mvcc_resource_pool<memory_t>& pool = mut_resource_pool_ref(memory_);
-    for (std::size_t attempts = 0; !pool.deleter_list.empty() && (max_attempts == 0 || attempts < max_attempts); ++attempts)
-    {
-	if (pool.deleter_list.pop(deleter))
-	{
-	    pool.owner_token.registry.insert(std::make_pair(deleter.key, deleter));
-	}
-    }
+    // writers register new keys themselves so there is nothing left to drain
 }
 
 template <class memory_t>
@@ -701,29 +2273,182 @@ std::string mvcc_owner_handle<memory_t>::collect_garbage(std::size_t max_attempt
 template <class memory_t>
 std::string mvcc_owner_handle<memory_t>::collect_garbage(const std::string& from, std::size_t max_attempts)
 {
-    mvcc_resource_pool<memory_t>& pool = mut_resource_pool_ref(memory_);
-    if (pool.owner_token.registry.empty())
+    const mvcc_resource_pool<memory_t>& pool = const_resource_pool_ref(memory_);
+    std::size_t count = registered_count(memory_);
+    if (count == 0)
     {
 	return "";
     }
-    mvcc_key key(from.c_str());
-    typename mvcc_owner_token<memory_t>::registry_map::const_iterator iter = from.empty() ?
-	    pool.owner_token.registry.begin() :
-	    pool.owner_token.registry.find(key);
+    mvcc_type_table::snapshot_type trims;
+    mvcc_type_table::instance().snapshot(trims);
+    expire_keys(trims, max_attempts);
+    std::size_t index = from.empty() ? 0 : find_registered_index(from, count);
     if (pool.owner_token.oldest_revision_found)
     {
 	mvcc_revision oldest = pool.owner_token.oldest_revision_found.get();
-	for (std::size_t attempts = 0; iter != pool.owner_token.registry.end() && (max_attempts == 0 || attempts < max_attempts); ++attempts, ++iter)
+	for (std::size_t attempts = 0; index < count && (max_attempts == 0 || attempts < max_attempts); ++attempts, ++index)
 	{
-	    iter->second.function(memory_, iter->first.c_str, oldest);
+	    const mvcc_registry_entry<memory_t>* entry = const_registry_entry_ptr(memory_, index);
+	    if (LIKELY_EXT(entry != 0))
+	    {
+		trim_entry(memory_, *entry, trims, oldest);
+	    }
 	}
     }
-    if (iter == pool.owner_token.registry.end())
+    const mvcc_registry_entry<memory_t>* next = 0;
+    for (; index < count && !next; ++index)
+    {
+	next = const_registry_entry_ptr(memory_, index);
+    }
+    if (!next)
     {
 	// Next collect attempt should start again from beginning
-	iter = pool.owner_token.registry.begin();
+	for (index = 0; index < count && !next; ++index)
+	{
+	    next = const_registry_entry_ptr(memory_, index);
+	}
+    }
+    if (!next)
+    {
+	return "";
+    }
+    resume_index_ = index - 1;
+    resume_key_ = next->key.c_str;
+    return resume_key_;
+}
+
+template <class memory_t>
+void mvcc_owner_handle<memory_t>::collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts)
+{
+    const mvcc_resource_pool<memory_t>& pool = const_resource_pool_ref(memory_);
+    std::size_t count = registered_count(memory_);
+    if (count == 0)
+    {
+	return;
+    }
+    mvcc_type_table::snapshot_type trims;
+    mvcc_type_table::instance().snapshot(trims);
+    expire_keys(trims, max_attempts);
+    if (!pool.owner_token.oldest_revision_found)
+    {
+	return;
+    }
+    if (cursors.registry_size_ != count)
+    {
+	partition_registry(cursors, count);
+    }
+    // The threshold is read once here so every range is collected against the same revision
+    mvcc_revision oldest = pool.owner_token.oldest_revision_found.get();
+    cursors.run_on_ranges(boost::bind(&mvcc_owner_handle<memory_t>::collect_garbage_range,
+	    this, boost::ref(cursors), _1, oldest, boost::cref(trims), max_attempts));
+}
+
+template <class memory_t>
+template <class value_t>
+void mvcc_owner_handle<memory_t>::enroll_type()
+{
+    enrolled_type_id<value_t>();
+}
+
+template <class memory_t>
+void mvcc_owner_handle<memory_t>::expire_keys(const mvcc_type_table::snapshot_type& functions, std::size_t max_attempts)
+{
+    typedef mvcc_expiry_entry<memory_t> entry_type;
+    mvcc_expiry_index<memory_t>& expiry = mut_resource_pool_ref(memory_).expiry;
+    bpt::ptime now = bpt::microsec_clock::universal_time();
+    std::vector<entry_type> due;
+    std::vector<entry_type> unknown;
+    {
+	bip::scoped_lock<bip::interprocess_mutex> lock(expiry.mutex);
+	// entries of a type never enrolled here are set aside without counting as an attempt,
+	// so they can't hold back the ones behind them
+	std::size_t attempts = 0;
+	while (!expiry.heap.empty() && expiry.heap.front().deadline <= now &&
+		(max_attempts == 0 || attempts < max_attempts))
+	{
+	    std::pop_heap(expiry.heap.begin(), expiry.heap.end());
+	    if (LIKELY_EXT(find_type_functions(functions, expiry.heap.back().type_id) != 0))
+	    {
+		due.push_back(expiry.heap.back());
+		++attempts;
+	    }
+	    else
+	    {
+		unknown.push_back(expiry.heap.back());
+	    }
+	    expiry.heap.pop_back();
+	}
+	// kept for an owner process that has the type enrolled
+	for (typename std::vector<entry_type>::const_iterator iter = unknown.begin(); iter != unknown.end(); ++iter)
+	{
+	    expiry.heap.push_back(*iter);
+	    std::push_heap(expiry.heap.begin(), expiry.heap.end());
+	}
+    }
+    // each key is expired without holding the index, so writers aren't held up
+    for (typename std::vector<entry_type>::const_iterator iter = due.begin(); iter != due.end(); ++iter)
+    {
+	const mvcc_type_table::functions* entry_functions = find_type_functions(functions, iter->type_id);
+	mvcc_change_journal& journal = mut_resource_pool_ref(memory_).journal;
+	bip::scoped_lock<bip::interprocess_mutex> lock(journal.mutex);
+	if (entry_functions->expire(memory_.get_address_from_handle(iter->record), iter->revision))
+	{
+	    append_change(memory_, iter->key, mut_resource_pool_ref(memory_).global_revision.fetch_add(
+		    1, boost::memory_order_consume), true);
+	}
+    }
+}
+
+template <class memory_t>
+std::size_t mvcc_owner_handle<memory_t>::find_registered_index(const std::string& key, std::size_t count) const
+{
+    // Only the key returned by the previous collection is remembered, any other one starts
+    // the sweep over rather than searching the registry for it
+    if (resume_index_ < count && key == resume_key_)
+    {
+	return resume_index_;
+    }
+    return 0;
+}
+
+template <class memory_t>
+void mvcc_owner_handle<memory_t>::partition_registry(mvcc_gc_cursors& cursors, std::size_t count) const
+{
+    std::size_t range_count = std::min(cursors.worker_count_, count);
+    std::size_t range_size = count / range_count;
+    std::size_t remainder = count % range_count;
+    cursors.range_first_.clear();
+    for (std::size_t range = 0, first = 0; range < range_count; ++range)
+    {
+	cursors.range_first_.push_back(first);
+	first += range_size + (range < remainder ? 1 : 0);
+    }
+    // The ranges have shifted so every range starts over
+    cursors.resume_from_ = cursors.range_first_;
+    cursors.registry_size_ = count;
+}
+
+template <class memory_t>
+void mvcc_owner_handle<memory_t>::collect_garbage_range(mvcc_gc_cursors& cursors, std::size_t range, boost::uint64_t oldest,
+	const mvcc_type_table::snapshot_type& trims, std::size_t max_attempts)
+{
+    if (range >= cursors.range_first_.size())
+    {
+	// fewer keys than workers
+	return;
+    }
+    std::size_t first = cursors.range_first_[range];
+    std::size_t last = (range + 1 < cursors.range_first_.size()) ? cursors.range_first_[range + 1] : cursors.registry_size_;
+    std::size_t index = cursors.resume_from_[range];
+    for (std::size_t attempts = 0; index < last && (max_attempts == 0 || attempts < max_attempts); ++attempts, ++index)
+    {
+	const mvcc_registry_entry<memory_t>* entry = const_registry_entry_ptr(memory_, index);
+	if (LIKELY_EXT(entry != 0))
+	{
+	    trim_entry(memory_, *entry, trims, oldest);
+	}
     }
-    return iter->first.c_str;
+    cursors.resume_from_[range] = (index < last) ? index : first;
 }
 
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
@@ -741,15 +2466,30 @@ boost::uint64_t mvcc_owner_handle<memory_t>::get_global_oldest_revision_read() c
     }
 }
 
+template <class memory_t>
+std::size_t mvcc_owner_handle<memory_t>::get_pending_expiry_count() const
+{
+    mvcc_expiry_index<memory_t>& expiry = mut_resource_pool_ref(memory_).expiry;
+    bip::scoped_lock<bip::interprocess_mutex> lock(expiry.mutex);
+    return expiry.heap.size();
+}
+
 template <class memory_t>
 std::vector<std::string> mvcc_owner_handle<memory_t>::get_registered_keys() const
 {
-    const mvcc_resource_pool<memory_t>& pool = const_resource_pool_ref(memory_);
     std::vector<std::string> result;
-    for (typename mvcc_owner_token<memory_t>::registry_map::const_iterator iter = pool.owner_token.registry.begin(); iter != pool.owner_token.registry.end(); ++iter)
+    std::size_t count = registered_count(memory_);
+    for (std::size_t index = 0; index < count; ++index)
     {
-	result.push_back(iter->first.c_str);
+	const mvcc_registry_entry<memory_t>* entry = const_registry_entry_ptr(memory_, index);
+	if (entry)
+	{
+	    result.push_back(entry->key.c_str);
+	}
     }
+    // a key written with several types is registered once per type
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
     return result;
 }
 
@@ -758,36 +2498,4 @@ std::vector<std::string> mvcc_owner_handle<memory_t>::get_registered_keys() cons
 } // namespace storage
 } // namespace supernova
 
-namespace boost {
-
-namespace sst = supernova::storage;
-
-// FIXME: this is anti-generic but we don't have a better solution right now
-
-template <>
-struct has_trivial_destructor< sst::mvcc_deleter<bip::managed_mapped_file> >
-{
-    static const bool value = true;
-};
-
-template <>
-struct has_trivial_destructor< sst::mvcc_deleter<bip::managed_shared_memory> >
-{
-    static const bool value = true;
-};
-
-template <>
-struct has_trivial_assign< sst::mvcc_deleter<bip::managed_mapped_file> >
-{
-    static const bool value = true;
-};
-
-template <>
-struct has_trivial_assign< sst::mvcc_deleter<bip::managed_shared_memory> >
-{
-    static const bool value = true;
-};
-
-} // namespace boost
-
 #endif
@@ -0,0 +1,123 @@
+#ifndef SUPERNOVA_STORAGE_MVCC_SHARDED_HPP
+#define SUPERNOVA_STORAGE_MVCC_SHARDED_HPP
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <supernova/storage/about.hpp>
+#include "mvcc_memory.hpp"
+#include "mvcc_shm.hpp"
+
+namespace supernova {
+namespace storage {
+
+static const size_t MVCC_SHARD_LIMIT = 256;
+
+// Stable across processes and builds, unlike boost::hash
+std::size_t mvcc_shard_index(const char* key, std::size_t shard_count);
+
+// Each shard is an independent shared memory segment with its own resource pool,
+// so allocations, metadata processing and garbage collection don't contend across shards.
+// Revisions are only ordered within a shard.
+// The reads are the same whether the shards are opened by a reader or by the owner.
+template <class shard_t>
+class mvcc_sharded_base : private boost::noncopyable
+{
+public:
+    template <class element_t> bool exists(const char* key) const;
+    template <class element_t> const boost::optional<const element_t&> read(const char* key) const;
+    template <class element_t> std::size_t read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const;
+    template <class element_t> const boost::optional<const element_t&> read_at(const char* key, boost::uint64_t revision) const;
+    template <class element_t> const boost::optional<const element_t&> read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const;
+    template <class element_t> mvcc_history_iterator<element_t> history(const char* key) const;
+    template <class element_t> boost::optional<element_t> read_inline(const char* key) const;
+    std::size_t get_available_space() const;
+    std::size_t get_size() const;
+    reader_token_id get_reader_limit() const;
+    std::size_t get_shard_count() const;
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+    template <class element_t> boost::uint64_t get_oldest_revision(const char* key) const;
+    template <class element_t> boost::uint64_t get_newest_revision(const char* key) const;
+#endif
+protected:
+    mvcc_sharded_base();
+    ~mvcc_sharded_base();
+    const shard_t& shard_for(const char* key) const;
+    shard_t& shard_for(const char* key);
+    boost::ptr_vector<shard_t> shards_;
+};
+
+class mvcc_sharded_reader : public mvcc_sharded_base<mvcc_shm_reader>
+{
+public:
+    mvcc_sharded_reader(const std::string& name);
+    ~mvcc_sharded_reader();
+private:
+    const std::string name_;
+};
+
+class mvcc_sharded_owner : public mvcc_sharded_base<mvcc_shm_owner>
+{
+public:
+    mvcc_sharded_owner(const std::string& name, std::size_t shard_count, std::size_t shard_size, reader_token_id reader_limit = MVCC_READER_LIMIT);
+    ~mvcc_sharded_owner();
+    template <class element_t> void write(const char* key, const element_t& value);
+    template <class element_t> void write(const char* key, const element_t& value, const boost::posix_time::time_duration& ttl);
+    template <class element_t> void write_coalesced(const char* key, const element_t& value);
+    template <class element_t, class functor_t> void write_with(const char* key, functor_t functor);
+    template <class element_t> void remove(const char* key);
+    template <class element_t> bool write_if(const char* key, const element_t& value, boost::uint64_t expected_revision);
+    template <class element_t> bool remove_if(const char* key, boost::uint64_t expected_revision);
+    template <class element_t> void write_inline(const char* key, const element_t& value);
+    template <class element_t> void remove_inline(const char* key);
+    // Deprecated: writers register new keys themselves, so this does nothing and max_attempts is ignored
+    void process_write_metadata(std::size_t max_attempts = 0);
+    // The following run on every shard at once, on workers started with the owner,
+    // and must not be called from several threads at the same time
+    void process_read_metadata(reader_token_id from = 0, reader_token_id to = MVCC_READER_LIMIT);
+    // Each shard resumes from where its previous collection stopped
+    void collect_garbage(std::size_t max_attempts = 0);
+    template <class element_t> void enroll_type();
+    static void erase(const std::string& name);
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+    template <class element_t> std::size_t get_history_depth(const char* key) const;
+    std::vector<std::string> get_registered_keys() const;
+#endif
+private:
+    void start_workers();
+    void stop_workers();
+    void run_worker(std::size_t index);
+    void run_on_shards(const boost::function<void(std::size_t)>& task);
+    void process_read_metadata_task(std::size_t index, reader_token_id from, reader_token_id to);
+    void collect_garbage_task(std::size_t index, std::size_t max_attempts);
+    const std::string name_;
+    boost::interprocess::shared_memory_object manifest_shm_;
+    boost::interprocess::mapped_region manifest_region_;
+    std::vector<std::string> gc_cursors_;
+    // The calling thread runs the task on the first shard and a worker on each of the others
+    boost::mutex task_mutex_;
+    boost::condition_variable task_posted_;
+    boost::condition_variable task_done_;
+    boost::function<void(std::size_t)> task_;
+    std::size_t task_generation_;
+    std::size_t tasks_pending_;
+    bool stopping_;
+    std::vector<boost::exception_ptr> task_failures_;
+    boost::thread_group workers_;
+};
+
+} // namespace storage
+} // namespace supernova
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef SUPERNOVA_STORAGE_MVCC_SHARDED_HXX
+#define SUPERNOVA_STORAGE_MVCC_SHARDED_HXX
+
+#include <algorithm>
+#include "mvcc_sharded.hpp"
+#include "mvcc_shm.hxx"
+
+namespace supernova {
+namespace storage {
+
+template <class shard_t>
+mvcc_sharded_base<shard_t>::mvcc_sharded_base() :
+    shards_()
+{ }
+
+template <class shard_t>
+mvcc_sharded_base<shard_t>::~mvcc_sharded_base()
+{ }
+
+template <class shard_t>
+template <class element_t>
+bool mvcc_sharded_base<shard_t>::exists(const char* key) const
+{
+    return shard_for(key).template exists<element_t>(key);
+}
+
+template <class shard_t>
+template <class element_t>
+const boost::optional<const element_t&> mvcc_sharded_base<shard_t>::read(const char* key) const
+{
+    return shard_for(key).template read<element_t>(key);
+}
+
+template <class shard_t>
+template <class element_t>
+std::size_t mvcc_sharded_base<shard_t>::read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const
+{
+    // each shard gets one batch so its reader token is still only updated once
+    out.assign(keys.size(), boost::none);
+    std::vector<std::size_t> shard_indices(keys.size());
+    for (std::size_t index = 0; index < keys.size(); ++index)
+    {
+	shard_indices[index] = mvcc_shard_index(keys[index], shards_.size());
+    }
+    std::size_t found = 0;
+    std::vector<const char*> shard_keys;
+    std::vector<std::size_t> positions;
+    std::vector< boost::optional<const element_t&> > shard_out;
+    for (std::size_t shard = 0; shard < shards_.size(); ++shard)
+    {
+	shard_keys.clear();
+	positions.clear();
+	for (std::size_t index = 0; index < keys.size(); ++index)
+	{
+	    if (shard_indices[index] == shard)
+	    {
+		shard_keys.push_back(keys[index]);
+		positions.push_back(index);
+	    }
+	}
+	if (shard_keys.empty())
+	{
+	    continue;
+	}
+	found += shards_[shard].template read_many<element_t>(shard_keys, shard_out);
+	for (std::size_t index = 0; index < positions.size(); ++index)
+	{
+	    out[positions[index]] = shard_out[index];
+	}
+    }
+    return found;
+}
+
+template <class shard_t>
+template <class element_t>
+const boost::optional<const element_t&> mvcc_sharded_base<shard_t>::read_at(const char* key, boost::uint64_t revision) const
+{
+    return shard_for(key).template read_at<element_t>(key, revision);
+}
+
+template <class shard_t>
+template <class element_t>
+const boost::optional<const element_t&> mvcc_sharded_base<shard_t>::read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const
+{
+    return shard_for(key).template read_as_of<element_t>(key, timestamp);
+}
+
+template <class shard_t>
+template <class element_t>
+mvcc_history_iterator<element_t> mvcc_sharded_base<shard_t>::history(const char* key) const
+{
+    return shard_for(key).template history<element_t>(key);
+}
+
+template <class shard_t>
+template <class element_t>
+boost::optional<element_t> mvcc_sharded_base<shard_t>::read_inline(const char* key) const
+{
+    return shard_for(key).template read_inline<element_t>(key);
+}
+
+template <class shard_t>
+std::size_t mvcc_sharded_base<shard_t>::get_available_space() const
+{
+    std::size_t result = 0;
+    for (std::size_t index = 0; index < shards_.size(); ++index)
+    {
+	result += shards_[index].get_available_space();
+    }
+    return result;
+}
+
+template <class shard_t>
+std::size_t mvcc_sharded_base<shard_t>::get_size() const
+{
+    std::size_t result = 0;
+    for (std::size_t index = 0; index < shards_.size(); ++index)
+    {
+	result += shards_[index].get_size();
+    }
+    return result;
+}
+
+template <class shard_t>
+reader_token_id mvcc_sharded_base<shard_t>::get_reader_limit() const
+{
+    return shards_.front().get_reader_limit();
+}
+
+template <class shard_t>
+std::size_t mvcc_sharded_base<shard_t>::get_shard_count() const
+{
+    return shards_.size();
+}
+
+template <class shard_t>
+const shard_t& mvcc_sharded_base<shard_t>::shard_for(const char* key) const
+{
+    return shards_[mvcc_shard_index(key, shards_.size())];
+}
+
+template <class shard_t>
+shard_t& mvcc_sharded_base<shard_t>::shard_for(const char* key)
+{
+    return shards_[mvcc_shard_index(key, shards_.size())];
+}
+
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+
+template <class shard_t>
+template <class element_t>
+boost::uint64_t mvcc_sharded_base<shard_t>::get_oldest_revision(const char* key) const
+{
+    return shard_for(key).template get_oldest_revision<element_t>(key);
+}
+
+template <class shard_t>
+template <class element_t>
+boost::uint64_t mvcc_sharded_base<shard_t>::get_newest_revision(const char* key) const
+{
+    return shard_for(key).template get_newest_revision<element_t>(key);
+}
+
+#endif
+
+template <class element_t>
+void mvcc_sharded_owner::write(const char* key, const element_t& value)
+{
+    shard_for(key).template write<element_t>(key, value);
+}
+
+template <class element_t>
+void mvcc_sharded_owner::write(const char* key, const element_t& value, const boost::posix_time::time_duration& ttl)
+{
+    shard_for(key).template write<element_t>(key, value, ttl);
+}
+
+template <class element_t>
+void mvcc_sharded_owner::write_coalesced(const char* key, const element_t& value)
+{
+    shard_for(key).template write_coalesced<element_t>(key, value);
+}
+
+template <class element_t, class functor_t>
+void mvcc_sharded_owner::write_with(const char* key, functor_t functor)
+{
+    shard_for(key).template write_with<element_t>(key, functor);
+}
+
+template <class element_t>
+void mvcc_sharded_owner::remove(const char* key)
+{
+    shard_for(key).template remove<element_t>(key);
+}
+
+template <class element_t>
+bool mvcc_sharded_owner::write_if(const char* key, const element_t& value, boost::uint64_t expected_revision)
+{
+    return shard_for(key).template write_if<element_t>(key, value, expected_revision);
+}
+
+template <class element_t>
+bool mvcc_sharded_owner::remove_if(const char* key, boost::uint64_t expected_revision)
+{
+    return shard_for(key).template remove_if<element_t>(key, expected_revision);
+}
+
+template <class element_t>
+void mvcc_sharded_owner::write_inline(const char* key, const element_t& value)
+{
+    shard_for(key).template write_inline<element_t>(key, value);
+}
+
+template <class element_t>
+void mvcc_sharded_owner::remove_inline(const char* key)
+{
+    shard_for(key).template remove_inline<element_t>(key);
+}
+
+template <class element_t>
+void mvcc_sharded_owner::enroll_type()
+{
+    // the type table is per process so enrolling through any shard covers them all
+    shards_.front().template enroll_type<element_t>();
+}
+
+#ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
+
+template <class element_t>
+std::size_t mvcc_sharded_owner::get_history_depth(const char* key) const
+{
+    return shard_for(key).template get_history_depth<element_t>(key);
+}
+
+inline std::vector<std::string> mvcc_sharded_owner::get_registered_keys() const
+{
+    std::vector<std::string> result;
+    for (std::size_t shard = 0; shard < shards_.size(); ++shard)
+    {
+	std::vector<std::string> keys(shards_[shard].get_registered_keys());
+	result.insert(result.end(), keys.begin(), keys.end());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+#endif
+
+} // namespace storage
+} // namespace supernova
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <limits>
+#include <vector>
 #include <boost/cstdint.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
@@ -22,8 +23,16 @@ public:
     ~mvcc_shm_reader();
     template <class element_t> bool exists(const char* key) const;
     template <class element_t> const boost::optional<const element_t&> read(const char* key) const;
+    template <class element_t> std::size_t read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const;
+    template <class element_t> const boost::optional<const element_t&> read_at(const char* key, boost::uint64_t revision) const;
+    template <class element_t> const boost::optional<const element_t&> read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const;
+    template <class element_t> mvcc_history_iterator<element_t> history(const char* key) const;
+    template <class element_t> boost::optional<element_t> read_inline(const char* key) const;
+    bool changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const;
+    boost::uint64_t get_journal_revision() const;
     std::size_t get_available_space() const;
     std::size_t get_size() const;
+    reader_token_id get_reader_limit() const;
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
     reader_token_id get_reader_token_id() const;
     boost::uint64_t get_last_read_revision() const;
@@ -36,6 +45,21 @@ private:
     mvcc_reader_handle<boost::interprocess::managed_shared_memory> reader_handle_;
 };
 
+class mvcc_shm_reader_cache : private boost::noncopyable
+{
+public:
+    typedef mvcc_reader_handle<boost::interprocess::managed_shared_memory> reader_type;
+    mvcc_shm_reader_cache(const std::string& name, std::size_t batch_size = MVCC_READER_BATCH_SIZE);
+    ~mvcc_shm_reader_cache();
+    reader_type& get_thread_reader();
+    std::size_t get_reserved_count() const;
+    std::size_t get_idle_count() const;
+private:
+    const std::string name_;
+    boost::interprocess::managed_shared_memory share_;
+    mvcc_reader_token_cache<boost::interprocess::managed_shared_memory> token_cache_;
+};
+
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
 #include <vector>
 #endif
@@ -43,18 +67,37 @@ private:
 class mvcc_shm_owner : private boost::noncopyable
 {
 public:
-    mvcc_shm_owner(const std::string& name, std::size_t size);
+    mvcc_shm_owner(const std::string& name, std::size_t size, reader_token_id reader_limit = MVCC_READER_LIMIT);
     ~mvcc_shm_owner();
     template <class element_t> bool exists(const char* key) const;
     template <class element_t> const boost::optional<const element_t&> read(const char* key) const;
+    template <class element_t> std::size_t read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const;
+    template <class element_t> const boost::optional<const element_t&> read_at(const char* key, boost::uint64_t revision) const;
+    template <class element_t> const boost::optional<const element_t&> read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const;
+    template <class element_t> mvcc_history_iterator<element_t> history(const char* key) const;
+    template <class element_t> boost::optional<element_t> read_inline(const char* key) const;
+    bool changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const;
+    boost::uint64_t get_journal_revision() const;
     template <class element_t> void write(const char* key, const element_t& value);
+    template <class element_t> void write(const char* key, const element_t& value, const boost::posix_time::time_duration& ttl);
+    template <class element_t> void write_coalesced(const char* key, const element_t& value);
+    template <class element_t, class functor_t> void write_with(const char* key, functor_t functor);
+    template <class element_t, class iterator_t> std::size_t write_bulk(iterator_t first, iterator_t last);
     template <class element_t> void remove(const char* key);
+    template <class element_t> bool write_if(const char* key, const element_t& value, boost::uint64_t expected_revision);
+    template <class element_t> bool remove_if(const char* key, boost::uint64_t expected_revision);
+    template <class element_t> void write_inline(const char* key, const element_t& value);
+    template <class element_t> void remove_inline(const char* key);
     void process_read_metadata(reader_token_id from = 0, reader_token_id to = MVCC_READER_LIMIT);
+    // Deprecated: writers register new keys themselves, so this does nothing and max_attempts is ignored
     void process_write_metadata(std::size_t max_attempts = 0);
     std::string collect_garbage(std::size_t max_attempts = 0);
     std::string collect_garbage(const std::string& from, std::size_t max_attempts = 0);
+    void collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts = 0);
+    template <class element_t> void enroll_type();
     std::size_t get_available_space() const;
     std::size_t get_size() const;
+    reader_token_id get_reader_limit() const;
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
     reader_token_id get_reader_token_id() const;
     boost::uint64_t get_last_read_revision() const;
@@ -62,6 +105,7 @@ public:
     template <class element_t> boost::uint64_t get_newest_revision(const char* key) const;
     boost::uint64_t get_global_oldest_revision_read() const;
     std::vector<std::string> get_registered_keys() const;
+    std::size_t get_pending_expiry_count() const;
     template <class element_t> std::size_t get_history_depth(const char* key) const;
 #endif
 private:
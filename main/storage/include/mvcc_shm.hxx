@@ -19,6 +19,36 @@ const boost::optional<const element_t&> mvcc_shm_reader::read(const char* key) c
     return reader_handle_.template read<element_t>(key);
 }
 
+template <class element_t>
+std::size_t mvcc_shm_reader::read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const
+{
+    return reader_handle_.template read_many<element_t>(keys, out);
+}
+
+template <class element_t>
+const boost::optional<const element_t&> mvcc_shm_reader::read_at(const char* key, boost::uint64_t revision) const
+{
+    return reader_handle_.template read_at<element_t>(key, revision);
+}
+
+template <class element_t>
+const boost::optional<const element_t&> mvcc_shm_reader::read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const
+{
+    return reader_handle_.template read_as_of<element_t>(key, timestamp);
+}
+
+template <class element_t>
+mvcc_history_iterator<element_t> mvcc_shm_reader::history(const char* key) const
+{
+    return reader_handle_.template history<element_t>(key);
+}
+
+template <class element_t>
+boost::optional<element_t> mvcc_shm_reader::read_inline(const char* key) const
+{
+    return reader_handle_.template read_inline<element_t>(key);
+}
+
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
 
 reader_token_id mvcc_shm_reader::get_reader_token_id() const
@@ -57,18 +87,102 @@ const boost::optional<const element_t&> mvcc_shm_owner::read(const char* key) co
     return reader_handle_.template read<element_t>(key);
 }
 
+template <class element_t>
+std::size_t mvcc_shm_owner::read_many(const std::vector<const char*>& keys, std::vector< boost::optional<const element_t&> >& out) const
+{
+    return reader_handle_.template read_many<element_t>(keys, out);
+}
+
+template <class element_t>
+const boost::optional<const element_t&> mvcc_shm_owner::read_at(const char* key, boost::uint64_t revision) const
+{
+    return reader_handle_.template read_at<element_t>(key, revision);
+}
+
+template <class element_t>
+const boost::optional<const element_t&> mvcc_shm_owner::read_as_of(const char* key, const boost::posix_time::ptime& timestamp) const
+{
+    return reader_handle_.template read_as_of<element_t>(key, timestamp);
+}
+
+template <class element_t>
+mvcc_history_iterator<element_t> mvcc_shm_owner::history(const char* key) const
+{
+    return reader_handle_.template history<element_t>(key);
+}
+
+template <class element_t>
+boost::optional<element_t> mvcc_shm_owner::read_inline(const char* key) const
+{
+    return reader_handle_.template read_inline<element_t>(key);
+}
+
 template <class element_t>
 void mvcc_shm_owner::write(const char* key, const element_t& value)
 {
     writer_handle_.template write(key, value);
 }
 
+template <class element_t>
+void mvcc_shm_owner::write(const char* key, const element_t& value, const boost::posix_time::time_duration& ttl)
+{
+    writer_handle_.template write(key, value, ttl);
+}
+
+template <class element_t>
+void mvcc_shm_owner::write_coalesced(const char* key, const element_t& value)
+{
+    writer_handle_.template write_coalesced<element_t>(key, value);
+}
+
+template <class element_t, class functor_t>
+void mvcc_shm_owner::write_with(const char* key, functor_t functor)
+{
+    writer_handle_.template write_with<element_t>(key, functor);
+}
+
+template <class element_t, class iterator_t>
+std::size_t mvcc_shm_owner::write_bulk(iterator_t first, iterator_t last)
+{
+    return writer_handle_.template write_bulk<element_t>(first, last);
+}
+
 template <class element_t>
 void mvcc_shm_owner::remove(const char* key)
 {
     writer_handle_.template remove<element_t>(key);
 }
 
+template <class element_t>
+bool mvcc_shm_owner::write_if(const char* key, const element_t& value, boost::uint64_t expected_revision)
+{
+    return writer_handle_.template write_if<element_t>(key, value, expected_revision);
+}
+
+template <class element_t>
+bool mvcc_shm_owner::remove_if(const char* key, boost::uint64_t expected_revision)
+{
+    return writer_handle_.template remove_if<element_t>(key, expected_revision);
+}
+
+template <class element_t>
+void mvcc_shm_owner::write_inline(const char* key, const element_t& value)
+{
+    writer_handle_.template write_inline<element_t>(key, value);
+}
+
+template <class element_t>
+void mvcc_shm_owner::remove_inline(const char* key)
+{
+    writer_handle_.template remove_inline<element_t>(key);
+}
+
+template <class element_t>
+void mvcc_shm_owner::enroll_type()
+{
+    owner_handle_.template enroll_type<element_t>();
+}
+
 #ifdef SUPERNOVA_STORAGE_MVCCMEMORY_DEBUG
 
 reader_token_id mvcc_shm_owner::get_reader_token_id() const
@@ -103,6 +217,11 @@ std::vector<std::string> mvcc_shm_owner::get_registered_keys() const
     return owner_handle_.get_registered_keys();
 }
 
+std::size_t mvcc_shm_owner::get_pending_expiry_count() const
+{
+    return owner_handle_.get_pending_expiry_count();
+}
+
 template <class element_t> 
 std::size_t mvcc_shm_owner::get_history_depth(const char* key) const
 {
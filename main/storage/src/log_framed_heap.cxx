@@ -0,0 +1,82 @@
+#include "log_framed_heap.hpp"
+#include <boost/interprocess/anonymous_shared_memory.hpp>
+#include "mode.hpp"
+
+namespace bip = boost::interprocess;
+
+namespace supernova {
+namespace storage {
+
+log_framed_heap_reader::log_framed_heap_reader(const log_framed_heap_owner& owner) :
+    reader_handle_(owner.region_)
+{ }
+
+log_framed_heap_reader::~log_framed_heap_reader()
+{ }
+
+boost::optional<log_payload> log_framed_heap_reader::read(const log_index& index) const
+{
+    return reader_handle_.read(index);
+}
+
+boost::optional<log_index> log_framed_heap_reader::get_front_index() const
+{
+    return reader_handle_.get_front_index();
+}
+
+boost::optional<log_index> log_framed_heap_reader::get_back_index() const
+{
+    return reader_handle_.get_back_index();
+}
+
+log_index log_framed_heap_reader::get_max_index() const
+{
+    return reader_handle_.get_max_index();
+}
+
+std::size_t log_framed_heap_reader::get_free_size() const
+{
+    return reader_handle_.get_free_size();
+}
+
+log_framed_heap_owner::log_framed_heap_owner(std::size_t size, std::size_t average_size) :
+    region_(bip::anonymous_shared_memory(size)),
+    owner_handle_(open_new, region_, average_size),
+    reader_handle_(region_)
+{ }
+
+log_framed_heap_owner::~log_framed_heap_owner()
+{ }
+
+boost::optional<log_index> log_framed_heap_owner::append(const void* payload, std::size_t size)
+{
+    return owner_handle_.append(payload, size);
+}
+
+boost::optional<log_payload> log_framed_heap_owner::read(const log_index& index) const
+{
+    return reader_handle_.read(index);
+}
+
+boost::optional<log_index> log_framed_heap_owner::get_front_index() const
+{
+    return reader_handle_.get_front_index();
+}
+
+boost::optional<log_index> log_framed_heap_owner::get_back_index() const
+{
+    return reader_handle_.get_back_index();
+}
+
+log_index log_framed_heap_owner::get_max_index() const
+{
+    return reader_handle_.get_max_index();
+}
+
+std::size_t log_framed_heap_owner::get_free_size() const
+{
+    return reader_handle_.get_free_size();
+}
+
+} // namespace storage
+} // namespace supernova
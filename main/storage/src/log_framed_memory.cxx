@@ -0,0 +1,339 @@
+#include "log_framed_memory.hpp"
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <boost/atomic.hpp>
+#include <supernova/core/compiler_extensions.hpp>
+#include <supernova/storage/exception.hpp>
+
+namespace bip = boost::interprocess;
+
+namespace supernova {
+namespace storage {
+
+namespace {
+
+static const char* LOG_FRAMED_TYPE_TAG = "supernova::storage::log_framed_memory";
+
+struct log_framed_header
+{
+    log_framed_header(const version& ver, boost::uint64_t regsize, log_index maxidx, boost::uint64_t frmsize);
+    boost::uint16_t endianess_indicator;
+    char memory_type_tag[48];
+    version memory_version;
+    boost::uint16_t header_size;
+    boost::uint64_t region_size;
+    log_index max_index;
+    // The bytes after the side table, for the frames
+    boost::uint64_t frames_size;
+    // The number of indexes handed out to appends, which can run past max_index + 1 once full
+    boost::atomic<log_index> reserve_count;
+    // The bytes of the frames handed out to appends, which never runs past frames_size
+    boost::atomic<boost::uint64_t> reserve_size;
+    // Every index below it has its frame fully written
+    boost::atomic<log_index> commit_count __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
+} __attribute__((aligned(LEVEL1_DCACHE_LINESIZE)));
+
+log_framed_header::log_framed_header(const version& ver, boost::uint64_t regsize, log_index maxidx, boost::uint64_t frmsize) :
+    endianess_indicator(std::numeric_limits<boost::uint8_t>::max()),
+    memory_version(ver),
+    header_size(sizeof(log_framed_header)),
+    region_size(regsize),
+    max_index(maxidx),
+    frames_size(frmsize)
+{
+    strncpy(memory_type_tag, LOG_FRAMED_TYPE_TAG, sizeof(memory_type_tag));
+    reserve_count = 0U;
+    reserve_size = 0U;
+    commit_count = 0U;
+}
+
+// The payload starts 8 bytes into the frame, so it is aligned for anything up to 8 bytes
+struct log_frame
+{
+    boost::uint64_t size;
+    char payload[];
+};
+
+static const std::size_t LOG_FRAME_ALIGNMENT = sizeof(boost::uint64_t);
+
+// The payload size must be no more than the frames size, or the rounding up could wrap
+std::size_t get_frame_size(std::size_t payload_size)
+{
+    return sizeof(log_frame) + ((payload_size + LOG_FRAME_ALIGNMENT - 1) & ~(LOG_FRAME_ALIGNMENT - 1));
+}
+
+// The side table holds one offset marker per index, holding the offset plus one
+// of the frame of the index once it is fully written, and the frames follow it
+struct log_framed_container
+{
+    typedef boost::atomic<boost::uint64_t> marker_type;
+    log_framed_container(const version& ver, boost::uint64_t regsize, log_index slots);
+    static log_index get_slot_count(boost::uint64_t regsize, std::size_t average_size);
+    static std::size_t get_frames_offset(log_index slots);
+    inline char* get_frames();
+    inline const char* get_frames() const;
+    log_framed_header header;
+    marker_type offsets[];
+};
+
+log_framed_container::log_framed_container(const version& ver, boost::uint64_t regsize, log_index slots) :
+    header(ver, regsize, slots - 1, regsize - get_frames_offset(slots))
+{
+    for (log_index index = 0; index < slots; ++index)
+    {
+	new (&offsets[index]) marker_type(0U);
+    }
+}
+
+log_index log_framed_container::get_slot_count(boost::uint64_t regsize, std::size_t average_size)
+{
+    return (regsize - sizeof(log_framed_container)) / (sizeof(marker_type) + get_frame_size(average_size));
+}
+
+std::size_t log_framed_container::get_frames_offset(log_index slots)
+{
+    // The header is cache line aligned, so the frames start 8 byte aligned right after the markers
+    return sizeof(log_framed_container) + slots * sizeof(marker_type);
+}
+
+char* log_framed_container::get_frames()
+{
+    return reinterpret_cast<char*>(this) + get_frames_offset(header.max_index + 1);
+}
+
+const char* log_framed_container::get_frames() const
+{
+    return reinterpret_cast<const char*>(this) + get_frames_offset(header.max_index + 1);
+}
+
+void check(const bip::mapped_region& region)
+{
+    const log_framed_container* container = static_cast<const log_framed_container*>(region.get_address());
+    if (UNLIKELY_EXT(!container))
+    {
+	throw malformed_db_error("Could not find log container")
+		<< info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(container->header.endianess_indicator != std::numeric_limits<boost::uint8_t>::max()))
+    {
+        throw unsupported_db_error("Memory requires byte swapping")
+                << info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(strncmp(
+	    container->header.memory_type_tag,
+	    LOG_FRAMED_TYPE_TAG,
+	    sizeof(container->header.memory_type_tag))))
+    {
+        throw malformed_db_error("Incorrect memory type tag found")
+                << info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(container->header.memory_version < LOG_FRAMED_MIN_SUPPORTED_VERSION ||
+            container->header.memory_version > LOG_FRAMED_MAX_SUPPORTED_VERSION))
+    {
+        throw unsupported_db_error("Unsuported memory version")
+                << info_component_identity("log_framed_memory")
+                << info_version_found(container->header.memory_version)
+                << info_min_supported_version(LOG_FRAMED_MIN_SUPPORTED_VERSION)
+                << info_max_supported_version(LOG_FRAMED_MAX_SUPPORTED_VERSION);
+    }
+    if (UNLIKELY_EXT(sizeof(log_framed_header) != container->header.header_size))
+    {
+        throw malformed_db_error("Wrong header size")
+                << info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(region.get_size() != container->header.region_size))
+    {
+        throw malformed_db_error("Wrong region size")
+                << info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(container->header.max_index >= log_framed_container::get_slot_count(region.get_size(), 0U) ||
+	    region.get_size() - log_framed_container::get_frames_offset(container->header.max_index + 1) !=
+		    container->header.frames_size))
+    {
+        throw malformed_db_error("Side table does not fit the region")
+                << info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(container->header.reserve_size.load(boost::memory_order_acquire) > container->header.frames_size))
+    {
+        throw malformed_db_error("Reserved size is greater than the frames size")
+                << info_component_identity("log_framed_memory");
+    }
+    if (UNLIKELY_EXT(container->header.commit_count.load(boost::memory_order_acquire) > container->header.max_index + 1))
+    {
+        throw malformed_db_error("Commit count is greater than the number of slots")
+                << info_component_identity("log_framed_memory");
+    }
+}
+
+void init_log(bip::mapped_region& region, std::size_t average_size)
+{
+    void* base = region.get_address();
+    if (UNLIKELY_EXT(!base))
+    {
+	throw malformed_db_error("Could not find log container")
+		<< info_component_identity("log_framed_memory");
+    }
+    std::size_t region_size = region.get_size();
+    if (UNLIKELY_EXT(region_size < sizeof(log_framed_container) || average_size > region_size ||
+	    !log_framed_container::get_slot_count(region_size, average_size)))
+    {
+        throw malformed_db_error("Region size is too small")
+                << info_component_identity("log_framed_memory");
+    }
+    new (base) log_framed_container(
+	    LOG_FRAMED_MAX_SUPPORTED_VERSION,
+	    region_size,
+	    log_framed_container::get_slot_count(region_size, average_size));
+}
+
+// Frames are written out of order, so whichever producer publishes
+// the frame at the commit count carries it over the run already published
+void advance_commit(log_framed_container* container)
+{
+    log_index slots = container->header.max_index + 1;
+    log_index committed = container->header.commit_count.load(boost::memory_order_acquire);
+    while (committed < slots && container->offsets[committed].load(boost::memory_order_acquire))
+    {
+	log_index published = committed + 1;
+	while (published < slots && container->offsets[published].load(boost::memory_order_acquire))
+	{
+	    ++published;
+	}
+	if (container->header.commit_count.compare_exchange_weak(committed, published,
+		boost::memory_order_acq_rel, boost::memory_order_acquire))
+	{
+	    committed = published;
+	}
+    }
+}
+
+} // anonymous namespace
+
+log_framed_reader_handle::log_framed_reader_handle(const bip::mapped_region& region) :
+    region_(region)
+{
+    check(region_);
+}
+
+log_framed_reader_handle::~log_framed_reader_handle()
+{ }
+
+boost::optional<log_payload> log_framed_reader_handle::read(const log_index& index) const
+{
+    boost::optional<log_payload> result;
+    const log_framed_container* container = static_cast<const log_framed_container*>(region_.get_address());
+    assert(container);
+    if (LIKELY_EXT(index <= container->header.max_index))
+    {
+	boost::uint64_t marker = container->offsets[index].load(boost::memory_order_acquire);
+	boost::uint64_t frames_size = container->header.frames_size;
+	// The marker and the frame size are checked against the frames, as the memory may be shared
+	// with a process that wrote them wrongly
+	if (marker && marker - 1 <= frames_size - sizeof(log_frame))
+	{
+	    const log_frame* frame = reinterpret_cast<const log_frame*>(container->get_frames() + marker - 1);
+	    boost::uint64_t size = frame->size;
+	    if (LIKELY_EXT(size <= frames_size - sizeof(log_frame) - (marker - 1)))
+	    {
+		result = log_payload(frame->payload, frame->payload + size);
+	    }
+	}
+    }
+    return result;
+}
+
+boost::optional<log_index> log_framed_reader_handle::get_front_index() const
+{
+    const log_framed_container* container = static_cast<const log_framed_container*>(region_.get_address());
+    assert(container);
+    boost::optional<log_index> result;
+    if (container->header.commit_count.load(boost::memory_order_acquire))
+    {
+	result = 0U;
+    }
+    return result;
+}
+
+boost::optional<log_index> log_framed_reader_handle::get_back_index() const
+{
+    const log_framed_container* container = static_cast<const log_framed_container*>(region_.get_address());
+    assert(container);
+    boost::optional<log_index> result;
+    log_index committed = container->header.commit_count.load(boost::memory_order_acquire);
+    if (committed)
+    {
+	result = committed - 1;
+    }
+    return result;
+}
+
+log_index log_framed_reader_handle::get_max_index() const
+{
+    const log_framed_container* container = static_cast<const log_framed_container*>(region_.get_address());
+    assert(container);
+    return container->header.max_index;
+}
+
+std::size_t log_framed_reader_handle::get_free_size() const
+{
+    const log_framed_container* container = static_cast<const log_framed_container*>(region_.get_address());
+    assert(container);
+    return container->header.frames_size - container->header.reserve_size.load(boost::memory_order_relaxed);
+}
+
+log_framed_owner_handle::log_framed_owner_handle(open_mode mode, bip::mapped_region& region, std::size_t average_size) :
+    region_(region)
+{
+    if (mode == open_new)
+    {
+	init_log(region_, average_size);
+    }
+    else
+    {
+	check(region_);
+    }
+}
+
+log_framed_owner_handle::~log_framed_owner_handle()
+{ }
+
+boost::optional<log_index> log_framed_owner_handle::append(const void* payload, std::size_t size)
+{
+    log_framed_container* container = static_cast<log_framed_container*>(region_.get_address());
+    assert(container);
+    boost::optional<log_index> result;
+    // A payload larger than all the frames is turned down before its frame size can wrap
+    if (LIKELY_EXT(size <= container->header.frames_size &&
+	    container->header.reserve_count.load(boost::memory_order_relaxed) <= container->header.max_index))
+    {
+	boost::uint64_t frame_size = get_frame_size(size);
+	// The bytes are taken before the index: bytes left without an index are only wasted,
+	// while an index left without a frame would hold the commit count back for good
+	boost::uint64_t offset = container->header.reserve_size.load(boost::memory_order_relaxed);
+	bool reserved = false;
+	while (!reserved && offset + frame_size <= container->header.frames_size)
+	{
+	    reserved = container->header.reserve_size.compare_exchange_weak(offset, offset + frame_size,
+		    boost::memory_order_relaxed, boost::memory_order_relaxed);
+	}
+	if (reserved)
+	{
+	    log_index index = container->header.reserve_count.fetch_add(1, boost::memory_order_relaxed);
+	    if (LIKELY_EXT(index <= container->header.max_index))
+	    {
+		log_frame* frame = reinterpret_cast<log_frame*>(container->get_frames() + offset);
+		frame->size = size;
+		memcpy(frame->payload, payload, size);
+		container->offsets[index].store(offset + 1, boost::memory_order_release);
+		advance_commit(container);
+		result = index;
+	    }
+	}
+    }
+    return result;
+}
+
+} // namespace storage
+} // namespace supernova
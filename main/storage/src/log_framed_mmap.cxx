@@ -0,0 +1,118 @@
+#include "log_framed_mmap.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <supernova/storage/exception.hpp>
+#include "mode.hpp"
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+
+namespace supernova {
+namespace storage {
+
+// Shared with log_mmap
+const bfs::path& init_file(const bfs::path& path, std::size_t size);
+
+log_framed_mmap_reader::log_framed_mmap_reader(const bfs::path& path)
+try :
+    file_(path.string().c_str(), bip::read_only),
+    region_(file_, bip::read_only, 0U, bfs::file_size(path)),
+    reader_handle_(region_)
+{
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(path.string());
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(path.string());
+    throw err;
+}
+
+log_framed_mmap_reader::~log_framed_mmap_reader()
+{ }
+
+boost::optional<log_payload> log_framed_mmap_reader::read(const log_index& index) const
+{
+    return reader_handle_.read(index);
+}
+
+boost::optional<log_index> log_framed_mmap_reader::get_front_index() const
+{
+    return reader_handle_.get_front_index();
+}
+
+boost::optional<log_index> log_framed_mmap_reader::get_back_index() const
+{
+    return reader_handle_.get_back_index();
+}
+
+log_index log_framed_mmap_reader::get_max_index() const
+{
+    return reader_handle_.get_max_index();
+}
+
+std::size_t log_framed_mmap_reader::get_free_size() const
+{
+    return reader_handle_.get_free_size();
+}
+
+log_framed_mmap_owner::log_framed_mmap_owner(const bfs::path& path, std::size_t size, std::size_t average_size)
+try :
+    exists_(bfs::exists(path)),
+    flock_(init_file(path, size).string().c_str()),
+    slock_(flock_),
+    file_(path.string().c_str(), bip::read_write),
+    region_(file_, bip::read_write, 0U, bfs::file_size(path)),
+    owner_handle_(exists_ ? open_existing : open_new, region_, average_size),
+    reader_handle_(region_)
+{
+    region_.flush();
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(path.string());
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(path.string());
+    throw err;
+}
+
+log_framed_mmap_owner::~log_framed_mmap_owner()
+{ }
+
+boost::optional<log_index> log_framed_mmap_owner::append(const void* payload, std::size_t size)
+{
+    return owner_handle_.append(payload, size);
+}
+
+boost::optional<log_payload> log_framed_mmap_owner::read(const log_index& index) const
+{
+    return reader_handle_.read(index);
+}
+
+boost::optional<log_index> log_framed_mmap_owner::get_front_index() const
+{
+    return reader_handle_.get_front_index();
+}
+
+boost::optional<log_index> log_framed_mmap_owner::get_back_index() const
+{
+    return reader_handle_.get_back_index();
+}
+
+log_index log_framed_mmap_owner::get_max_index() const
+{
+    return reader_handle_.get_max_index();
+}
+
+std::size_t log_framed_mmap_owner::get_free_size() const
+{
+    return reader_handle_.get_free_size();
+}
+
+} // namespace storage
+} // namespace supernova
@@ -1,7 +1,15 @@
 #include "log_memory.hpp"
 #include "log_memory.hxx"
+#include <cerrno>
+#include <climits>
+#include <csignal>
 #include <cstring>
+#include <ctime>
 #include <limits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <boost/static_assert.hpp>
 #include <supernova/core/compiler_extensions.hpp>
 
 namespace supernova {
@@ -9,20 +17,186 @@ namespace storage {
 
 const char* LOG_TYPE_TAG = "supernova::storage::log_memory";
 
-log_header::log_header(const version& ver, boost::uint64_t regsize, log_index maxidx) :
+log_header::log_header(const version& ver, boost::uint64_t regsize, log_index maxidx, log_overflow ovf) :
     endianess_indicator(std::numeric_limits<boost::uint8_t>::max()),
     memory_version(ver),
     header_size(sizeof(log_header)),
     region_size(regsize),
-    max_index(maxidx)
+    max_index(maxidx),
+    overflow(static_cast<boost::uint8_t>(ovf))
 {
     strncpy(memory_type_tag, LOG_TYPE_TAG, sizeof(memory_type_tag));
-    back_index = get_null_index();
+    reserve_count = 0U;
+    commit_count = 0U;
+    waiter_count = 0U;
+    wake_sequence = 0U;
+    front_index = 0U;
+    checkpoint_table.init();
 }
 
-log_index log_header::get_null_index() const
+log_index log_header::get_committed_count() const
 {
-    return max_index + 1;
+    return commit_count.load(boost::memory_order_acquire);
+}
+
+namespace {
+
+static const boost::uint64_t TRUNCATION_COUNT_MASK = 0xFFFFFFFFU;
+// The number of yields between two checks on the process truncating
+static const std::size_t TRUNCATION_CHECK_INTERVAL = 256;
+
+boost::int32_t get_truncating_pid(boost::uint64_t marker)
+{
+    return static_cast<boost::int32_t>(marker >> 32);
+}
+
+bool is_process_gone(boost::int32_t pid)
+{
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+} // anonymous namespace
+
+void log_checkpoint_table::init()
+{
+    truncation_marker = 0U;
+    for (std::size_t id = 0; id < LOG_CHECKPOINT_LIMIT; ++id)
+    {
+	checkpoints[id] = 0U;
+	owner_pids[id] = 0;
+    }
+}
+
+boost::optional<std::size_t> log_checkpoint_table::claim(log_index index)
+{
+    boost::optional<std::size_t> result;
+    for (std::size_t id = 0; !result && id < LOG_CHECKPOINT_LIMIT; ++id)
+    {
+	log_index expected = 0U;
+	if (checkpoints[id].compare_exchange_strong(expected, index + 1, boost::memory_order_seq_cst))
+	{
+	    owner_pids[id].store(getpid(), boost::memory_order_release);
+	    result = id;
+	}
+    }
+    return result;
+}
+
+void log_checkpoint_table::move(std::size_t id, log_index index)
+{
+    // Releases the reads of the entries below the index to the owner truncating them
+    checkpoints[id].store(index + 1, boost::memory_order_seq_cst);
+}
+
+void log_checkpoint_table::release(std::size_t id)
+{
+    owner_pids[id].store(0, boost::memory_order_relaxed);
+    checkpoints[id].store(0U, boost::memory_order_release);
+}
+
+void log_checkpoint_table::begin_truncation()
+{
+    boost::int32_t pid = getpid();
+    boost::uint64_t marker = truncation_marker.load(boost::memory_order_seq_cst);
+    bool begun = false;
+    while (!begun)
+    {
+	boost::uint64_t count = marker & TRUNCATION_COUNT_MASK;
+	boost::int32_t holder = get_truncating_pid(marker);
+	// Truncations of the same process share the marker, and one left by a process gone is taken over
+	if (!count || holder == pid || is_process_gone(holder))
+	{
+	    boost::uint64_t next = (static_cast<boost::uint64_t>(static_cast<boost::uint32_t>(pid)) << 32) |
+		    (holder == pid ? count + 1 : 1U);
+	    begun = truncation_marker.compare_exchange_weak(marker, next, boost::memory_order_seq_cst);
+	}
+	else
+	{
+	    boost::this_thread::yield();
+	    marker = truncation_marker.load(boost::memory_order_seq_cst);
+	}
+    }
+}
+
+void log_checkpoint_table::end_truncation()
+{
+    truncation_marker.fetch_sub(1, boost::memory_order_seq_cst);
+}
+
+bool log_checkpoint_table::wait_for_truncations()
+{
+    // Truncations only read the checkpoints and move the front, so this rarely waits for long
+    boost::posix_time::ptime deadline;
+    boost::uint64_t marker = truncation_marker.load(boost::memory_order_seq_cst);
+    bool expired = false;
+    for (std::size_t spins = 1; !expired && (marker & TRUNCATION_COUNT_MASK); ++spins)
+    {
+	if (spins % TRUNCATION_CHECK_INTERVAL == 0)
+	{
+	    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	    if (is_process_gone(get_truncating_pid(marker)))
+	    {
+		// Fails when the marker moved on, which the next load sees
+		truncation_marker.compare_exchange_strong(marker, 0U, boost::memory_order_seq_cst);
+	    }
+	    else if (deadline.is_not_a_date_time())
+	    {
+		deadline = now + boost::posix_time::milliseconds(LOG_TRUNCATION_WAIT_LIMIT);
+	    }
+	    else
+	    {
+		expired = now > deadline;
+	    }
+	}
+	else
+	{
+	    boost::this_thread::yield();
+	}
+	marker = truncation_marker.load(boost::memory_order_seq_cst);
+    }
+    return !(marker & TRUNCATION_COUNT_MASK);
+}
+
+log_index log_checkpoint_table::get_lowest(log_index bound)
+{
+    log_index result = bound;
+    for (std::size_t id = 0; id < LOG_CHECKPOINT_LIMIT; ++id)
+    {
+	log_index checkpoint = checkpoints[id].load(boost::memory_order_seq_cst);
+	boost::int32_t pid = checkpoint ? owner_pids[id].load(boost::memory_order_acquire) : 0;
+	// Whoever clears the pid first releases the checkpoint, which nothing else can take until then
+	if (pid && is_process_gone(pid) &&
+		owner_pids[id].compare_exchange_strong(pid, 0, boost::memory_order_acq_rel))
+	{
+	    checkpoints[id].store(0U, boost::memory_order_release);
+	}
+	else if (checkpoint && checkpoint - 1 < result)
+	{
+	    result = checkpoint - 1;
+	}
+    }
+    return result;
+}
+
+// The futex calls take the address of the word inside the atomic
+BOOST_STATIC_ASSERT(sizeof(boost::atomic<boost::uint32_t>) == sizeof(boost::uint32_t));
+
+// The futexes are not private ones, as the producers and the waiters may be in different processes
+// and have the log mapped at different addresses
+void wait_log_futex(boost::atomic<boost::uint32_t>& word, boost::uint32_t value, const boost::posix_time::time_duration& timeout)
+{
+    timespec relative;
+    boost::int64_t microseconds = timeout.is_pos_infinity() ? 0 : timeout.total_microseconds();
+    relative.tv_sec = microseconds / 1000000;
+    relative.tv_nsec = (microseconds % 1000000) * 1000;
+    // Returns straight away when the word no longer holds the value, and on signals or spurious wake ups
+    syscall(SYS_futex, reinterpret_cast<boost::uint32_t*>(&word), FUTEX_WAIT, value,
+	    timeout.is_pos_infinity() ? 0 : &relative, 0, 0);
+}
+
+void wake_log_futex(boost::atomic<boost::uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<boost::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, 0, 0, 0);
 }
 
 } // namespace storage
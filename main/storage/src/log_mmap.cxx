@@ -1,7 +1,9 @@
 #include "log_mmap.hxx"
 #include <fstream>
+#include <boost/interprocess/exceptions.hpp>
 
 namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
 
 namespace supernova {
 namespace storage {
@@ -21,5 +23,23 @@ const bfs::path& init_file(const bfs::path& path, std::size_t size)
     return path;
 }
 
+bip::mode_t open_log_file(bip::file_mapping& file, const bfs::path& path)
+{
+    bip::mode_t mode = bip::read_write;
+    try
+    {
+	bip::file_mapping writable(path.string().c_str(), bip::read_write);
+	file.swap(writable);
+    }
+    catch (bip::interprocess_exception&)
+    {
+	// fails the same way again if it was not for the lack of write access
+	bip::file_mapping readable(path.string().c_str(), bip::read_only);
+	file.swap(readable);
+	mode = bip::read_only;
+    }
+    return mode;
+}
+
 } // namespace storage
 } // namespace supernova
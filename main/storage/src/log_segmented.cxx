@@ -0,0 +1,141 @@
+#include "log_segmented.hpp"
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+#include <boost/date_time/gregorian/gregorian_types.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+#include <supernova/core/compiler_extensions.hpp>
+#include <supernova/storage/exception.hpp>
+#include "log_segmented.hxx"
+
+namespace bfs = boost::filesystem;
+namespace bpt = boost::posix_time;
+
+namespace supernova {
+namespace storage {
+
+namespace {
+
+static const char* LOG_SEGMENTED_FILE_TYPE_TAG = "supernova::storage::log_segmented";
+
+void init_manifest(log_segment_manifest* manifest, std::size_t segment_size)
+{
+    manifest->endianess_indicator = std::numeric_limits<boost::uint8_t>::max();
+    strncpy(manifest->file_type_tag, LOG_SEGMENTED_FILE_TYPE_TAG, sizeof(manifest->file_type_tag));
+    manifest->memory_version = LOG_MAX_SUPPORTED_VERSION;
+    manifest->manifest_size = sizeof(log_segment_manifest);
+    manifest->segment_size = segment_size;
+    manifest->segment_capacity = 0U;
+    manifest->front_sequence = 0U;
+    manifest->back_sequence = 0U;
+    manifest->front_index = 0U;
+    manifest->checkpoint_table.init();
+}
+
+} // anonymous namespace
+
+log_retention::log_retention() :
+    max_count(0U),
+    max_age(bpt::not_a_date_time),
+    max_size(0U)
+{ }
+
+log_retention& log_retention::keep_count(std::size_t count)
+{
+    max_count = count;
+    return *this;
+}
+
+log_retention& log_retention::keep_age(const bpt::time_duration& age)
+{
+    max_age = age;
+    return *this;
+}
+
+log_retention& log_retention::keep_size(boost::uint64_t size)
+{
+    max_size = size;
+    return *this;
+}
+
+bfs::path init_segment_directory(const bfs::path& path, std::size_t segment_size)
+{
+    bfs::create_directories(path);
+    bfs::path manifest_path(path / "manifest");
+    if (!bfs::exists(manifest_path))
+    {
+	// Written in full before being renamed into place, so no reader ever maps half a manifest
+	bfs::path draft_path(path / "manifest.draft");
+	std::vector<char> buffer(sizeof(log_segment_manifest), '\0');
+	log_segment_manifest* manifest = reinterpret_cast<log_segment_manifest*>(&buffer[0]);
+	init_manifest(manifest, segment_size);
+	{
+	    std::filebuf fbuf;
+	    fbuf.open(draft_path.string().c_str(),
+		    std::ios_base::out |
+		    std::ios_base::trunc |
+		    std::ios_base::binary);
+	    fbuf.sputn(&buffer[0], buffer.size());
+	}
+	bfs::rename(draft_path, manifest_path);
+    }
+    return manifest_path;
+}
+
+void check_segment_manifest(const log_segment_manifest* manifest, std::size_t region_size)
+{
+    if (UNLIKELY_EXT(!manifest || region_size < sizeof(log_segment_manifest)))
+    {
+	throw malformed_db_error("Manifest is truncated")
+		<< info_component_identity("log_segmented");
+    }
+    // If endianess is different the indicator will be 65280 instead of 255
+    if (UNLIKELY_EXT(manifest->endianess_indicator != std::numeric_limits<boost::uint8_t>::max()))
+    {
+	throw unsupported_db_error("Memory requires byte swapping")
+		<< info_component_identity("log_segmented")
+		<< info_version_found(manifest->memory_version);
+    }
+    if (UNLIKELY_EXT(strncmp(manifest->file_type_tag, LOG_SEGMENTED_FILE_TYPE_TAG, sizeof(manifest->file_type_tag))))
+    {
+	throw malformed_db_error("Incorrect file type tag found")
+		<< info_component_identity("log_segmented");
+    }
+    if (UNLIKELY_EXT(manifest->memory_version < LOG_MIN_SUPPORTED_VERSION ||
+	    manifest->memory_version > LOG_MAX_SUPPORTED_VERSION))
+    {
+	throw unsupported_db_error("Unsuported memory version")
+		<< info_component_identity("log_segmented")
+		<< info_version_found(manifest->memory_version)
+		<< info_min_supported_version(LOG_MIN_SUPPORTED_VERSION)
+		<< info_max_supported_version(LOG_MAX_SUPPORTED_VERSION);
+    }
+    if (UNLIKELY_EXT(sizeof(log_segment_manifest) != manifest->manifest_size))
+    {
+	throw malformed_db_error("Wrong manifest size")
+		<< info_component_identity("log_segmented");
+    }
+    if (UNLIKELY_EXT(manifest->front_sequence.load(boost::memory_order_acquire) >
+	    manifest->back_sequence.load(boost::memory_order_acquire)))
+    {
+	throw malformed_db_error("Front segment is newer than back segment")
+		<< info_component_identity("log_segmented");
+    }
+}
+
+bfs::path segment_path(const bfs::path& path, boost::uint64_t sequence)
+{
+    return path / str(boost::format("segment.%1%") % sequence);
+}
+
+boost::int64_t get_segment_clock()
+{
+    static const bpt::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return (bpt::microsec_clock::universal_time() - epoch).total_microseconds();
+}
+
+} // namespace storage
+} // namespace supernova
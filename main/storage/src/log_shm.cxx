@@ -1,4 +1,5 @@
 #include "log_shm.hxx"
+#include <boost/interprocess/exceptions.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 
 namespace bip = boost::interprocess;
@@ -12,5 +13,23 @@ bip::shared_memory_object& init_shared_memory(bip::shared_memory_object& shm, st
     return shm;
 }
 
+bip::mode_t open_log_shared_memory(bip::shared_memory_object& shm, const std::string& name)
+{
+    bip::mode_t mode = bip::read_write;
+    try
+    {
+	bip::shared_memory_object writable(bip::open_only, name.c_str(), bip::read_write);
+	shm.swap(writable);
+    }
+    catch (bip::interprocess_exception&)
+    {
+	// fails the same way again if it was not for the lack of write access
+	bip::shared_memory_object readable(bip::open_only, name.c_str(), bip::read_only);
+	shm.swap(readable);
+	mode = bip::read_only;
+    }
+    return mode;
+}
+
 } // namespace storage
 } // namespace supernova
@@ -0,0 +1,100 @@
+#include "mvcc_heap.hpp"
+#include "mvcc_heap.hxx"
+
+namespace supernova {
+namespace storage {
+
+mvcc_heap_reader::mvcc_heap_reader(mvcc_heap_owner& owner) :
+    reader_handle_(owner.heap_)
+{ }
+
+mvcc_heap_reader::~mvcc_heap_reader()
+{ }
+
+bool mvcc_heap_reader::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    return reader_handle_.changes_since(revision, out);
+}
+
+boost::uint64_t mvcc_heap_reader::get_journal_revision() const
+{
+    return reader_handle_.get_journal_revision();
+}
+
+std::size_t mvcc_heap_reader::get_available_space() const
+{
+    return reader_handle_.get_available_space();
+}
+
+std::size_t mvcc_heap_reader::get_size() const
+{
+    return reader_handle_.get_size();
+}
+
+reader_token_id mvcc_heap_reader::get_reader_limit() const
+{
+    return reader_handle_.get_reader_limit();
+}
+
+mvcc_heap_owner::mvcc_heap_owner(std::size_t size, reader_token_id reader_limit) :
+    heap_(size),
+    owner_handle_(open_new, heap_, reader_limit),
+    writer_handle_(heap_),
+    reader_handle_(heap_)
+{ }
+
+mvcc_heap_owner::~mvcc_heap_owner()
+{ }
+
+void mvcc_heap_owner::process_read_metadata(reader_token_id from, reader_token_id to)
+{
+    return owner_handle_.process_read_metadata(from, to);
+}
+
+void mvcc_heap_owner::process_write_metadata(std::size_t max_attempts)
+{
+    return owner_handle_.process_write_metadata(max_attempts);
+}
+
+std::string mvcc_heap_owner::collect_garbage(std::size_t max_attempts)
+{
+    return owner_handle_.collect_garbage(max_attempts);
+}
+
+std::string mvcc_heap_owner::collect_garbage(const std::string& from, std::size_t max_attempts)
+{
+    return owner_handle_.collect_garbage(from, max_attempts);
+}
+
+void mvcc_heap_owner::collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts)
+{
+    owner_handle_.collect_garbage(cursors, max_attempts);
+}
+
+bool mvcc_heap_owner::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    return reader_handle_.changes_since(revision, out);
+}
+
+boost::uint64_t mvcc_heap_owner::get_journal_revision() const
+{
+    return reader_handle_.get_journal_revision();
+}
+
+std::size_t mvcc_heap_owner::get_available_space() const
+{
+    return reader_handle_.get_available_space();
+}
+
+std::size_t mvcc_heap_owner::get_size() const
+{
+    return reader_handle_.get_size();
+}
+
+reader_token_id mvcc_heap_owner::get_reader_limit() const
+{
+    return reader_handle_.get_reader_limit();
+}
+
+} // namespace storage
+} // namespace supernova
@@ -1,12 +1,17 @@
 #include "mvcc_memory.hpp"
+#include <cerrno>
+#include <csignal>
 #include <cstring>
 #include <exception>
 #include <iostream>
+#include <unistd.h>
 #include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/function.hpp>
 #include <boost/interprocess/creation_tags.hpp>
 #include <boost/optional.hpp>
+#include <boost/thread/locks.hpp>
 #include <boost/thread/thread.hpp>
 #include <supernova/core/compiler_extensions.hpp>
 #include <supernova/storage/exception.hpp>
@@ -57,13 +62,232 @@ bool mvcc_key::operator<(const mvcc_key& other) const
     return strncmp(c_str, other.c_str, sizeof(c_str)) < 0;
 }
 
-mvcc_header::mvcc_header() :
+mvcc_header::mvcc_header(reader_token_id limit) :
     endianess_indicator(std::numeric_limits<boost::uint8_t>::max()),
     memory_version(MVCC_MAX_SUPPORTED_VERSION), 
-    header_size(sizeof(mvcc_header))
+    header_size(sizeof(mvcc_header)),
+    reader_limit(limit)
 {
     strncpy(file_type_tag, MVCC_FILE_TYPE_TAG, sizeof(file_type_tag));
 }
 
+mvcc_newest_revision_is::mvcc_newest_revision_is(const mvcc_revision& e, const boost::atomic<bool>& r) :
+    expected(e), removed(r)
+{ }
+
+bool mvcc_newest_revision_is::operator()(const mvcc_revision& newest) const
+{
+    return (removed ? 0 : newest) == expected;
+}
+
+mvcc_removal_marker::mvcc_removal_marker(boost::atomic<bool>& r) :
+    removed(r)
+{ }
+
+void mvcc_removal_marker::operator()() const
+{
+    removed = true;
+}
+
+mvcc_journal_entry::mvcc_journal_entry() :
+    sequence(0),
+    revision(0),
+    removed(false),
+    key()
+{ }
+
+mvcc_change_journal::mvcc_change_journal(mvcc_journal_entry* e) :
+    mutex(),
+    entries(e),
+    appended(0),
+    overwritten_revision(0)
+{ }
+
+mvcc_reader_token::mvcc_reader_token() :
+    reserved(false),
+    owner_pid(0)
+{ }
+
+boost::int32_t get_process_id()
+{
+    return getpid();
+}
+
+bool is_process_gone(boost::int32_t pid)
+{
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+mvcc_gc_cursors::mvcc_gc_cursors(std::size_t worker_count) :
+    worker_count_(worker_count),
+    registry_size_(0),
+    range_first_(),
+    resume_from_(),
+    task_generation_(0),
+    tasks_pending_(0),
+    stopping_(false),
+    task_failures_()
+{
+    if (UNLIKELY_EXT(worker_count == 0 || worker_count > MVCC_GC_WORKER_LIMIT))
+    {
+	throw storage_error("Garbage collection worker count out of range")
+		<< info_component_identity("mvcc_gc_cursors");
+    }
+    task_failures_.resize(worker_count);
+    start_workers();
+}
+
+mvcc_gc_cursors::~mvcc_gc_cursors()
+{
+    stop_workers();
+}
+
+std::size_t mvcc_gc_cursors::get_worker_count() const
+{
+    return worker_count_;
+}
+
+void mvcc_gc_cursors::start_workers()
+{
+    try
+    {
+	for (std::size_t range = 1; range < worker_count_; ++range)
+	{
+	    workers_.create_thread(boost::bind(&mvcc_gc_cursors::run_worker, this, range));
+	}
+    }
+    catch (...)
+    {
+	// the destructor won't run to stop the workers already started
+	stop_workers();
+	throw;
+    }
+}
+
+void mvcc_gc_cursors::stop_workers()
+{
+    {
+	boost::lock_guard<boost::mutex> lock(task_mutex_);
+	stopping_ = true;
+    }
+    task_posted_.notify_all();
+    workers_.join_all();
+}
+
+void mvcc_gc_cursors::run_worker(std::size_t range)
+{
+    std::size_t generation = 0;
+    boost::unique_lock<boost::mutex> lock(task_mutex_);
+    while (true)
+    {
+	while (!stopping_ && generation == task_generation_)
+	{
+	    task_posted_.wait(lock);
+	}
+	if (stopping_)
+	{
+	    return;
+	}
+	generation = task_generation_;
+	lock.unlock();
+	// the task is only replaced once every worker is done with it
+	boost::exception_ptr failure;
+	try
+	{
+	    task_(range);
+	}
+	catch (...)
+	{
+	    failure = boost::current_exception();
+	}
+	lock.lock();
+	task_failures_[range] = failure;
+	if (--tasks_pending_ == 0)
+	{
+	    task_done_.notify_one();
+	}
+    }
+}
+
+void mvcc_gc_cursors::run_on_ranges(const boost::function<void(std::size_t)>& task)
+{
+    {
+	boost::lock_guard<boost::mutex> lock(task_mutex_);
+	task_ = task;
+	tasks_pending_ = worker_count_ - 1;
+	++task_generation_;
+    }
+    task_posted_.notify_all();
+    try
+    {
+	task(0);
+	task_failures_[0] = boost::exception_ptr();
+    }
+    catch (...)
+    {
+	task_failures_[0] = boost::current_exception();
+    }
+    {
+	boost::unique_lock<boost::mutex> lock(task_mutex_);
+	while (tasks_pending_)
+	{
+	    task_done_.wait(lock);
+	}
+	task_.clear();
+    }
+    for (std::size_t range = 0; range < task_failures_.size(); ++range)
+    {
+	if (UNLIKELY_EXT(task_failures_[range] != 0))
+	{
+	    boost::exception_ptr failure(task_failures_[range]);
+	    task_failures_[range] = boost::exception_ptr();
+	    boost::rethrow_exception(failure);
+	}
+    }
+}
+
+mvcc_type_table::mvcc_type_table() :
+    mutex_(),
+    entries_()
+{ }
+
+mvcc_type_table& mvcc_type_table::instance()
+{
+    static mvcc_type_table table;
+    return table;
+}
+
+boost::uint64_t mvcc_type_table::hash_type_name(const char* name)
+{
+    // 64 bit FNV-1a
+    boost::uint64_t hash = 14695981039346656037ULL;
+    for (const char* iter = name; *iter; ++iter)
+    {
+	hash ^= static_cast<boost::uint8_t>(*iter);
+	hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void mvcc_type_table::enroll(boost::uint64_t type_id, trim_function trim, expire_function expire)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    for (snapshot_type::const_iterator iter = entries_.begin(); iter != entries_.end(); ++iter)
+    {
+	if (iter->first == type_id)
+	{
+	    return;
+	}
+    }
+    functions entry = { trim, expire };
+    entries_.push_back(std::make_pair(type_id, entry));
+}
+
+void mvcc_type_table::snapshot(snapshot_type& out) const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    out = entries_;
+}
+
 } // namespace storage
 } // namespace supernova
@@ -34,6 +34,16 @@ catch (storage_error& err)
 mvcc_mmap_reader::~mvcc_mmap_reader()
 { }
 
+bool mvcc_mmap_reader::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    return reader_handle_.changes_since(revision, out);
+}
+
+boost::uint64_t mvcc_mmap_reader::get_journal_revision() const
+{
+    return reader_handle_.get_journal_revision();
+}
+
 std::size_t mvcc_mmap_reader::get_available_space() const
 {
     return reader_handle_.get_available_space();
@@ -44,12 +54,53 @@ std::size_t mvcc_mmap_reader::get_size() const
     return reader_handle_.get_size();
 }
 
-mvcc_mmap_owner::mvcc_mmap_owner(const bfs::path& path, std::size_t size)
+reader_token_id mvcc_mmap_reader::get_reader_limit() const
+{
+    return reader_handle_.get_reader_limit();
+}
+
+mvcc_mmap_reader_cache::mvcc_mmap_reader_cache(const bfs::path& path, std::size_t batch_size)
+try :
+    path_(path),
+    file_(bip::open_only, path.string().c_str()),
+    token_cache_(file_, batch_size)
+{
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(path.string());
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(path.string());
+    throw err;
+}
+
+mvcc_mmap_reader_cache::~mvcc_mmap_reader_cache()
+{ }
+
+mvcc_mmap_reader_cache::reader_type& mvcc_mmap_reader_cache::get_thread_reader()
+{
+    return token_cache_.get_thread_reader();
+}
+
+std::size_t mvcc_mmap_reader_cache::get_reserved_count() const
+{
+    return token_cache_.get_reserved_count();
+}
+
+std::size_t mvcc_mmap_reader_cache::get_idle_count() const
+{
+    return token_cache_.get_idle_count();
+}
+
+mvcc_mmap_owner::mvcc_mmap_owner(const bfs::path& path, std::size_t size, reader_token_id reader_limit)
 try :
     exists_(bfs::exists(path)),
     path_(path),
     file_(bip::open_or_create, path.string().c_str(), size),
-    owner_handle_(exists_ ? open_existing : open_new, file_),
+    owner_handle_(exists_ ? open_existing : open_new, file_, reader_limit),
     writer_handle_(file_),
     reader_handle_(file_),
     file_lock_(path.string().c_str())
@@ -100,6 +151,11 @@ std::string mvcc_mmap_owner::collect_garbage(const std::string& from, std::size_
     return owner_handle_.collect_garbage(from, max_attempts);
 }
 
+void mvcc_mmap_owner::collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts)
+{
+    owner_handle_.collect_garbage(cursors, max_attempts);
+}
+
 void mvcc_mmap_owner::flush()
 {
     boost::function<void ()> flush_func(boost::bind(&mvcc_mmap_owner::flush_impl, boost::ref(*this)));
@@ -112,6 +168,16 @@ void mvcc_mmap_owner::flush_impl()
     last_flush_timestamp_ = bpt::microsec_clock::local_time();
 }
 
+bool mvcc_mmap_owner::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    return reader_handle_.changes_since(revision, out);
+}
+
+boost::uint64_t mvcc_mmap_owner::get_journal_revision() const
+{
+    return reader_handle_.get_journal_revision();
+}
+
 std::size_t mvcc_mmap_owner::get_available_space() const
 {
     return reader_handle_.get_available_space();
@@ -122,5 +188,10 @@ std::size_t mvcc_mmap_owner::get_size() const
     return reader_handle_.get_size();
 }
 
+reader_token_id mvcc_mmap_owner::get_reader_limit() const
+{
+    return reader_handle_.get_reader_limit();
+}
+
 } // namespace storage
 } // namespace supernova
@@ -0,0 +1,341 @@
+#include "mvcc_sharded.hpp"
+#include <cstring>
+#include <limits>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/format.hpp>
+#include <boost/interprocess/creation_tags.hpp>
+#include <boost/thread/locks.hpp>
+#include <supernova/core/compiler_extensions.hpp>
+#include <supernova/storage/exception.hpp>
+#include "mvcc_sharded.hxx"
+
+namespace bip = boost::interprocess;
+
+namespace supernova {
+namespace storage {
+
+namespace {
+
+static const char* MVCC_SHARDED_FILE_TYPE_TAG = "supernova::storage::mvcc_sharded";
+
+struct mvcc_shard_manifest
+{
+    boost::uint16_t endianess_indicator;
+    char file_type_tag[48];
+    version memory_version;
+    boost::uint16_t manifest_size;
+    boost::uint32_t shard_count;
+};
+
+std::string shard_name(const std::string& name, std::size_t index)
+{
+    return str(boost::format("%1%.%2%") % name % index);
+}
+
+void init_manifest(mvcc_shard_manifest* manifest, std::size_t shard_count)
+{
+    manifest->endianess_indicator = std::numeric_limits<boost::uint8_t>::max();
+    strncpy(manifest->file_type_tag, MVCC_SHARDED_FILE_TYPE_TAG, sizeof(manifest->file_type_tag));
+    manifest->memory_version = MVCC_MAX_SUPPORTED_VERSION;
+    manifest->manifest_size = sizeof(mvcc_shard_manifest);
+    manifest->shard_count = shard_count;
+}
+
+void check_manifest(const mvcc_shard_manifest* manifest)
+{
+    // If endianess is different the indicator will be 65280 instead of 255
+    if (UNLIKELY_EXT(manifest->endianess_indicator != std::numeric_limits<boost::uint8_t>::max()))
+    {
+	throw unsupported_db_error("Memory requires byte swapping")
+		<< info_component_identity("mvcc_sharded")
+		<< info_version_found(manifest->memory_version);
+    }
+    if (UNLIKELY_EXT(strncmp(manifest->file_type_tag, MVCC_SHARDED_FILE_TYPE_TAG, sizeof(manifest->file_type_tag))))
+    {
+	throw malformed_db_error("Incorrect file type tag found")
+		<< info_component_identity("mvcc_sharded");
+    }
+    if (UNLIKELY_EXT(manifest->memory_version < MVCC_MIN_SUPPORTED_VERSION ||
+	    manifest->memory_version > MVCC_MAX_SUPPORTED_VERSION))
+    {
+	throw unsupported_db_error("Unsuported memory version")
+		<< info_component_identity("mvcc_sharded")
+		<< info_version_found(manifest->memory_version)
+		<< info_min_supported_version(MVCC_MIN_SUPPORTED_VERSION)
+		<< info_max_supported_version(MVCC_MAX_SUPPORTED_VERSION);
+    }
+    if (UNLIKELY_EXT(sizeof(mvcc_shard_manifest) != manifest->manifest_size))
+    {
+	throw malformed_db_error("Wrong manifest size")
+		<< info_component_identity("mvcc_sharded");
+    }
+    if (UNLIKELY_EXT(manifest->shard_count == 0 || manifest->shard_count > MVCC_SHARD_LIMIT))
+    {
+	throw malformed_db_error("Shard count out of range")
+		<< info_component_identity("mvcc_sharded");
+    }
+}
+
+std::size_t read_shard_count(const std::string& name)
+{
+    bip::shared_memory_object shm(bip::open_only, name.c_str(), bip::read_only);
+    bip::mapped_region region(shm, bip::read_only);
+    if (UNLIKELY_EXT(region.get_size() < sizeof(mvcc_shard_manifest)))
+    {
+	throw malformed_db_error("Manifest is truncated")
+		<< info_component_identity("mvcc_sharded");
+    }
+    const mvcc_shard_manifest* manifest = static_cast<const mvcc_shard_manifest*>(region.get_address());
+    check_manifest(manifest);
+    return manifest->shard_count;
+}
+
+bip::shared_memory_object& init_manifest_memory(bip::shared_memory_object& shm)
+{
+    bip::offset_t size = 0;
+    if (!shm.get_size(size) || size == 0)
+    {
+	shm.truncate(sizeof(mvcc_shard_manifest));
+    }
+    return shm;
+}
+
+} // anonymous namespace
+
+std::size_t mvcc_shard_index(const char* key, std::size_t shard_count)
+{
+    // 32 bit FNV-1a
+    boost::uint32_t hash = 2166136261U;
+    for (const char* iter = key; *iter; ++iter)
+    {
+	hash ^= static_cast<boost::uint8_t>(*iter);
+	hash *= 16777619U;
+    }
+    return hash % shard_count;
+}
+
+template class mvcc_sharded_base<mvcc_shm_reader>;
+template class mvcc_sharded_base<mvcc_shm_owner>;
+
+mvcc_sharded_reader::mvcc_sharded_reader(const std::string& name)
+try :
+    mvcc_sharded_base<mvcc_shm_reader>(),
+    name_(name)
+{
+    std::size_t shard_count = read_shard_count(name);
+    shards_.reserve(shard_count);
+    for (std::size_t index = 0; index < shard_count; ++index)
+    {
+	shards_.push_back(new mvcc_shm_reader(shard_name(name, index)));
+    }
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(name);
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(name);
+    throw err;
+}
+
+mvcc_sharded_reader::~mvcc_sharded_reader()
+{ }
+
+mvcc_sharded_owner::mvcc_sharded_owner(const std::string& name, std::size_t shard_count, std::size_t shard_size, reader_token_id reader_limit)
+try :
+    mvcc_sharded_base<mvcc_shm_owner>(),
+    name_(name),
+    manifest_shm_(bip::open_or_create, name.c_str(), bip::read_write),
+    manifest_region_(init_manifest_memory(manifest_shm_), bip::read_write),
+    gc_cursors_(shard_count),
+    task_generation_(0),
+    tasks_pending_(0),
+    stopping_(false),
+    task_failures_(shard_count)
+{
+    if (UNLIKELY_EXT(shard_count == 0 || shard_count > MVCC_SHARD_LIMIT))
+    {
+	throw storage_error("Shard count out of range")
+		<< info_component_identity("mvcc_sharded");
+    }
+    mvcc_shard_manifest* manifest = static_cast<mvcc_shard_manifest*>(manifest_region_.get_address());
+    if (manifest->manifest_size == 0)
+    {
+	init_manifest(manifest, shard_count);
+    }
+    check_manifest(manifest);
+    if (UNLIKELY_EXT(manifest->shard_count != shard_count))
+    {
+	throw storage_error("Shard count differs from the existing memory")
+		<< info_component_identity("mvcc_sharded");
+    }
+    shards_.reserve(shard_count);
+    for (std::size_t index = 0; index < shard_count; ++index)
+    {
+	shards_.push_back(new mvcc_shm_owner(shard_name(name, index), shard_size, reader_limit));
+    }
+    start_workers();
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(name);
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(name);
+    throw err;
+}
+
+mvcc_sharded_owner::~mvcc_sharded_owner()
+{
+    stop_workers();
+}
+
+void mvcc_sharded_owner::process_read_metadata(reader_token_id from, reader_token_id to)
+{
+    run_on_shards(boost::bind(&mvcc_sharded_owner::process_read_metadata_task, this, _1, from, to));
+}
+
+void mvcc_sharded_owner::process_write_metadata(std::size_t)
+{
+    // writers register new keys themselves so there is nothing to hand to the shards
+}
+
+void mvcc_sharded_owner::collect_garbage(std::size_t max_attempts)
+{
+    run_on_shards(boost::bind(&mvcc_sharded_owner::collect_garbage_task, this, _1, max_attempts));
+}
+
+void mvcc_sharded_owner::erase(const std::string& name)
+{
+    std::size_t shard_count = 0;
+    try
+    {
+	shard_count = read_shard_count(name);
+    }
+    catch (...)
+    {
+	// nothing usable left to find the shards with
+    }
+    for (std::size_t index = 0; index < shard_count; ++index)
+    {
+	bip::shared_memory_object::remove(shard_name(name, index).c_str());
+    }
+    bip::shared_memory_object::remove(name.c_str());
+}
+
+void mvcc_sharded_owner::start_workers()
+{
+    try
+    {
+	for (std::size_t index = 1; index < shards_.size(); ++index)
+	{
+	    workers_.create_thread(boost::bind(&mvcc_sharded_owner::run_worker, this, index));
+	}
+    }
+    catch (...)
+    {
+	// the destructor won't run to stop the workers already started
+	stop_workers();
+	throw;
+    }
+}
+
+void mvcc_sharded_owner::stop_workers()
+{
+    {
+	boost::lock_guard<boost::mutex> lock(task_mutex_);
+	stopping_ = true;
+    }
+    task_posted_.notify_all();
+    workers_.join_all();
+}
+
+void mvcc_sharded_owner::run_worker(std::size_t index)
+{
+    std::size_t generation = 0;
+    boost::unique_lock<boost::mutex> lock(task_mutex_);
+    while (true)
+    {
+	while (!stopping_ && generation == task_generation_)
+	{
+	    task_posted_.wait(lock);
+	}
+	if (stopping_)
+	{
+	    return;
+	}
+	generation = task_generation_;
+	lock.unlock();
+	// the task is only replaced once every worker is done with it
+	boost::exception_ptr failure;
+	try
+	{
+	    task_(index);
+	}
+	catch (...)
+	{
+	    failure = boost::current_exception();
+	}
+	lock.lock();
+	task_failures_[index] = failure;
+	if (--tasks_pending_ == 0)
+	{
+	    task_done_.notify_one();
+	}
+    }
+}
+
+void mvcc_sharded_owner::run_on_shards(const boost::function<void(std::size_t)>& task)
+{
+    {
+	boost::lock_guard<boost::mutex> lock(task_mutex_);
+	task_ = task;
+	tasks_pending_ = shards_.size() - 1;
+	++task_generation_;
+    }
+    task_posted_.notify_all();
+    try
+    {
+	task(0);
+	task_failures_[0] = boost::exception_ptr();
+    }
+    catch (...)
+    {
+	task_failures_[0] = boost::current_exception();
+    }
+    {
+	boost::unique_lock<boost::mutex> lock(task_mutex_);
+	while (tasks_pending_)
+	{
+	    task_done_.wait(lock);
+	}
+	task_.clear();
+    }
+    for (std::size_t index = 0; index < task_failures_.size(); ++index)
+    {
+	if (UNLIKELY_EXT(task_failures_[index] != 0))
+	{
+	    boost::exception_ptr failure(task_failures_[index]);
+	    task_failures_[index] = boost::exception_ptr();
+	    boost::rethrow_exception(failure);
+	}
+    }
+}
+
+void mvcc_sharded_owner::process_read_metadata_task(std::size_t index, reader_token_id from, reader_token_id to)
+{
+    shards_[index].process_read_metadata(from, to);
+}
+
+void mvcc_sharded_owner::collect_garbage_task(std::size_t index, std::size_t max_attempts)
+{
+    gc_cursors_[index] = shards_[index].collect_garbage(gc_cursors_[index], max_attempts);
+}
+
+} // namespace storage
+} // namespace supernova
@@ -34,6 +34,16 @@ catch (storage_error& err)
 mvcc_shm_reader::~mvcc_shm_reader()
 { }
 
+bool mvcc_shm_reader::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    return reader_handle_.changes_since(revision, out);
+}
+
+boost::uint64_t mvcc_shm_reader::get_journal_revision() const
+{
+    return reader_handle_.get_journal_revision();
+}
+
 std::size_t mvcc_shm_reader::get_available_space() const
 {
     return reader_handle_.get_available_space();
@@ -44,12 +54,53 @@ std::size_t mvcc_shm_reader::get_size() const
     return reader_handle_.get_size();
 }
 
-mvcc_shm_owner::mvcc_shm_owner(const std::string& name, std::size_t size)
+reader_token_id mvcc_shm_reader::get_reader_limit() const
+{
+    return reader_handle_.get_reader_limit();
+}
+
+mvcc_shm_reader_cache::mvcc_shm_reader_cache(const std::string& name, std::size_t batch_size)
+try :
+    name_(name),
+    share_(bip::open_only, name.c_str()),
+    token_cache_(share_, batch_size)
+{
+}
+catch (storage_condition& cond)
+{
+    cond << info_db_identity(name);
+    throw cond;
+}
+catch (storage_error& err)
+{
+    err << info_db_identity(name);
+    throw err;
+}
+
+mvcc_shm_reader_cache::~mvcc_shm_reader_cache()
+{ }
+
+mvcc_shm_reader_cache::reader_type& mvcc_shm_reader_cache::get_thread_reader()
+{
+    return token_cache_.get_thread_reader();
+}
+
+std::size_t mvcc_shm_reader_cache::get_reserved_count() const
+{
+    return token_cache_.get_reserved_count();
+}
+
+std::size_t mvcc_shm_reader_cache::get_idle_count() const
+{
+    return token_cache_.get_idle_count();
+}
+
+mvcc_shm_owner::mvcc_shm_owner(const std::string& name, std::size_t size, reader_token_id reader_limit)
 try :
     exists_(does_shm_exist(name)),
     name_(name),
     share_(bip::open_or_create, name.c_str(), size),
-    owner_handle_(exists_ ? open_existing : open_new, share_),
+    owner_handle_(exists_ ? open_existing : open_new, share_, reader_limit),
     writer_handle_(share_),
     reader_handle_(share_)
 {
@@ -88,6 +139,21 @@ std::string mvcc_shm_owner::collect_garbage(const std::string& from, std::size_t
     return owner_handle_.collect_garbage(from, max_attempts);
 }
 
+void mvcc_shm_owner::collect_garbage(mvcc_gc_cursors& cursors, std::size_t max_attempts)
+{
+    owner_handle_.collect_garbage(cursors, max_attempts);
+}
+
+bool mvcc_shm_owner::changes_since(boost::uint64_t revision, std::vector<mvcc_change>& out) const
+{
+    return reader_handle_.changes_since(revision, out);
+}
+
+boost::uint64_t mvcc_shm_owner::get_journal_revision() const
+{
+    return reader_handle_.get_journal_revision();
+}
+
 std::size_t mvcc_shm_owner::get_available_space() const
 {
     return reader_handle_.get_available_space();
@@ -98,6 +164,11 @@ std::size_t mvcc_shm_owner::get_size() const
     return reader_handle_.get_size();
 }
 
+reader_token_id mvcc_shm_owner::get_reader_limit() const
+{
+    return reader_handle_.get_reader_limit();
+}
+
 bool mvcc_shm_owner::does_shm_exist(const std::string& name)
 {
     bool result = true;
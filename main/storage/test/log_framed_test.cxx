@@ -0,0 +1,133 @@
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include "exception.hpp"
+#include "log_framed_heap.hpp"
+#include "log_framed_mmap.hpp"
+
+namespace bfs = boost::filesystem;
+namespace sst = supernova::storage;
+
+namespace {
+
+static const std::size_t HEAP_SIZE = 1 << 16;
+
+// Payloads of every length from 0 up, each byte holding the length
+std::string make_payload(std::size_t size)
+{
+    return std::string(size, static_cast<char>(size));
+}
+
+void append_sized_until_full(sst::log_framed_heap_owner& owner, std::size_t size)
+{
+    std::string payload(make_payload(size));
+    while (owner.append(payload.data(), payload.size()))
+    { }
+}
+
+} // anonymous namespace
+
+TEST(log_framed_test, empty_log)
+{
+    sst::log_framed_heap_owner owner(HEAP_SIZE, 32U);
+    sst::log_framed_heap_reader reader(owner);
+    EXPECT_FALSE(reader.get_front_index()) << "front index is defined for an empty log";
+    EXPECT_FALSE(reader.get_back_index()) << "back index is defined for an empty log";
+    EXPECT_FALSE(reader.read(0U)) << "entry read from an empty log";
+}
+
+TEST(log_framed_test, frames_of_different_sizes)
+{
+    sst::log_framed_heap_owner owner(HEAP_SIZE, 32U);
+    sst::log_framed_heap_reader reader(owner);
+    std::size_t free_size = reader.get_free_size();
+    for (std::size_t size = 0; size < 100; ++size)
+    {
+	std::string payload(make_payload(size));
+	boost::optional<sst::log_index> index = owner.append(payload.data(), payload.size());
+	ASSERT_TRUE(index) << "append failed";
+	ASSERT_EQ(size, index.get()) << "index is not the number of entries appended before";
+	ASSERT_EQ(free_size - 8U - (size + 7U) / 8U * 8U, reader.get_free_size()) << "frame is not padded to 8 bytes";
+	free_size = reader.get_free_size();
+    }
+    ASSERT_EQ(99U, reader.get_back_index().get());
+    for (sst::log_index index = 0; index < 100; ++index)
+    {
+	boost::optional<sst::log_payload> payload = reader.read(index);
+	ASSERT_TRUE(payload) << "appended entry could not be read";
+	EXPECT_EQ(make_payload(index), std::string(payload->begin(), payload->end())) << "wrong payload read";
+	EXPECT_EQ(0U, reinterpret_cast<std::size_t>(payload->begin()) % 8U) << "payload is not 8 byte aligned";
+	EXPECT_EQ(payload->begin(), owner.read(index)->begin()) << "payload was copied out of the log";
+    }
+    EXPECT_FALSE(reader.read(100U)) << "entry read past the back of the log";
+}
+
+TEST(log_framed_test, stops_when_full)
+{
+    sst::log_framed_heap_owner owner(HEAP_SIZE, 32U);
+    // Small frames run out of indexes first, large ones out of bytes
+    append_sized_until_full(owner, 8U);
+    EXPECT_EQ(owner.get_max_index(), owner.get_back_index().get()) << "log of small frames stopped before using every index";
+    sst::log_framed_heap_owner large_owner(HEAP_SIZE, 32U);
+    append_sized_until_full(large_owner, 1000U);
+    EXPECT_GT(large_owner.get_max_index(), large_owner.get_back_index().get()) << "log of large frames used every index";
+    EXPECT_GT(1008U, large_owner.get_free_size()) << "log stopped with room for another frame";
+    std::string rest(make_payload(large_owner.get_free_size() - 8U));
+    EXPECT_TRUE(large_owner.append(rest.data(), rest.size())) << "smaller frame did not fit in the bytes left";
+    EXPECT_EQ(0U, large_owner.get_free_size()) << "last frame did not take the bytes left";
+}
+
+TEST(log_framed_test, oversized_payload_rejected)
+{
+    sst::log_framed_heap_owner owner(HEAP_SIZE, 32U);
+    char payload = 'a';
+    // Only one byte is there to be copied, which is fine as long as no frame gets reserved
+    EXPECT_FALSE(owner.append(&payload, std::numeric_limits<std::size_t>::max())) << "frame size wrapped round to a small one";
+    EXPECT_FALSE(owner.append(&payload, HEAP_SIZE)) << "payload larger than the log was appended";
+    EXPECT_FALSE(owner.get_back_index()) << "rejected payload took an index";
+    EXPECT_TRUE(owner.append(&payload, 1U)) << "log refused a payload after an oversized one";
+}
+
+TEST(log_framed_test, producers_on_threads)
+{
+    sst::log_framed_heap_owner owner(HEAP_SIZE, 32U);
+    boost::thread_group producers;
+    for (std::size_t size = 1; size <= 4; ++size)
+    {
+	producers.create_thread(boost::bind(&append_sized_until_full, boost::ref(owner), size * 20U));
+    }
+    producers.join_all();
+    ASSERT_TRUE(owner.get_back_index()) << "nothing was appended";
+    for (sst::log_index index = 0; index <= owner.get_back_index().get(); ++index)
+    {
+	boost::optional<sst::log_payload> payload = owner.read(index);
+	ASSERT_TRUE(payload) << "entry below the back index could not be read";
+	EXPECT_EQ(make_payload(payload->size()), std::string(payload->begin(), payload->end())) << "frames overlap";
+    }
+}
+
+TEST(log_framed_test, reopen_mmap_log)
+{
+    bfs::path path(bfs::temp_directory_path() / bfs::unique_path());
+    {
+	sst::log_framed_mmap_owner owner(path, HEAP_SIZE, 32U);
+	std::string payload(make_payload(3U));
+	ASSERT_TRUE(owner.append(payload.data(), payload.size())) << "append failed";
+    }
+    {
+	sst::log_framed_mmap_owner owner(path, HEAP_SIZE, 32U);
+	std::string payload(make_payload(300U));
+	ASSERT_EQ(1U, owner.append(payload.data(), payload.size()).get()) << "reopened log did not carry on from its back";
+	sst::log_framed_mmap_reader reader(path);
+	ASSERT_EQ(1U, reader.get_back_index().get());
+	EXPECT_EQ(3U, reader.read(0U)->size()) << "wrong payload read";
+	EXPECT_EQ(300U, reader.read(1U)->size()) << "wrong payload read";
+    }
+    bfs::remove(path);
+}
@@ -0,0 +1,318 @@
+#include <cstring>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/variant.hpp>
+#include <gtest/gtest.h>
+#include "exception.hpp"
+#include "log_heap.hpp"
+#include "log_heap.hxx"
+
+namespace sst = supernova::storage;
+
+namespace {
+
+static const std::size_t HEAP_SIZE = 1 << 16;
+
+// The entries of the log_mmap and log_shm tests, minus their protobuf conversions
+struct struct_A
+{
+    struct_A(const char* k = "", const char* v = "")
+    {
+	strncpy(key, k, sizeof(key) - 1);
+	key[sizeof(key) - 1] = '\0';
+	strncpy(value, v, sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+    }
+    bool operator==(const struct_A& other) const
+    {
+	return strncmp(key, other.key, sizeof(key)) == 0 && strncmp(value, other.value, sizeof(value)) == 0;
+    }
+    char key[64];
+    char value[64];
+};
+
+struct struct_B
+{
+    struct_B(const char* k = "", bool a = true, boost::int32_t b = 0, double c = 0.0F) :
+	value1(a), value2(b), value3(c)
+    {
+	strncpy(key, k, sizeof(key) - 1);
+	key[sizeof(key) - 1] = '\0';
+    }
+    bool operator==(const struct_B& other) const
+    {
+	return strncmp(key, other.key, sizeof(key)) == 0 && value1 == other.value1 &&
+		value2 == other.value2 && value3 == other.value3;
+    }
+    char key[64];
+    bool value1;
+    boost::int32_t value2;
+    double value3;
+};
+
+struct union_AB
+{
+    union_AB(const struct_A& a) : value(a) { }
+    union_AB(const struct_B& b) : value(b) { }
+    bool operator==(const union_AB& other) const
+    {
+	return value == other.value;
+    }
+    boost::variant<struct_A, struct_B> value;
+};
+
+void append_until_full(sst::log_heap_owner<union_AB>& owner, boost::atomic<std::size_t>& appended)
+{
+    struct_A A1("foo", "bar");
+    union_AB U1(A1);
+    while (owner.append(U1))
+    {
+	++appended;
+    }
+}
+
+void append_numbered_until_full(sst::log_heap_owner<struct_B>& owner)
+{
+    for (boost::int32_t number = 0; owner.append(struct_B("blah", true, number, 1.0 * number)); ++number)
+    { }
+}
+
+void read_until_full(const sst::log_heap_owner<struct_B>& owner, boost::atomic<std::size_t>& mismatches)
+{
+    sst::log_heap_reader<struct_B> reader(owner);
+    boost::optional<sst::log_index> back;
+    while (!back || back.get() < reader.get_max_index())
+    {
+	back = reader.get_back_index();
+	for (sst::log_index index = 0; back && index <= back.get(); ++index)
+	{
+	    boost::optional<const struct_B&> entry = reader.read(index);
+	    if (!entry || entry->value2 != static_cast<boost::int32_t>(entry->value3))
+	    {
+		++mismatches;
+	    }
+	}
+    }
+}
+
+void append_numbered_slowly(sst::log_heap_owner<struct_B>& owner, boost::int32_t count)
+{
+    for (boost::int32_t number = 0; number < count; ++number)
+    {
+	boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	owner.append(struct_B("blah", true, number, 1.0 * number));
+    }
+}
+
+} // anonymous namespace
+
+TEST(log_heap_test, empty_log)
+{
+    sst::log_heap_owner<union_AB> owner(HEAP_SIZE);
+    sst::log_heap_reader<union_AB> reader(owner);
+    EXPECT_FALSE(reader.get_front_index()) << "front index is defined for an empty log";
+    EXPECT_FALSE(reader.get_back_index()) << "back index is defined for an empty log";
+}
+
+TEST(log_heap_test, fill_log)
+{
+    sst::log_heap_owner<union_AB> owner(HEAP_SIZE);
+    sst::log_heap_reader<union_AB> reader(owner);
+
+    struct_A A1("foo", "bar");
+    union_AB U1(A1);
+    boost::optional<sst::log_index> index1 = owner.append(U1);
+    ASSERT_TRUE(index1) << "append failed";
+    EXPECT_TRUE(reader.get_front_index()) << "front index is not defined";
+    EXPECT_EQ(U1, reader.read(index1.get()).get()) << "entry read does not match entry just appended";
+
+    for (boost::optional<sst::log_index> index = index1.get() + 1; index && index.get() <= reader.get_max_index(); ++(index.get()))
+    {
+	struct_B fillerB("blah", true, index.get(), 1.0 * index.get());
+	union_AB fillerU(fillerB);
+	index = owner.append(fillerU);
+	ASSERT_TRUE(index) << "append failed";
+	EXPECT_EQ(fillerU, reader.read(index.get()).get()) << "entry read does not match entry just appended";
+    }
+    EXPECT_EQ(reader.get_back_index(), reader.get_max_index()) << "in a full log the back index != max index";
+    EXPECT_FALSE(owner.append(U1)) << "append to full log allowed";
+}
+
+TEST(log_heap_test, producers_on_threads)
+{
+    sst::log_heap_owner<union_AB> owner(HEAP_SIZE);
+    sst::log_heap_reader<union_AB> reader(owner);
+    boost::atomic<std::size_t> appended(0);
+    boost::thread_group producers;
+    for (std::size_t iter = 0; iter < 4U; ++iter)
+    {
+	producers.create_thread(boost::bind(&append_until_full, boost::ref(owner), boost::ref(appended)));
+    }
+    producers.join_all();
+    EXPECT_EQ(reader.get_max_index() + 1, appended.load()) << "producers did not fill every slot exactly once";
+    EXPECT_EQ(reader.get_max_index(), reader.get_back_index().get()) << "in a full log the back index != max index";
+    EXPECT_FALSE(reader.read(reader.get_max_index() + 1)) << "read past the end of the log allowed";
+}
+
+TEST(log_heap_test, readers_see_whole_entries)
+{
+    sst::log_heap_owner<struct_B> owner(HEAP_SIZE);
+    boost::atomic<std::size_t> mismatches(0);
+    boost::thread_group threads;
+    for (std::size_t iter = 0; iter < 2U; ++iter)
+    {
+	threads.create_thread(boost::bind(&read_until_full, boost::cref(owner), boost::ref(mismatches)));
+	threads.create_thread(boost::bind(&append_numbered_until_full, boost::ref(owner)));
+    }
+    threads.join_all();
+    EXPECT_EQ(0U, mismatches.load()) << "a reader saw an entry before it was fully written";
+}
+
+TEST(log_heap_test, append_batch_and_read_range)
+{
+    sst::log_heap_owner<struct_B> owner(HEAP_SIZE);
+    sst::log_heap_reader<struct_B> reader(owner);
+    std::vector<struct_B> batch;
+    for (boost::int32_t number = 0; number < 10; ++number)
+    {
+	batch.push_back(struct_B("blah", true, number, 1.0 * number));
+    }
+    boost::optional<sst::log_index> first = owner.append_batch(batch.begin(), batch.end());
+    ASSERT_TRUE(first) << "append failed";
+    EXPECT_EQ(0U, first.get()) << "batch did not start at the front of the log";
+    EXPECT_EQ(9U, reader.get_back_index().get()) << "batch was not appended whole";
+    boost::iterator_range<const struct_B*> range = reader.read_range(first.get(), 20U);
+    ASSERT_EQ(10U, range.size()) << "range goes past the entries appended";
+    EXPECT_TRUE(std::equal(batch.begin(), batch.end(), range.begin())) << "entries read do not match entries just appended";
+    EXPECT_TRUE(reader.read_range(10U, 5U).empty()) << "range read past the back of the log";
+
+    std::vector<struct_B> filler(reader.get_max_index() + 1, struct_B("filler", false, 1, 1.0));
+    first = owner.append_batch(filler.begin(), filler.end());
+    ASSERT_TRUE(first) << "append to a log with free slots failed";
+    EXPECT_EQ(10U, first.get()) << "batch did not follow the previous one";
+    EXPECT_EQ(reader.get_max_index(), reader.get_back_index().get()) << "batch did not fill the log";
+    EXPECT_EQ(reader.get_max_index() - 9, reader.read_range(10U, filler.size()).size()) << "range is not bounded by the end of the log";
+    EXPECT_FALSE(owner.append_batch(batch.begin(), batch.end())) << "append to full log allowed";
+}
+
+TEST(log_heap_test, wrap_around_detects_overrun)
+{
+    sst::log_heap_owner<struct_B> owner(HEAP_SIZE, sst::log_wraps_around);
+    sst::log_heap_reader<struct_B> reader(owner);
+    sst::log_index slots = reader.get_max_index() + 1;
+    for (boost::int32_t number = 0; static_cast<sst::log_index>(number) < slots + 5; ++number)
+    {
+	boost::optional<sst::log_index> index = owner.append(struct_B("blah", true, number, 1.0 * number));
+	ASSERT_TRUE(index) << "append to a log wrapping around failed";
+	EXPECT_EQ(static_cast<sst::log_index>(number), index.get()) << "index did not keep counting up";
+    }
+    EXPECT_EQ(5U, reader.get_front_index().get()) << "front index does not follow the oldest entry kept";
+    EXPECT_EQ(slots + 4, reader.get_back_index().get()) << "back index does not follow the newest entry";
+    EXPECT_FALSE(reader.read(4U)) << "overwritten entry could still be read";
+    EXPECT_TRUE(reader.is_overwritten(4U)) << "overwritten entry not detected";
+    boost::optional<const struct_B&> entry = reader.read(slots + 4);
+    ASSERT_TRUE(entry) << "newest entry could not be read";
+    EXPECT_EQ(static_cast<boost::int32_t>(slots + 4), entry->value2) << "entry read does not match entry appended";
+    EXPECT_FALSE(reader.is_overwritten(slots + 4)) << "newest entry reported overwritten";
+    EXPECT_EQ(slots - 5, reader.read_range(5U, slots).size()) << "range does not stop at the end of the slots";
+    EXPECT_EQ(5U, reader.read_range(slots, slots).size()) << "range does not continue from the start of the slots";
+}
+
+TEST(log_heap_test, wait_for_follows_appends)
+{
+    sst::log_heap_owner<struct_B> owner(HEAP_SIZE);
+    sst::log_heap_reader<struct_B> reader(owner);
+    EXPECT_FALSE(reader.wait_for(0U, boost::posix_time::milliseconds(50))) << "wait on an empty log did not time out";
+    boost::thread producer(boost::bind(&append_numbered_slowly, boost::ref(owner), 10));
+    for (sst::log_index index = 0; index < 10; ++index)
+    {
+	ASSERT_TRUE(reader.wait_for(index, boost::posix_time::seconds(10))) << "waiter was not woken by the append";
+	boost::optional<const struct_B&> entry = reader.read(index);
+	ASSERT_TRUE(entry) << "entry waited for could not be read";
+	EXPECT_EQ(static_cast<boost::int32_t>(index), entry->value2) << "entry read does not match entry appended";
+    }
+    producer.join();
+    EXPECT_TRUE(reader.wait_for(9U, boost::posix_time::milliseconds(0))) << "wait on an entry already appended blocked";
+}
+
+TEST(log_heap_test, truncate_front_reuses_slots)
+{
+    sst::log_heap_owner<struct_B> owner(HEAP_SIZE);
+    append_numbered_until_full(owner);
+    sst::log_index slots = owner.get_max_index() + 1;
+    {
+	sst::log_heap_reader<struct_B> reader(owner);
+	reader.set_checkpoint(5U);
+	EXPECT_EQ(5U, owner.truncate_front(10U)) << "front moved past the checkpoint of a reader";
+	EXPECT_EQ(5U, reader.get_front_index().get()) << "front index does not reflect the truncation";
+	for (boost::int32_t number = 0; number < 5; ++number)
+	{
+	    boost::optional<sst::log_index> index = owner.append(struct_B("blah", true, number, 1.0 * number));
+	    ASSERT_TRUE(index) << "append to a truncated log failed";
+	    EXPECT_EQ(slots + number, index.get()) << "index did not keep counting up";
+	}
+	EXPECT_FALSE(owner.append(struct_B("blah", true, 5, 5.0))) << "append overwrote an entry past the front";
+	EXPECT_TRUE(reader.is_overwritten(4U)) << "truncated entry was not overwritten";
+	EXPECT_TRUE(reader.read(5U)) << "entry at the checkpoint could not be read";
+	EXPECT_EQ(slots + 4, reader.get_back_index().get()) << "back index does not follow the newest entry";
+	EXPECT_EQ(slots - 5, reader.read_range(5U, slots).size()) << "range does not stop at the end of the slots";
+	sst::log_heap_reader<struct_B> late_reader(owner);
+	EXPECT_EQ(5U, late_reader.set_checkpoint(2U)) << "checkpoint set below the front was not moved up to it";
+    }
+    EXPECT_EQ(10U, owner.truncate_front(10U)) << "checkpoint outlived its reader";
+    std::vector<struct_B> batch(8, struct_B("blah", true, 0, 0.0));
+    EXPECT_EQ(slots + 5, owner.append_batch(batch.begin(), batch.end()).get()) << "batch did not follow the previous append";
+    EXPECT_EQ(slots + 9, owner.get_back_index().get()) << "batch did not stop at the front";
+}
+
+TEST(log_heap_test, truncation_of_exited_process)
+{
+    sst::log_checkpoint_table table;
+    table.init();
+    pid_t child = fork();
+    ASSERT_NE(-1, child) << "fork failed";
+    if (child == 0)
+    {
+	_exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0)) << "truncating process was lost";
+    // As left by an owner that exited between begin_truncation and end_truncation
+    boost::uint64_t exited = (static_cast<boost::uint64_t>(child) << 32) | 1U;
+    table.truncation_marker = exited;
+    EXPECT_TRUE(table.wait_for_truncations()) << "truncation outlived the process truncating";
+    table.truncation_marker = exited;
+    table.begin_truncation();
+    EXPECT_EQ((static_cast<boost::uint64_t>(getpid()) << 32) | 1U, table.truncation_marker.load()) << "truncation of an exited process was not taken over";
+    table.end_truncation();
+    EXPECT_TRUE(table.wait_for_truncations()) << "finished truncation was waited for";
+    table.truncation_marker = (static_cast<boost::uint64_t>(getppid()) << 32) | 1U;
+    EXPECT_FALSE(table.wait_for_truncations()) << "wait for the truncation of a live process was not bounded";
+}
+
+TEST(log_heap_test, appends_to_full_log_are_skipped)
+{
+    sst::log_heap_owner<struct_B> owner(HEAP_SIZE);
+    sst::log_heap_reader<struct_B> reader(owner);
+    append_numbered_until_full(owner);
+    sst::log_index slots = owner.get_max_index() + 1;
+    EXPECT_EQ(3U, owner.truncate_front(3U)) << "front did not move";
+    std::vector<struct_B> batch(5, struct_B("blah", true, 0, 0.0));
+    EXPECT_EQ(slots, owner.append_batch(batch.begin(), batch.end()).get()) << "batch did not follow the last append";
+    EXPECT_EQ(slots + 2, owner.get_back_index().get()) << "batch did not stop at the front";
+    EXPECT_TRUE(reader.read(3U)) << "entry a lap behind a skipped index could not be read";
+    EXPECT_TRUE(reader.read(4U)) << "entry a lap behind a skipped index could not be read";
+    EXPECT_EQ(10U, owner.truncate_front(10U)) << "front did not move";
+    boost::optional<sst::log_index> index = owner.append(struct_B("blah", true, 5, 5.0));
+    ASSERT_TRUE(index) << "append to a truncated log failed";
+    EXPECT_EQ(slots + 5, index.get()) << "indexes skipped were handed out again";
+    EXPECT_EQ(slots + 5, owner.get_back_index().get()) << "commit count did not pass the skipped indexes";
+    EXPECT_FALSE(reader.read(slots + 3)) << "skipped index read as an entry";
+    EXPECT_TRUE(reader.is_overwritten(slots + 4)) << "skipped index read as an entry";
+    EXPECT_EQ(3U, reader.read_range(slots, 10U).size()) << "range did not stop at a skipped index";
+}
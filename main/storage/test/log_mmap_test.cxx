@@ -456,3 +456,26 @@ TEST(log_mmap_test, out_of_bounds)
 
     client.send_terminate_msg(20U);
 }
+
+TEST(log_mmap_test, read_only_file)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::struct_A A1("foo", "bar");
+    sst::union_AB U1(A1);
+    boost::optional<sst::log_index> index1 = client.send_append_msg(10U, U1);
+    ASSERT_TRUE(index1) << "append failed";
+
+    bfs::permissions(bfs::path(conf.name), bfs::owner_read | bfs::group_read | bfs::others_read);
+    sst::log_mmap_reader<sst::union_AB> reader(bfs::path(conf.name.c_str()));
+    EXPECT_EQ(U1, reader.read(index1.get()).get()) << "entry read from a read only file does not match entry appended";
+    // a privileged user can write to the file all the same
+    if (access(conf.name.c_str(), W_OK) != 0)
+    {
+	EXPECT_THROW(reader.wait_for(index1.get(), bpt::milliseconds(1)), sst::storage_error) << "waited on a read only log";
+	EXPECT_THROW(reader.set_checkpoint(index1.get()), sst::storage_error) << "checkpoint set in a read only log";
+    }
+
+    client.send_terminate_msg(20U);
+}
@@ -0,0 +1,191 @@
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include "exception.hpp"
+#include "log_segmented.hpp"
+#include "log_segmented.hxx"
+
+namespace bfs = boost::filesystem;
+namespace bpt = boost::posix_time;
+namespace sst = supernova::storage;
+
+namespace {
+
+static const std::size_t SEGMENT_SIZE = 1 << 14;
+
+// Laid out like the struct_B of log_service_msg.hpp, as nothing here is sent to a service
+struct struct_B
+{
+    struct_B(const char* k = "", bool a = true, boost::int32_t b = 0, double c = 0.0F) :
+	value1(a), value2(b), value3(c)
+    {
+	strncpy(key, k, sizeof(key) - 1);
+	key[sizeof(key) - 1] = '\0';
+    }
+    bool operator==(const struct_B& other) const
+    {
+	return strncmp(key, other.key, sizeof(key)) == 0 && value1 == other.value1 &&
+		value2 == other.value2 && value3 == other.value3;
+    }
+    char key[64];
+    bool value1;
+    boost::int32_t value2;
+    double value3;
+};
+
+class temp_directory
+{
+public:
+    temp_directory() : path_(bfs::temp_directory_path() / bfs::unique_path()) { }
+    ~temp_directory() { bfs::remove_all(path_); }
+    const bfs::path& get_path() const { return path_; }
+private:
+    bfs::path path_;
+};
+
+void append_numbered(sst::log_segmented_owner<struct_B>& owner, sst::log_index count)
+{
+    for (sst::log_index number = 0; number < count; ++number)
+    {
+	boost::optional<sst::log_index> index = owner.append(struct_B("blah", true, number, 1.0 * number));
+	ASSERT_TRUE(index) << "append failed";
+	ASSERT_EQ(number, index.get()) << "index is not the number of entries appended before";
+    }
+}
+
+} // anonymous namespace
+
+TEST(log_segmented_test, rolls_over_to_new_segments)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE);
+    sst::log_segmented_reader<struct_B> reader(directory.get_path());
+    EXPECT_FALSE(reader.get_back_index()) << "back index is defined for an empty log";
+    sst::log_index capacity = owner.get_segment_capacity();
+    ASSERT_LT(0U, capacity) << "segment holds no entries";
+    append_numbered(owner, 3 * capacity + 5);
+    EXPECT_EQ(4U, owner.get_segment_count()) << "log did not roll over once per full segment";
+    EXPECT_TRUE(bfs::exists(directory.get_path() / "segment.3")) << "newest segment file is missing";
+    EXPECT_EQ(0U, reader.get_front_index().get()) << "front index is not the first entry";
+    EXPECT_EQ(3 * capacity + 4, reader.get_back_index().get()) << "back index is not the last entry";
+    for (sst::log_index index = 0; index <= reader.get_back_index().get(); ++index)
+    {
+	boost::optional<const struct_B&> entry = reader.read(index);
+	ASSERT_TRUE(entry) << "entry could not be read";
+	EXPECT_EQ(static_cast<boost::int32_t>(index), entry->value2) << "entry read does not match entry appended";
+    }
+    EXPECT_EQ(4U, reader.get_mapped_count()) << "reader did not map each segment it reached";
+    EXPECT_EQ(capacity - 1, reader.read_range(capacity + 1, 2 * capacity).size()) << "range crosses the end of a segment";
+}
+
+TEST(log_segmented_test, retention_by_count)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE, sst::log_retention().keep_count(2));
+    sst::log_segmented_reader<struct_B> reader(directory.get_path());
+    sst::log_index capacity = owner.get_segment_capacity();
+    append_numbered(owner, capacity + 1);
+    EXPECT_TRUE(reader.read(0U)) << "entry of a retained segment could not be read";
+    for (sst::log_index number = capacity + 1; number < 4 * capacity + 1; ++number)
+    {
+	ASSERT_TRUE(owner.append(struct_B("blah", true, number, 1.0 * number))) << "append failed";
+    }
+    EXPECT_EQ(2U, owner.get_segment_count()) << "retention did not keep the number of segments down";
+    EXPECT_FALSE(bfs::exists(directory.get_path() / "segment.2")) << "segment file was not deleted";
+    EXPECT_EQ(3 * capacity, reader.get_front_index().get()) << "front index did not follow the oldest segment retained";
+    EXPECT_FALSE(reader.read(0U)) << "entry of a deleted segment could still be read";
+    EXPECT_TRUE(reader.read(3 * capacity)) << "entry of a retained segment could not be read";
+    EXPECT_EQ(2U, reader.get_mapped_count()) << "reader kept a deleted segment mapped";
+}
+
+TEST(log_segmented_test, retention_below_checkpoints)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE, sst::log_retention().keep_count(2));
+    sst::log_segmented_reader<struct_B> reader(directory.get_path());
+    sst::log_index capacity = owner.get_segment_capacity();
+    EXPECT_EQ(capacity + 1, reader.set_checkpoint(capacity + 1)) << "checkpoint was not held at the index";
+    append_numbered(owner, 4 * capacity + 1);
+    EXPECT_EQ(4U, owner.get_segment_count()) << "retention removed the segment holding a checkpoint";
+    EXPECT_TRUE(reader.read(capacity + 1)) << "entry at the checkpoint could not be read";
+    EXPECT_EQ(capacity, reader.get_front_index().get()) << "front index did not follow the oldest segment retained";
+    EXPECT_EQ(capacity, reader.set_checkpoint(0U)) << "checkpoint set below the front was not moved up to it";
+    reader.set_checkpoint(3 * capacity);
+    owner.apply_retention();
+    EXPECT_EQ(2U, owner.get_segment_count()) << "retention held back by a checkpoint moved on";
+}
+
+TEST(log_segmented_test, checkpoint_of_exited_reader)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE);
+    sst::log_index capacity = owner.get_segment_capacity();
+    append_numbered(owner, 3 * capacity + 1);
+    pid_t child = fork();
+    ASSERT_NE(-1, child) << "fork failed";
+    if (child == 0)
+    {
+	// Exits without the reader going away, as a crashed reader would
+	sst::log_segmented_reader<struct_B>* reader = new sst::log_segmented_reader<struct_B>(directory.get_path());
+	reader->set_checkpoint(capacity + 1);
+	_exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0)) << "reader process was lost";
+    EXPECT_EQ(3 * capacity, owner.truncate_front(3 * capacity)) << "checkpoint outlived the process of its reader";
+    EXPECT_EQ(1U, owner.get_segment_count()) << "segments wholly below the front were retained";
+}
+
+TEST(log_segmented_test, retention_by_age)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE, sst::log_retention().keep_age(bpt::milliseconds(200)));
+    append_numbered(owner, 2 * owner.get_segment_capacity() + 1);
+    EXPECT_EQ(3U, owner.get_segment_count()) << "segments expired before their time";
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(300));
+    owner.apply_retention();
+    EXPECT_EQ(1U, owner.get_segment_count()) << "expired segments were retained";
+    EXPECT_EQ(2 * owner.get_segment_capacity(), owner.get_front_index().get()) << "front index did not follow the oldest segment retained";
+}
+
+TEST(log_segmented_test, truncate_front_below_checkpoints)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE);
+    sst::log_index capacity = owner.get_segment_capacity();
+    append_numbered(owner, 3 * capacity + 1);
+    {
+	sst::log_segmented_reader<struct_B> reader(directory.get_path());
+	reader.set_checkpoint(capacity + 1);
+	EXPECT_EQ(capacity + 1, owner.truncate_front(3 * capacity)) << "front moved past the checkpoint of a reader";
+	EXPECT_EQ(capacity + 1, reader.get_front_index().get()) << "front index does not reflect the truncation";
+	EXPECT_EQ(3U, owner.get_segment_count()) << "segments wholly below the front were retained";
+	EXPECT_FALSE(bfs::exists(directory.get_path() / "segment.0")) << "segment file was not deleted";
+	EXPECT_TRUE(reader.read(capacity + 1)) << "entry at the checkpoint could not be read";
+    }
+    EXPECT_EQ(3 * capacity, owner.truncate_front(3 * capacity)) << "checkpoint outlived its reader";
+    EXPECT_EQ(1U, owner.get_segment_count()) << "segments wholly below the front were retained";
+    EXPECT_EQ(3 * capacity + 1, owner.truncate_front(5 * capacity)) << "front moved past the back of the log";
+    EXPECT_EQ(1U, owner.get_segment_count()) << "segment being appended to was removed";
+}
+
+TEST(log_segmented_test, no_roll_over_segments_held)
+{
+    temp_directory directory;
+    sst::log_segmented_owner<struct_B> owner(directory.get_path(), SEGMENT_SIZE);
+    sst::log_segmented_reader<struct_B> reader(directory.get_path());
+    sst::log_index capacity = owner.get_segment_capacity();
+    reader.set_checkpoint(0U);
+    append_numbered(owner, sst::LOG_SEGMENT_LIMIT * capacity);
+    EXPECT_EQ(sst::LOG_SEGMENT_LIMIT, owner.get_segment_count()) << "segments held by a checkpoint were not retained";
+    EXPECT_THROW(owner.append(struct_B("blah")), sst::busy_condition) << "log rolled over the record of a segment held";
+    EXPECT_TRUE(reader.read(0U)) << "entry at the checkpoint could not be read";
+    reader.set_checkpoint(capacity);
+    EXPECT_EQ(sst::LOG_SEGMENT_LIMIT * capacity, owner.append(struct_B("blah")).get()) << "log did not roll over once the checkpoint moved on";
+    EXPECT_EQ(sst::LOG_SEGMENT_LIMIT, owner.get_segment_count()) << "retention kept the segment no longer held";
+}
@@ -832,3 +832,15 @@ TEST(multi_reader_ring_buffer_test, shm_multi_read_sequence)
 	client2.send_terminate(5U);
     }
 }
+
+TEST(multi_reader_ring_buffer_test, zero_capacity_rejected)
+{
+    typedef bip::allocator<boost::int32_t, bip::managed_mapped_file::segment_manager> allocator_t;
+    bfs::path path(bfs::absolute(bfs::unique_path()));
+    {
+	bip::managed_mapped_file memory(bip::create_only, path.string().c_str(), DEFAULT_SIZE);
+	EXPECT_THROW((sst::multi_reader_ring_buffer<boost::int32_t, allocator_t>(0U, memory.get_segment_manager())),
+		sst::storage_error) << "ring buffer that can hold nothing was created";
+    }
+    bfs::remove(path);
+}
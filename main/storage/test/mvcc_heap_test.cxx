@@ -0,0 +1,340 @@
+#include <cstring>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include "exception.hpp"
+#include "mvcc_heap.hpp"
+#include "mvcc_heap.hxx"
+
+namespace sst = supernova::storage;
+
+namespace {
+
+static const std::size_t HEAP_SIZE = 1 << 24;
+
+// The values of the mmap and shm tests, without the messages that carry them to the service
+struct string_value
+{
+    string_value(const char* value = "")
+    {
+	strncpy(c_str, value, sizeof(c_str) - 1);
+	c_str[sizeof(c_str) - 1] = '\0';
+    }
+    bool operator==(const string_value& other) const
+    {
+	return strncmp(c_str, other.c_str, sizeof(c_str)) == 0;
+    }
+    char c_str[64];
+};
+
+struct struct_value
+{
+    struct_value(bool a = true, boost::int32_t b = 0, double c = 0.0F) :
+	value1(a), value2(b), value3(c)
+    { }
+    bool operator==(const struct_value& other) const
+    {
+	return value1 == other.value1 && value2 == other.value2 && value3 == other.value3;
+    }
+    bool value1;
+    boost::int32_t value2;
+    double value3;
+};
+
+void read_until_done(sst::mvcc_heap_owner& owner, const boost::atomic<bool>& done, boost::atomic<std::size_t>& mismatches)
+{
+    sst::mvcc_heap_reader reader(owner);
+    while (!done)
+    {
+	const boost::optional<const struct_value&> actual = reader.read<struct_value>("heap_struct");
+	if (actual && actual->value2 != static_cast<boost::int32_t>(actual->value3))
+	{
+	    ++mismatches;
+	}
+    }
+}
+
+void read_inline_until_done(sst::mvcc_heap_owner& owner, const boost::atomic<bool>& done, boost::atomic<std::size_t>& mismatches)
+{
+    sst::mvcc_heap_reader reader(owner);
+    while (!done)
+    {
+	boost::optional<struct_value> actual = reader.read_inline<struct_value>("heap_inline");
+	if (actual && actual->value2 != static_cast<boost::int32_t>(actual->value3))
+	{
+	    ++mismatches;
+	}
+    }
+}
+
+} // anonymous namespace
+
+TEST(mvcc_heap_test, write_read_collect)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    const char* key = "heap_string";
+
+    EXPECT_FALSE(reader.exists<string_value>(key)) << "key exists before its first write";
+    owner.write<string_value>(key, string_value("abc"));
+    boost::uint64_t rev1 = reader.get_newest_revision<string_value>(key);
+    EXPECT_EQ(string_value("abc"), reader.read<string_value>(key).get()) << "value read is not the value written";
+    owner.write<string_value>(key, string_value("def"));
+    EXPECT_EQ(string_value("abc"), reader.read_at<string_value>(key, rev1).get()) << "older version was lost";
+    EXPECT_EQ(string_value("def"), reader.read<string_value>(key).get()) << "value read is not the value written";
+    EXPECT_EQ(2U, owner.get_history_depth<string_value>(key)) << "write did not add a version";
+
+    owner.process_read_metadata();
+    owner.collect_garbage();
+    EXPECT_EQ(1U, owner.get_history_depth<string_value>(key)) << "version older than every read was not collected";
+    EXPECT_EQ(std::vector<std::string>(1U, key), owner.get_registered_keys()) << "key was not registered";
+
+    owner.remove<string_value>(key);
+    EXPECT_FALSE(reader.exists<string_value>(key)) << "removed key still exists";
+}
+
+TEST(mvcc_heap_test, readers_on_threads)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    boost::atomic<bool> done(false);
+    boost::atomic<std::size_t> mismatches(0);
+    boost::thread_group readers;
+    for (std::size_t iter = 0; iter < 4U; ++iter)
+    {
+	readers.create_thread(boost::bind(&read_until_done, boost::ref(owner), boost::cref(done), boost::ref(mismatches)));
+    }
+    for (boost::int32_t iter = 0; iter < 10000; ++iter)
+    {
+	owner.write<struct_value>("heap_struct", struct_value(true, iter, iter));
+	if (iter % 100 == 0)
+	{
+	    owner.process_read_metadata();
+	    owner.collect_garbage();
+	}
+    }
+    done = true;
+    readers.join_all();
+    EXPECT_EQ(0U, mismatches.load()) << "a reader saw a partly written value";
+    EXPECT_EQ(9999, owner.read<struct_value>("heap_struct")->value2) << "value read is not the value written";
+}
+
+TEST(mvcc_heap_test, history_shares_reader_token)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    const char* key = "heap_history";
+    owner.write<string_value>(key, string_value("abc"));
+    boost::uint64_t rev1 = reader.get_newest_revision<string_value>(key);
+    owner.write<string_value>(key, string_value("def"));
+    owner.write<string_value>(key, string_value("ghi"));
+    boost::uint64_t rev3 = reader.get_newest_revision<string_value>(key);
+
+    EXPECT_EQ(string_value("abc"), reader.read_at<string_value>(key, rev1).get()) << "older version was lost";
+    EXPECT_EQ(rev1, reader.get_last_read_revision()) << "version read at a revision is not held";
+    sst::mvcc_history_iterator<string_value> iter = reader.history<string_value>(key);
+    ++iter;
+    boost::uint64_t rev2 = iter->revision;
+    EXPECT_EQ(rev2, reader.get_last_read_revision()) << "version pointed at is not held";
+    // Reading through the same handle moves the token off the version the iterator points at
+    reader.read<string_value>(key);
+    EXPECT_EQ(rev3, reader.get_last_read_revision()) << "read did not move the reader token";
+    ++iter;
+    EXPECT_EQ(rev1, iter->revision) << "history is not ordered from newest to oldest";
+    EXPECT_EQ(rev1, reader.get_last_read_revision()) << "incrementing did not hold the version pointed at";
+    ++iter;
+    EXPECT_TRUE(iter == sst::mvcc_history_iterator<string_value>()) << "history did not end after the oldest version";
+}
+
+TEST(mvcc_heap_test, read_many_across_groups)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    std::vector<std::string> names;
+    for (std::size_t iter = 0; iter < 20U; ++iter)
+    {
+	names.push_back(str(boost::format("heap_many_%1%") % iter));
+	// every third key is never written and every fifth one removed
+	if (iter % 3 != 0)
+	{
+	    owner.write<string_value>(names.back().c_str(), string_value(names.back().c_str()));
+	}
+	if (iter % 5 == 0)
+	{
+	    owner.remove<string_value>(names.back().c_str());
+	}
+    }
+    std::vector<const char*> keys;
+    for (std::vector<std::string>::const_iterator iter = names.begin(); iter != names.end(); ++iter)
+    {
+	keys.push_back(iter->c_str());
+    }
+    std::vector< boost::optional<const string_value&> > actual;
+    EXPECT_EQ(11U, reader.read_many<string_value>(keys, actual)) << "incorrect number of values read";
+    ASSERT_EQ(keys.size(), actual.size()) << "one result is not returned per key";
+    for (std::size_t iter = 0; iter < keys.size(); ++iter)
+    {
+	bool written = iter % 3 != 0 && iter % 5 != 0;
+	EXPECT_EQ(written, static_cast<bool>(actual[iter])) << "wrong key read at " << iter;
+	if (written && actual[iter])
+	{
+	    EXPECT_EQ(string_value(keys[iter]), actual[iter].get()) << "value read is not the value written";
+	}
+    }
+    EXPECT_EQ(reader.get_newest_revision<string_value>(keys[1]), reader.get_last_read_revision())
+	    << "last read revision is not the oldest revision of the batch";
+}
+
+TEST(mvcc_heap_test, collect_dispatches_on_type)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    const char* string_key = "heap_typed_string";
+    const char* struct_key = "heap_typed_struct";
+    EXPECT_NE(sst::mvcc_type_table::hash_type_name(typeid(string_value).name()),
+	    sst::mvcc_type_table::hash_type_name(typeid(struct_value).name())) << "different types share a type id";
+    for (boost::int32_t iter = 0; iter < 2; ++iter)
+    {
+	owner.write<string_value>(string_key, string_value(str(boost::format("abc%1%") % iter).c_str()));
+	owner.write<struct_value>(struct_key, struct_value(true, iter, iter));
+    }
+    // enrolling a type already written must not add a second entry for it
+    owner.enroll_type<string_value>();
+    sst::mvcc_type_table::snapshot_type functions;
+    sst::mvcc_type_table::instance().snapshot(functions);
+    std::size_t string_entries = 0;
+    for (sst::mvcc_type_table::snapshot_type::const_iterator iter = functions.begin(); iter != functions.end(); ++iter)
+    {
+	if (iter->first == sst::mvcc_type_table::hash_type_name(typeid(string_value).name()))
+	{
+	    ++string_entries;
+	}
+    }
+    EXPECT_EQ(1U, string_entries) << "type was enrolled twice";
+
+    // the struct was written last, so every older version of either key is below what was read
+    reader.read<struct_value>(struct_key);
+    owner.process_read_metadata();
+    owner.collect_garbage();
+    EXPECT_EQ(1U, owner.get_history_depth<string_value>(string_key)) << "older versions were not collected";
+    EXPECT_EQ(1U, owner.get_history_depth<struct_value>(struct_key)) << "older versions were not collected";
+    EXPECT_EQ(string_value("abc1"), reader.read<string_value>(string_key).get()) << "newest version was collected";
+    EXPECT_EQ(1, reader.read<struct_value>(struct_key)->value2) << "newest version was collected";
+}
+
+TEST(mvcc_heap_test, collect_on_workers)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    sst::mvcc_gc_cursors cursors(4U);
+    std::vector<std::string> names;
+    for (std::size_t iter = 0; iter < 10U; ++iter)
+    {
+	names.push_back(str(boost::format("heap_workers_%1%") % iter));
+    }
+    // the same workers sweep every collection, fewer keys than workers included
+    for (boost::int32_t round = 0; round < 3; ++round)
+    {
+	std::size_t written = round ? names.size() : 2U;
+	for (std::size_t iter = 0; iter < written; ++iter)
+	{
+	    owner.write<struct_value>(names[iter].c_str(), struct_value(true, round, round));
+	    owner.write<struct_value>(names[iter].c_str(), struct_value(true, round + 1, round + 1));
+	}
+	// the key written last, so every older version is below what was read
+	reader.read<struct_value>(names[written - 1].c_str());
+	owner.process_read_metadata();
+	owner.collect_garbage(cursors, 1U);
+	// each sweep drops no more than the oldest version of every key
+	for (std::size_t sweep = 0; sweep < 3U; ++sweep)
+	{
+	    owner.collect_garbage(cursors);
+	}
+	for (std::size_t iter = 0; iter < written; ++iter)
+	{
+	    EXPECT_EQ(1U, owner.get_history_depth<struct_value>(names[iter].c_str())) << "older versions were not collected";
+	}
+    }
+}
+
+TEST(mvcc_heap_test, read_inline_on_threads)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    boost::atomic<bool> done(false);
+    boost::atomic<std::size_t> mismatches(0);
+    boost::thread_group readers;
+    for (std::size_t iter = 0; iter < 4U; ++iter)
+    {
+	readers.create_thread(boost::bind(&read_inline_until_done, boost::ref(owner), boost::cref(done), boost::ref(mismatches)));
+    }
+    // the slot being written is the one readers were on two writes ago, so they have to retry
+    // whenever a write lands during their copy rather than return half of each value
+    for (boost::int32_t iter = 0; iter < 100000; ++iter)
+    {
+	owner.write_inline<struct_value>("heap_inline", struct_value(true, iter, iter));
+    }
+    done = true;
+    readers.join_all();
+    EXPECT_EQ(0U, mismatches.load()) << "a reader saw a partly written value";
+    EXPECT_EQ(99999, owner.read_inline<struct_value>("heap_inline")->value2) << "value read is not the value written";
+}
+
+TEST(mvcc_heap_test, write_bulk_rejects_unordered_keys)
+{
+    typedef std::vector< std::pair<std::string, string_value> > run_t;
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    run_t run;
+    EXPECT_EQ(0U, owner.write_bulk<string_value>(run.begin(), run.end())) << "empty run loaded keys";
+
+    run.push_back(std::make_pair(std::string("heap_bulk_b"), string_value("abc")));
+    run.push_back(std::make_pair(std::string("heap_bulk_a"), string_value("abc")));
+    EXPECT_THROW(owner.write_bulk<string_value>(run.begin(), run.end()), sst::storage_error) << "keys out of order were loaded";
+    EXPECT_FALSE(reader.exists<string_value>("heap_bulk_a")) << "rejected run was partly loaded";
+    EXPECT_FALSE(reader.exists<string_value>("heap_bulk_b")) << "rejected run was partly loaded";
+
+    run[0].first = "heap_bulk_a";
+    EXPECT_THROW(owner.write_bulk<string_value>(run.begin(), run.end()), sst::storage_error) << "duplicate keys were loaded";
+    EXPECT_FALSE(reader.exists<string_value>("heap_bulk_a")) << "rejected run was partly loaded";
+    EXPECT_TRUE(owner.get_registered_keys().empty()) << "keys of a rejected run were registered";
+
+    run[1].first = "heap_bulk_b";
+    boost::uint64_t before = reader.get_journal_revision();
+    EXPECT_EQ(2U, owner.write_bulk<string_value>(run.begin(), run.end())) << "keys in order were not loaded";
+    EXPECT_TRUE(reader.exists<string_value>("heap_bulk_a")) << "loaded key does not exist";
+    EXPECT_TRUE(reader.exists<string_value>("heap_bulk_b")) << "loaded key does not exist";
+
+    std::vector<sst::mvcc_change> changes;
+    ASSERT_TRUE(reader.changes_since(before, changes)) << "changes of the load were dropped";
+    ASSERT_EQ(2U, changes.size()) << "load was not journalled once per key";
+    EXPECT_EQ("heap_bulk_a", changes[0].key) << "changes are not in load order";
+    EXPECT_EQ("heap_bulk_b", changes[1].key) << "changes are not in load order";
+    EXPECT_EQ(string_value("abc"), reader.read_at<string_value>("heap_bulk_a", changes[0].revision).get())
+	    << "loaded version not found at the revision journalled";
+}
+
+TEST(mvcc_heap_test, expiry_index_keeps_newest_entry_per_key)
+{
+    sst::mvcc_heap_owner owner(HEAP_SIZE);
+    sst::mvcc_heap_reader reader(owner);
+    const char* key = "heap_ttl";
+    // every rewrite leaves the previous entry behind until the index is compacted
+    for (std::size_t iter = 0; iter < 5000U; ++iter)
+    {
+	owner.write<string_value>(key, string_value("abc"), boost::posix_time::hours(1));
+	owner.process_read_metadata();
+	owner.collect_garbage();
+    }
+    EXPECT_GE(1024U, owner.get_pending_expiry_count()) << "entries of rewritten key were kept without bound";
+    EXPECT_EQ(string_value("abc"), reader.read<string_value>(key).get()) << "key expired before its time to live passed";
+
+    owner.write<string_value>(key, string_value("def"), boost::posix_time::microseconds(1));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    owner.collect_garbage();
+    EXPECT_FALSE(reader.exists<string_value>(key)) << "key was not expired once its newest entry was due";
+}
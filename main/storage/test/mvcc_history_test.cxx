@@ -0,0 +1,180 @@
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <gtest/gtest.h>
+#include "exception.hpp"
+#include "mvcc_memory.hpp"
+#include "mvcc_memory.hxx"
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+namespace bpt = boost::posix_time;
+namespace sst = supernova::storage;
+
+namespace {
+
+typedef sst::mvcc_history<boost::int32_t> history_t;
+
+static const std::size_t FILE_SIZE = 1 << 20;
+static const bpt::ptime EPOCH(boost::gregorian::date(2020, 1, 1));
+
+// Version n has revision and value 10 * n and is written n seconds after the epoch
+void push(history_t& history, boost::int32_t n)
+{
+    sst::mvcc_revision revision = 10 * n;
+    bpt::ptime timestamp(EPOCH + bpt::seconds(n));
+    history.emplace_front(boost::bind<void>(sst::mvcc_value_copier<boost::int32_t>(10 * n), _1, revision, timestamp),
+	    revision, timestamp);
+}
+
+boost::int32_t value_at(const history_t& history, sst::mvcc_revision revision)
+{
+    boost::optional<const sst::mvcc_value<boost::int32_t>&> result = history.find_by_revision(revision);
+    return result ? result->value : -1;
+}
+
+boost::int32_t value_as_of(const history_t& history, const bpt::ptime& timestamp)
+{
+    boost::optional<const sst::mvcc_value<boost::int32_t>&> result = history.find_by_timestamp(timestamp);
+    return result ? result->value : -1;
+}
+
+class mapped_file
+{
+public:
+    mapped_file() :
+	path_(bfs::absolute(bfs::unique_path())),
+	file_(bip::create_only, path_.string().c_str(), FILE_SIZE)
+    { }
+    ~mapped_file()
+    {
+	bfs::remove(path_);
+    }
+    bip::managed_mapped_file::segment_manager* get_segment_manager()
+    {
+	return file_.get_segment_manager();
+    }
+private:
+    bfs::path path_;
+    bip::managed_mapped_file file_;
+};
+
+} // anonymous namespace
+
+TEST(mvcc_history_test, zero_capacity_rejected)
+{
+    mapped_file file;
+    EXPECT_THROW(history_t(0U, file.get_segment_manager()), sst::storage_error) << "history that can hold nothing was created";
+}
+
+TEST(mvcc_history_test, find_when_wrapped)
+{
+    mapped_file file;
+    history_t history(4U, file.get_segment_manager());
+    // six versions in four slots, so the newest ones have wrapped round to the start
+    for (boost::int32_t n = 1; n <= 6; ++n)
+    {
+	push(history, n);
+    }
+    ASSERT_EQ(4U, history.element_count()) << "full history did not overwrite its oldest versions";
+    EXPECT_EQ(60U, history.front_revision()) << "front is not the newest version";
+    EXPECT_EQ(30U, history.back_revision()) << "back is not the oldest version left";
+
+    EXPECT_EQ(-1, value_at(history, 29U)) << "version found before the oldest one left";
+    EXPECT_EQ(30, value_at(history, 30U)) << "oldest version not found at its revision";
+    EXPECT_EQ(30, value_at(history, 39U)) << "oldest version not found before the next one";
+    EXPECT_EQ(50, value_at(history, 55U)) << "wrong version found in the middle";
+    EXPECT_EQ(60, value_at(history, 60U)) << "newest version not found at its revision";
+    EXPECT_EQ(60, value_at(history, 1000U)) << "newest version not found after its revision";
+
+    EXPECT_EQ(-1, value_as_of(history, EPOCH + bpt::seconds(3) - bpt::microseconds(1))) << "version found before the oldest one left";
+    EXPECT_EQ(30, value_as_of(history, EPOCH + bpt::seconds(3))) << "oldest version not found at its timestamp";
+    EXPECT_EQ(50, value_as_of(history, EPOCH + bpt::milliseconds(5500))) << "wrong version found in the middle";
+    EXPECT_EQ(60, value_as_of(history, EPOCH + bpt::seconds(6))) << "newest version not found at its timestamp";
+    EXPECT_EQ(60, value_as_of(history, EPOCH + bpt::hours(1))) << "newest version not found after its timestamp";
+}
+
+TEST(mvcc_history_test, grow_when_wrapped)
+{
+    mapped_file file;
+    history_t history(4U, file.get_segment_manager());
+    for (boost::int32_t n = 1; n <= 6; ++n)
+    {
+	push(history, n);
+    }
+    history.grow(8U);
+    ASSERT_EQ(8U, history.capacity()) << "history did not grow";
+    ASSERT_EQ(4U, history.element_count()) << "versions were lost growing";
+    EXPECT_EQ(60U, history.front_revision()) << "front is not the newest version after growing";
+    EXPECT_EQ(30U, history.back_revision()) << "back is not the oldest version after growing";
+    EXPECT_EQ(30, value_at(history, 30U)) << "oldest version not found after growing";
+    EXPECT_EQ(40, value_at(history, 45U)) << "wrong version found after growing";
+    EXPECT_EQ(30, value_as_of(history, EPOCH + bpt::seconds(3))) << "oldest version not found after growing";
+    EXPECT_EQ(60, value_as_of(history, EPOCH + bpt::hours(1))) << "newest version not found after growing";
+
+    // the slots added by growing are used before anything is overwritten
+    for (boost::int32_t n = 7; n <= 10; ++n)
+    {
+	push(history, n);
+    }
+    EXPECT_EQ(8U, history.element_count()) << "grown history did not fill its new slots";
+    EXPECT_EQ(30, value_at(history, 30U)) << "version overwritten before the history was full";
+    EXPECT_EQ(100, value_at(history, 100U)) << "newest version not found";
+    push(history, 11);
+    EXPECT_EQ(-1, value_at(history, 30U)) << "full history did not overwrite its oldest version";
+    EXPECT_EQ(40U, history.back_revision()) << "back is not the oldest version left";
+}
+
+TEST(mvcc_history_test, pop_back_before_keeps_newest)
+{
+    mapped_file file;
+    history_t history(4U, file.get_segment_manager());
+    for (boost::int32_t n = 1; n <= 6; ++n)
+    {
+	push(history, n);
+    }
+    for (std::size_t iter = 0; iter < 4U; ++iter)
+    {
+	history.pop_back_before(1000U);
+    }
+    EXPECT_EQ(1U, history.element_count()) << "newest version was removed";
+    EXPECT_EQ(60, value_at(history, 60U)) << "newest version not found";
+    push(history, 7);
+    EXPECT_EQ(60, value_at(history, 65U)) << "version found is not the one before the revision";
+    EXPECT_EQ(70, value_as_of(history, EPOCH + bpt::seconds(7))) << "newest version not found at its timestamp";
+}
+
+TEST(mvcc_history_test, timestamps_never_go_down)
+{
+    mapped_file file;
+    history_t history(4U, file.get_segment_manager());
+    push(history, 1);
+    push(history, 3);
+    // written after the clock was set back
+    sst::mvcc_revision revision = 40U;
+    bpt::ptime timestamp(EPOCH + bpt::seconds(2));
+    history.emplace_front(boost::bind<void>(sst::mvcc_value_copier<boost::int32_t>(40), _1, revision, timestamp),
+	    revision, timestamp);
+    EXPECT_EQ(10, value_as_of(history, EPOCH + bpt::seconds(2))) << "version found is stamped with the clock set back";
+    EXPECT_EQ(40, value_as_of(history, EPOCH + bpt::seconds(3))) << "newest version is not the one found at the newest timestamp";
+}
+
+TEST(mvcc_history_test, coalesced_timestamps_never_go_down)
+{
+    mapped_file file;
+    history_t history(4U, file.get_segment_manager());
+    push(history, 1);
+    push(history, 2);
+    push(history, 3);
+    // overwrites the newest version in place, as nothing has read it, after the clock was set back
+    sst::mvcc_revision revision = 40U;
+    bpt::ptime timestamp(EPOCH + bpt::milliseconds(1500));
+    history.emplace_front_coalesced(boost::bind<void>(sst::mvcc_value_copier<boost::int32_t>(40), _1, revision, timestamp),
+	    revision, timestamp);
+    ASSERT_EQ(3U, history.element_count()) << "unread newest version was not overwritten";
+    EXPECT_EQ(10, value_as_of(history, EPOCH + bpt::milliseconds(1500))) << "version found is stamped with the clock set back";
+    EXPECT_EQ(40, value_as_of(history, EPOCH + bpt::seconds(2))) << "newest version is not the one found at the newest timestamp";
+    EXPECT_EQ(40, value_at(history, 40U)) << "newest version not found at its revision";
+}
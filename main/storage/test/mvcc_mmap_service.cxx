@@ -1,6 +1,7 @@
 #include <istream>
 #include <ostream>
 #include <fstream>
+#include <map>
 #include <string>
 #include <sstream>
 #include <stdexcept>
@@ -15,6 +16,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/function.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/sync/file_lock.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/program_options/errors.hpp>
@@ -27,6 +29,7 @@
 #include <boost/ref.hpp>
 #include <boost/signals2.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/utility/in_place_factory.hpp>
 #include <google/protobuf/message.h>
 #include <supernova/core/compiler_extensions.hpp>
 #include <supernova/core/signal_notifier.hpp>
@@ -112,15 +115,16 @@ inline std::istream& operator>>(std::istream& in, ipc::type& target)
 
 struct config
 {
-    config() : ipc(ipc::shm), port(DEFAULT_PORT), size(DEFAULT_SIZE) { }
+    config() : ipc(ipc::shm), port(DEFAULT_PORT), size(DEFAULT_SIZE), readers(sst::MVCC_READER_LIMIT) { }
     config(ipc::type ipc_, const std::string& name_, port_t port_ = DEFAULT_PORT,
-	    size_t size_ = DEFAULT_SIZE) :
-    	ipc(ipc_), name(name_), port(port_), size(size_)
+	    size_t size_ = DEFAULT_SIZE, sst::reader_token_id readers_ = sst::MVCC_READER_LIMIT) :
+    	ipc(ipc_), name(name_), port(port_), size(size_), readers(readers_)
     { }
     ipc::type ipc;
     std::string name;
     port_t port;
     size_t size;
+    sst::reader_token_id readers;
 };
 
 typedef boost::optional<config> parse_result;
@@ -136,6 +140,8 @@ parse_result parse_cmd_line(const int argc, char* const argv[], std::ostringstre
                     "Port number to listen on")
             ("size,s", bpo::value<size_t>(&tmp.size)->default_value(DEFAULT_SIZE),
                     "Size of ring buffer in bytes")
+            ("readers,r", bpo::value<sst::reader_token_id>(&tmp.readers)->default_value(sst::MVCC_READER_LIMIT),
+                    "Maximum number of readers")
             ("ipc,i", bpo::value<ipc::type>(&tmp.ipc)->required(),
                     "IPC method: (shm|mmap)")
             ("name,n", bpo::value<std::string>(&tmp.name)->required(),
@@ -164,6 +170,11 @@ parse_result parse_cmd_line(const int argc, char* const argv[], std::ostringstre
     return result;
 }
 
+void fill_struct_value(sst::struct_value& value, const sst::write_struct_instr& instr)
+{
+    value = instr;
+}
+
 class mvcc_service
 {
 public:
@@ -197,9 +208,19 @@ private:
     void exec_get_registered_keys(const sst::get_registered_keys_instr& input, sst::result_msg& output);
     void exec_get_string_history_depth(const sst::get_string_history_depth_instr& input, sst::result_msg& output);
     void exec_get_struct_history_depth(const sst::get_struct_history_depth_instr& input, sst::result_msg& output);
+    void exec_write_struct_with(const sst::write_struct_instr& input, sst::result_msg& output);
+    void exec_collect_garbage_parallel(const sst::collect_garbage_parallel_instr& input, sst::result_msg& output);
+    void exec_write_struct_inline(const sst::write_struct_instr& input, sst::result_msg& output);
+    void exec_remove_struct_inline(const sst::remove_struct_instr& input, sst::result_msg& output);
+    void exec_write_string_bulk(const sst::write_string_bulk_instr& input, sst::result_msg& output);
+    void exec_write_string_if(const sst::write_string_if_instr& input, sst::result_msg& output);
+    void exec_remove_string_if(const sst::remove_string_if_instr& input, sst::result_msg& output);
+    void exec_write_string_ttl(const sst::write_string_ttl_instr& input, sst::result_msg& output);
+    void exec_write_string_coalesced(const sst::write_string_coalesced_instr& input, sst::result_msg& output);
     sst::instruction_msg instr_;
     sst::result_msg result_;
     sst::mvcc_mmap_owner owner_;
+    boost::optional<sst::mvcc_gc_cursors> gc_cursors_;
     sco::signal_notifier notifier_;
     scm::request_reply_service service_;
 };
@@ -207,7 +228,8 @@ private:
 mvcc_service::mvcc_service(const config& config) :
     instr_(),
     result_(),
-    owner_(bfs::path(config.name.c_str()), config.size),
+    owner_(bfs::path(config.name.c_str()), config.size, config.readers),
+    gc_cursors_(),
     notifier_(),
     service_("127.0.0.1", config.port, sizeof(instr_), sizeof(result_))
 {
@@ -339,6 +361,42 @@ void mvcc_service::receive_instruction(const scm::request_reply_service::source&
     {
 	exec_get_struct_history_depth(instr_.get_get_struct_history_depth(), result_);
     }
+    else if (instr_.is_write_struct_with())
+    {
+	exec_write_struct_with(instr_.get_write_struct_with(), result_);
+    }
+    else if (instr_.is_collect_garbage_parallel())
+    {
+	exec_collect_garbage_parallel(instr_.get_collect_garbage_parallel(), result_);
+    }
+    else if (instr_.is_write_struct_inline())
+    {
+	exec_write_struct_inline(instr_.get_write_struct_inline(), result_);
+    }
+    else if (instr_.is_remove_struct_inline())
+    {
+	exec_remove_struct_inline(instr_.get_remove_struct_inline(), result_);
+    }
+    else if (instr_.is_write_string_bulk())
+    {
+	exec_write_string_bulk(instr_.get_write_string_bulk(), result_);
+    }
+    else if (instr_.is_write_string_if())
+    {
+	exec_write_string_if(instr_.get_write_string_if(), result_);
+    }
+    else if (instr_.is_remove_string_if())
+    {
+	exec_remove_string_if(instr_.get_remove_string_if(), result_);
+    }
+    else if (instr_.is_write_string_ttl())
+    {
+	exec_write_string_ttl(instr_.get_write_string_ttl(), result_);
+    }
+    else if (instr_.is_write_string_coalesced())
+    {
+	exec_write_string_coalesced(instr_.get_write_string_coalesced(), result_);
+    }
     else
     {
 	sst::malformed_message_result tmp;
@@ -561,6 +619,91 @@ void mvcc_service::exec_get_struct_history_depth(const sst::get_struct_history_d
     output.set_size(tmp);
 }
 
+void mvcc_service::exec_write_struct_with(const sst::write_struct_instr& input, sst::result_msg& output)
+{
+    sst::confirmation_result tmp;
+    tmp.set_sequence(input.sequence());
+    owner_.write_with<sst::struct_value>(input.key().c_str(), boost::bind(&fill_struct_value, _1, boost::cref(input)));
+    output.set_confirmation(tmp);
+}
+
+void mvcc_service::exec_collect_garbage_parallel(const sst::collect_garbage_parallel_instr& input, sst::result_msg& output)
+{
+    sst::confirmation_result tmp;
+    tmp.set_sequence(input.sequence());
+    if (!gc_cursors_ || gc_cursors_.get().get_worker_count() != input.workers())
+    {
+	gc_cursors_ = boost::in_place(input.workers());
+    }
+    owner_.collect_garbage(gc_cursors_.get(), input.max_attempts());
+    output.set_confirmation(tmp);
+}
+
+void mvcc_service::exec_write_struct_inline(const sst::write_struct_instr& input, sst::result_msg& output)
+{
+    sst::confirmation_result tmp;
+    tmp.set_sequence(input.sequence());
+    sst::struct_value value(input.value1(), input.value2(), input.value3());
+    owner_.write_inline<sst::struct_value>(input.key().c_str(), value);
+    output.set_confirmation(tmp);
+}
+
+void mvcc_service::exec_remove_struct_inline(const sst::remove_struct_instr& input, sst::result_msg& output)
+{
+    sst::confirmation_result tmp;
+    tmp.set_sequence(input.sequence());
+    owner_.remove_inline<sst::struct_value>(input.key().c_str());
+    output.set_confirmation(tmp);
+}
+
+void mvcc_service::exec_write_string_bulk(const sst::write_string_bulk_instr& input, sst::result_msg& output)
+{
+    sst::size_result tmp;
+    tmp.set_sequence(input.sequence());
+    std::map<std::string, sst::string_value> run;
+    for (int index = 0; index < input.key_size() && index < input.value_size(); ++index)
+    {
+	run[input.key(index)] = sst::string_value(input.value(index).c_str());
+    }
+    tmp.set_size(owner_.write_bulk<sst::string_value>(run.begin(), run.end()));
+    output.set_size(tmp);
+}
+
+void mvcc_service::exec_write_string_if(const sst::write_string_if_instr& input, sst::result_msg& output)
+{
+    sst::predicate_result tmp;
+    tmp.set_sequence(input.sequence());
+    sst::string_value value(input.value().c_str());
+    tmp.set_predicate(owner_.write_if<sst::string_value>(input.key().c_str(), value, input.expected_revision()));
+    output.set_predicate(tmp);
+}
+
+void mvcc_service::exec_remove_string_if(const sst::remove_string_if_instr& input, sst::result_msg& output)
+{
+    sst::predicate_result tmp;
+    tmp.set_sequence(input.sequence());
+    tmp.set_predicate(owner_.remove_if<sst::string_value>(input.key().c_str(), input.expected_revision()));
+    output.set_predicate(tmp);
+}
+
+void mvcc_service::exec_write_string_ttl(const sst::write_string_ttl_instr& input, sst::result_msg& output)
+{
+    sst::confirmation_result tmp;
+    tmp.set_sequence(input.sequence());
+    sst::string_value value(input.value().c_str());
+    owner_.write<sst::string_value>(input.key().c_str(), value, boost::posix_time::milliseconds(input.ttl_milliseconds()));
+    output.set_confirmation(tmp);
+}
+
+void mvcc_service::exec_write_string_coalesced(const sst::write_string_coalesced_instr& input, sst::result_msg& output)
+{
+    sst::confirmation_result tmp;
+    tmp.set_sequence(input.sequence());
+    sst::string_value value(input.value().c_str());
+    owner_.write_coalesced<sst::string_value>(input.key().c_str(), value);
+    output.set_confirmation(tmp);
+}
+
 } // anonymous namespace
 
 int main(int argc, char* argv[])
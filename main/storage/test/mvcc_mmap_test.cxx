@@ -1,19 +1,25 @@
+#include <algorithm>
 #include <iostream>
 #include <exception>
 #include <spawn.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <string>
+#include <limits>
 #include <vector>
 #include <boost/array.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/assign/list_of.hpp>
 #include <boost/atomic.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
 #include <boost/lockfree/queue.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/barrier.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/thread_time.hpp>
 #include <gtest/gtest.h>
@@ -99,15 +105,16 @@ inline std::istream& operator>>(std::istream& in, ipc::type& target)
 
 struct config
 {
-    config() : ipc(ipc::shm), port(DEFAULT_PORT), size(DEFAULT_SIZE) { }
+    config() : ipc(ipc::shm), port(DEFAULT_PORT), size(DEFAULT_SIZE), readers(sst::MVCC_READER_LIMIT) { }
     config(ipc::type ipc_, const std::string& name_, port_t port_ = DEFAULT_PORT,
-	    size_t size_ = DEFAULT_SIZE) :
-    	ipc(ipc_), name(name_), port(port_), size(size_)
+	    size_t size_ = DEFAULT_SIZE, sst::reader_token_id readers_ = sst::MVCC_READER_LIMIT) :
+    	ipc(ipc_), name(name_), port(port_), size(size_), readers(readers_)
     { }
     ipc::type ipc;
     std::string name;
     port_t port;
     size_t size;
+    sst::reader_token_id readers;
 };
 
 class service_client
@@ -129,6 +136,15 @@ public:
     std::vector<std::string> send_get_registered_keys(boost::uint32_t sequence);
     std::size_t send_get_string_history_depth(boost::uint32_t sequence, const char* key);
     std::size_t send_get_struct_history_depth(boost::uint32_t sequence, const char* key);
+    void send_write_struct_with(boost::uint32_t sequence, const char* key, const sst::struct_value& value);
+    void send_collect_garbage_parallel(boost::uint32_t sequence, boost::uint32_t workers, std::size_t max_attempts = 0);
+    void send_write_struct_inline(boost::uint32_t sequence, const char* key, const sst::struct_value& value);
+    void send_remove_struct_inline(boost::uint32_t sequence, const char* key);
+    std::size_t send_write_string_bulk(boost::uint32_t sequence, const std::vector<std::string>& keys, const std::vector<sst::string_value>& values);
+    bool send_write_string_if(boost::uint32_t sequence, const char* key, const sst::string_value& value, boost::uint64_t expected_revision);
+    bool send_remove_string_if(boost::uint32_t sequence, const char* key, boost::uint64_t expected_revision);
+    void send_write_string_ttl(boost::uint32_t sequence, const char* key, const sst::string_value& value, boost::uint32_t ttl_milliseconds);
+    void send_write_string_coalesced(boost::uint32_t sequence, const char* key, const sst::string_value& value);
 private:
     bool terminate_sent_;
     scm::request_reply_client client_;
@@ -333,6 +349,134 @@ std::size_t service_client::send_get_struct_history_depth(boost::uint32_t sequen
     return outmsg.get_size().size();
 }
 
+void service_client::send_write_struct_with(boost::uint32_t sequence, const char* key, const sst::struct_value& value)
+{
+    sst::instruction_msg inmsg;
+    sst::write_struct_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value1(value.value1);
+    instr.set_value2(value.value2);
+    instr.set_value3(value.value3);
+    inmsg.set_write_struct_with(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected write_with result";
+    EXPECT_EQ(inmsg.get_write_struct_with().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+void service_client::send_collect_garbage_parallel(boost::uint32_t sequence, boost::uint32_t workers, std::size_t max_attempts)
+{
+    sst::instruction_msg inmsg;
+    sst::collect_garbage_parallel_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_workers(workers);
+    instr.set_max_attempts(max_attempts);
+    inmsg.set_collect_garbage_parallel(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected collect_garbage_parallel result";
+    EXPECT_EQ(inmsg.get_collect_garbage_parallel().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+void service_client::send_write_struct_inline(boost::uint32_t sequence, const char* key, const sst::struct_value& value)
+{
+    sst::instruction_msg inmsg;
+    sst::write_struct_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value1(value.value1);
+    instr.set_value2(value.value2);
+    instr.set_value3(value.value3);
+    inmsg.set_write_struct_inline(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected write_inline result";
+    EXPECT_EQ(inmsg.get_write_struct_inline().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+void service_client::send_remove_struct_inline(boost::uint32_t sequence, const char* key)
+{
+    sst::instruction_msg inmsg;
+    sst::remove_struct_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    inmsg.set_remove_struct_inline(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected remove_inline result";
+    EXPECT_EQ(inmsg.get_remove_struct_inline().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+std::size_t service_client::send_write_string_bulk(boost::uint32_t sequence, const std::vector<std::string>& keys, const std::vector<sst::string_value>& values)
+{
+    sst::instruction_msg inmsg;
+    sst::write_string_bulk_instr instr;
+    instr.set_sequence(sequence);
+    for (std::size_t index = 0; index < keys.size() && index < values.size(); ++index)
+    {
+	instr.add_key(keys[index]);
+	instr.add_value(values[index].c_str);
+    }
+    inmsg.set_write_string_bulk(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_size()) << "unexpected write_bulk result";
+    EXPECT_EQ(inmsg.get_write_string_bulk().sequence(), outmsg.get_size().sequence()) << "sequence number mismatch";
+    return outmsg.get_size().size();
+}
+
+bool service_client::send_write_string_if(boost::uint32_t sequence, const char* key, const sst::string_value& value, boost::uint64_t expected_revision)
+{
+    sst::instruction_msg inmsg;
+    sst::write_string_if_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value(value.c_str);
+    instr.set_expected_revision(expected_revision);
+    inmsg.set_write_string_if(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_predicate()) << "unexpected write_if result";
+    EXPECT_EQ(inmsg.get_write_string_if().sequence(), outmsg.get_predicate().sequence()) << "sequence number mismatch";
+    return outmsg.get_predicate().predicate();
+}
+
+bool service_client::send_remove_string_if(boost::uint32_t sequence, const char* key, boost::uint64_t expected_revision)
+{
+    sst::instruction_msg inmsg;
+    sst::remove_string_if_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_expected_revision(expected_revision);
+    inmsg.set_remove_string_if(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_predicate()) << "unexpected remove_if result";
+    EXPECT_EQ(inmsg.get_remove_string_if().sequence(), outmsg.get_predicate().sequence()) << "sequence number mismatch";
+    return outmsg.get_predicate().predicate();
+}
+
+void service_client::send_write_string_ttl(boost::uint32_t sequence, const char* key, const sst::string_value& value, boost::uint32_t ttl_milliseconds)
+{
+    sst::instruction_msg inmsg;
+    sst::write_string_ttl_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value(value.c_str);
+    instr.set_ttl_milliseconds(ttl_milliseconds);
+    inmsg.set_write_string_ttl(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected write result";
+    EXPECT_EQ(inmsg.get_write_string_ttl().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+void service_client::send_write_string_coalesced(boost::uint32_t sequence, const char* key, const sst::string_value& value)
+{
+    sst::instruction_msg inmsg;
+    sst::write_string_coalesced_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value(value.c_str);
+    inmsg.set_write_string_coalesced(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected write result";
+    EXPECT_EQ(inmsg.get_write_string_coalesced().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
 class service_launcher
 {
 public:
@@ -369,6 +513,15 @@ service_launcher::service_launcher(const config& config) :
     size_buf << config.size;
     strncpy(size_arg.c_array(), size_buf.str().c_str(), size_arg.max_size());
 
+    static const char READERS_OPT[] = "--readers";
+    boost::array<char, sizeof(READERS_OPT)> readers_opt;
+    strncpy(readers_opt.c_array(), READERS_OPT, readers_opt.max_size());
+
+    boost::array<char, std::numeric_limits<sst::reader_token_id>::digits> readers_arg;
+    std::ostringstream readers_buf;
+    readers_buf << config.readers;
+    strncpy(readers_arg.c_array(), readers_buf.str().c_str(), readers_arg.max_size());
+
     // TODO: calculate the array size properly with constexpr after moving to C++11
     boost::array<char, 256> ipc_arg;
     std::ostringstream ipc_buf;
@@ -378,10 +531,11 @@ service_launcher::service_launcher(const config& config) :
     std::vector<char> name_arg(config.name.size() + 1, '\0');
     std::copy(config.name.begin(), config.name.end(), name_arg.begin());
 
-    boost::array<char*, 9> arg_list = boost::assign::list_of
+    boost::array<char*, 11> arg_list = boost::assign::list_of
     		(launcher_name.c_array())
 		(port_opt.c_array())(port_arg.c_array())
 		(size_opt.c_array())(size_arg.c_array())
+		(readers_opt.c_array())(readers_arg.c_array())
 		(ipc_arg.c_array())
 		(&name_arg[0])
 		(0);
@@ -425,6 +579,30 @@ int service_launcher::wait()
     return exit_code;
 }
 
+void read_string_from_cache(sst::mvcc_mmap_reader_cache& cache, const char* key, sst::string_value& value, sst::reader_token_id& token_id)
+{
+    sst::mvcc_mmap_reader_cache::reader_type& reader = cache.get_thread_reader();
+    const boost::optional<const sst::string_value&> result = reader.read<sst::string_value>(key);
+    if (result)
+    {
+	value = result.get();
+    }
+    token_id = reader.get_reader_token_id();
+}
+
+void read_string_until_cache_gone(sst::mvcc_mmap_reader_cache& cache, const char* key, sst::string_value& value, boost::barrier& barrier)
+{
+    sst::mvcc_mmap_reader_cache::reader_type& reader = cache.get_thread_reader();
+    const boost::optional<const sst::string_value&> result = reader.read<sst::string_value>(key);
+    if (result)
+    {
+	value = result.get();
+    }
+    // the lease of this thread outlives the cache
+    barrier.wait();
+    barrier.wait();
+}
+
 } // anonymous namespace
 
 TEST(mvcc_mmap_test, startup_and_shutdown_benchmark)
@@ -686,23 +864,23 @@ TEST(mvcc_mmap_test, process_write_metadata_multi_key)
     client.send_terminate(30U);
 }
 
-TEST(mvcc_mmap_test, process_write_metadata_subset)
+TEST(mvcc_mmap_test, registered_on_first_write)
 {
     config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
     service_launcher launcher(conf);
     service_client client(conf);
-    std::string keyA("process_write_metadata_A");
-    std::string keyB("process_write_metadata_B");
-    std::string keyC("process_write_metadata_C");
+    std::string keyA("registered_on_first_write_A");
+    std::string keyB("registered_on_first_write_B");
+    std::string keyC("registered_on_first_write_C");
 
     sst::string_value valueC1("abc123");
     client.send_write_string(10U, keyC.c_str(), valueC1);
     sst::string_value valueB1("def123");
     client.send_write_string(11U, keyB.c_str(), valueB1);
-    client.send_process_write_metadata(12U, 1U);
-    std::vector<std::string> registered1(client.send_get_registered_keys(13U));
-    EXPECT_EQ(registered1.size(), 1U) << "incorrect number of registered values";
-    EXPECT_EQ(registered1.at(0), keyC) << "unexpected registered key";
+    std::vector<std::string> registered1(client.send_get_registered_keys(12U));
+    EXPECT_EQ(registered1.size(), 2U) << "incorrect number of registered values";
+    EXPECT_EQ(registered1.at(0), keyB) << "unexpected registered key";
+    EXPECT_EQ(registered1.at(1), keyC) << "unexpected registered key";
 
     sst::string_value valueC2("abc456");
     client.send_write_string(20U, keyC.c_str(), valueC2);
@@ -710,18 +888,12 @@ TEST(mvcc_mmap_test, process_write_metadata_subset)
     client.send_write_string(21U, keyA.c_str(), valueA1);
     client.send_process_write_metadata(22U, 1U);
     std::vector<std::string> registered2(client.send_get_registered_keys(23U));
-    EXPECT_EQ(registered2.size(), 2U) << "incorrect number of registered values";
-    EXPECT_EQ(registered2.at(0), keyB) << "unexpected registered key";
-    EXPECT_EQ(registered2.at(1), keyC) << "unexpected registered key";
-
-    client.send_process_write_metadata(40U, 5U);
-    std::vector<std::string> registered3(client.send_get_registered_keys(41U));
-    EXPECT_EQ(registered3.size(), 3U) << "incorrect number of registered values";
-    EXPECT_EQ(registered3.at(0), keyA) << "unexpected registered key";
-    EXPECT_EQ(registered3.at(1), keyB) << "unexpected registered key";
-    EXPECT_EQ(registered3.at(2), keyC) << "unexpected registered key";
+    EXPECT_EQ(registered2.size(), 3U) << "incorrect number of registered values";
+    EXPECT_EQ(registered2.at(0), keyA) << "unexpected registered key";
+    EXPECT_EQ(registered2.at(1), keyB) << "unexpected registered key";
+    EXPECT_EQ(registered2.at(2), keyC) << "unexpected registered key";
 
-    client.send_terminate(50U);
+    client.send_terminate(30U);
 }
 
 TEST(mvcc_mmap_test, collect_garbage_single_key_single_type)
@@ -1190,3 +1362,519 @@ TEST(mvcc_mmap_test, read_after_remove)
 
     client.send_terminate(30U);
 }
+
+TEST(mvcc_mmap_test, reader_limit)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string(), DEFAULT_PORT, DEFAULT_SIZE, 3U);
+    service_launcher launcher(conf);
+    service_client client(conf);
+    // the owner holds one of the reader tokens
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    sst::mvcc_mmap_reader readerB(bfs::path(conf.name.c_str()));
+    EXPECT_EQ(3U, readerA.get_reader_limit()) << "reader limit was not recorded";
+    EXPECT_THROW(sst::mvcc_mmap_reader readerC(bfs::path(conf.name.c_str())), sst::storage_condition) << "reader limit was exceeded";
+
+    const char* key = "reader_limit";
+    sst::string_value expected1("abc1");
+    client.send_write_string(10U, key, expected1);
+    const boost::optional<const sst::string_value&> readerA_actual1 = readerA.read<sst::string_value>(key);
+    EXPECT_TRUE(readerA_actual1) << "read failed";
+    EXPECT_EQ(readerA_actual1.get(), expected1) << "value read is not the value just written";
+    client.send_process_read_metadata(11U);
+    boost::uint64_t oldest_rev1 = client.send_get_global_oldest_revision_read(12U);
+    EXPECT_EQ(readerA.get_last_read_revision(), oldest_rev1) << "oldest global read revision is not correct";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, reader_cache_thread_local)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string(), DEFAULT_PORT, DEFAULT_SIZE, 6U);
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader_cache cache(bfs::path(conf.name.c_str()), 4U);
+    const char* key = "reader_cache_thread_local";
+
+    sst::string_value expected1("abc1");
+    client.send_write_string(10U, key, expected1);
+    sst::mvcc_mmap_reader_cache::reader_type& reader1 = cache.get_thread_reader();
+    EXPECT_EQ(&reader1, &cache.get_thread_reader()) << "thread local reader was not reused";
+    const boost::optional<const sst::string_value&> actual1 = reader1.read<sst::string_value>(key);
+    EXPECT_TRUE(actual1) << "read failed";
+    EXPECT_EQ(expected1, actual1.get()) << "value read is not the value just written";
+    EXPECT_EQ(4U, cache.get_reserved_count()) << "reader tokens were not reserved as a batch";
+
+    sst::string_value actual2;
+    sst::reader_token_id token2 = 0;
+    boost::thread thread2(boost::bind(&read_string_from_cache, boost::ref(cache), key, boost::ref(actual2), boost::ref(token2)));
+    thread2.join();
+    EXPECT_EQ(expected1, actual2) << "value read is not the value just written";
+    EXPECT_NE(reader1.get_reader_token_id(), token2) << "reader token was shared between live threads";
+
+    sst::string_value actual3;
+    sst::reader_token_id token3 = 0;
+    boost::thread thread3(boost::bind(&read_string_from_cache, boost::ref(cache), key, boost::ref(actual3), boost::ref(token3)));
+    thread3.join();
+    EXPECT_EQ(expected1, actual3) << "value read is not the value just written";
+    EXPECT_EQ(token2, token3) << "reader token of an exited thread was not reused";
+    EXPECT_EQ(4U, cache.get_reserved_count()) << "reader tokens were reserved from the memory again";
+    EXPECT_EQ(3U, cache.get_idle_count()) << "reader token of an exited thread was not returned to the cache";
+
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    EXPECT_THROW(sst::mvcc_mmap_reader readerB(bfs::path(conf.name.c_str())), sst::storage_condition) << "cached reader tokens were not reserved";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, reader_cache_outlived_by_thread)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string(), DEFAULT_PORT, DEFAULT_SIZE, 6U);
+    service_launcher launcher(conf);
+    service_client client(conf);
+    const char* key = "reader_cache_outlived_by_thread";
+    sst::string_value expected("abc1");
+    client.send_write_string(10U, key, expected);
+
+    sst::string_value actual;
+    boost::barrier barrier(2);
+    boost::scoped_ptr<sst::mvcc_mmap_reader_cache> cache(new sst::mvcc_mmap_reader_cache(bfs::path(conf.name.c_str()), 5U));
+    boost::thread thread(boost::bind(&read_string_until_cache_gone, boost::ref(*cache), key, boost::ref(actual), boost::ref(barrier)));
+    barrier.wait();
+    cache.reset();
+    barrier.wait();
+    thread.join();
+    EXPECT_EQ(expected, actual) << "value read is not the value just written";
+
+    // every token but the one of the service was given back, the one leased to the thread included
+    boost::ptr_vector<sst::mvcc_mmap_reader> readers;
+    for (std::size_t iter = 0; iter < 5U; ++iter)
+    {
+	EXPECT_NO_THROW(readers.push_back(new sst::mvcc_mmap_reader(bfs::path(conf.name.c_str())))) << "reader token of the cache was not given back";
+    }
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, read_at_and_as_of)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    const char* key = "read_at_and_as_of";
+
+    sst::string_value expected1("abc1");
+    client.send_write_string(10U, key, expected1);
+    boost::uint64_t rev1 = readerA.get_newest_revision<sst::string_value>(key);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    bpt::ptime time1 = bpt::microsec_clock::universal_time();
+    boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    sst::string_value expected2("abc2");
+    client.send_write_string(11U, key, expected2);
+    boost::uint64_t rev2 = readerA.get_newest_revision<sst::string_value>(key);
+    sst::string_value expected3("abc3");
+    client.send_write_string(12U, key, expected3);
+
+    const boost::optional<const sst::string_value&> actual1 = readerA.read_at<sst::string_value>(key, rev1);
+    EXPECT_TRUE(actual1) << "read at revision failed";
+    EXPECT_EQ(expected1, actual1.get()) << "value read is not the value of the requested revision";
+    EXPECT_EQ(rev1, readerA.get_last_read_revision()) << "last read revision was not updated for historical read";
+    const boost::optional<const sst::string_value&> actual2 = readerA.read_at<sst::string_value>(key, rev2);
+    EXPECT_TRUE(actual2) << "read at revision failed";
+    EXPECT_EQ(expected2, actual2.get()) << "value read is not the value of the requested revision";
+    const boost::optional<const sst::string_value&> actual3 = readerA.read_at<sst::string_value>(key, rev2 + 1000U);
+    EXPECT_TRUE(actual3) << "read at revision failed";
+    EXPECT_EQ(expected3, actual3.get()) << "value read is not the newest value before the requested revision";
+    EXPECT_FALSE(readerA.read_at<sst::string_value>(key, rev1 - 1U)) << "value read from before the first revision";
+
+    const boost::optional<const sst::string_value&> actual4 = readerA.read_as_of<sst::string_value>(key, time1);
+    EXPECT_TRUE(actual4) << "read as of timestamp failed";
+    EXPECT_EQ(expected1, actual4.get()) << "value read is not the newest value before the requested timestamp";
+    EXPECT_FALSE(readerA.read_as_of<sst::string_value>(key, time1 - bpt::hours(1))) << "value read from before the first write";
+
+    client.send_remove_string(13U, key);
+    EXPECT_FALSE(readerA.read_at<sst::string_value>(key, rev2)) << "historical value read after remove";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, history_newest_to_oldest)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    const char* key = "history_newest_to_oldest";
+    EXPECT_TRUE(readerA.history<sst::string_value>(key) == sst::mvcc_history_iterator<sst::string_value>()) << "history of a missing key is not empty";
+
+    std::vector<sst::string_value> expected;
+    for (boost::uint32_t iter = 0; iter < 5U; ++iter)
+    {
+	expected.push_back(sst::string_value(str(boost::format("abc%1%") % iter).c_str()));
+	client.send_write_string(10U + iter, key, expected.back());
+    }
+    std::vector<sst::string_value> actual;
+    boost::uint64_t previous_rev = std::numeric_limits<boost::uint64_t>::max();
+    for (sst::mvcc_history_iterator<sst::string_value> iter = readerA.history<sst::string_value>(key);
+	    iter != sst::mvcc_history_iterator<sst::string_value>(); ++iter)
+    {
+	EXPECT_LT(iter->revision, previous_rev) << "history is not ordered from newest to oldest";
+	previous_rev = iter->revision;
+	EXPECT_EQ(previous_rev, readerA.get_last_read_revision()) << "last read revision does not follow the history";
+	actual.push_back(iter->value);
+    }
+    std::reverse(actual.begin(), actual.end());
+    EXPECT_EQ(expected, actual) << "history does not hold every value written";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, read_many_multi_key)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    std::string key1("read_many_1");
+    std::string key2("read_many_2");
+    std::string key3("read_many_3");
+    std::string missingKey("read_many_missing");
+
+    sst::string_value expected1("abc1");
+    client.send_write_string(10U, key1.c_str(), expected1);
+    sst::string_value expected2("abc2");
+    client.send_write_string(11U, key2.c_str(), expected2);
+    sst::string_value expected3("abc3");
+    client.send_write_string(12U, key3.c_str(), expected3);
+    sst::string_value expected4("abc4");
+    client.send_write_string(13U, key1.c_str(), expected4);
+    client.send_remove_string(14U, key3.c_str());
+
+    std::vector<const char*> keys;
+    keys.push_back(key1.c_str());
+    keys.push_back(missingKey.c_str());
+    keys.push_back(key2.c_str());
+    keys.push_back(key3.c_str());
+    std::vector< boost::optional<const sst::string_value&> > actual;
+    EXPECT_EQ(2U, readerA.read_many<sst::string_value>(keys, actual)) << "incorrect number of values read";
+    ASSERT_EQ(keys.size(), actual.size()) << "one result is not returned per key";
+    EXPECT_TRUE(actual[0]) << "read failed";
+    EXPECT_EQ(expected4, actual[0].get()) << "value read is not the newest value written";
+    EXPECT_FALSE(actual[1]) << "value read for a key never written";
+    EXPECT_TRUE(actual[2]) << "read failed";
+    EXPECT_EQ(expected2, actual[2].get()) << "value read is not the newest value written";
+    EXPECT_FALSE(actual[3]) << "value read for a removed key";
+    EXPECT_EQ(readerA.get_newest_revision<sst::string_value>(key2.c_str()), readerA.get_last_read_revision())
+	    << "last read revision is not the oldest revision of the batch";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, write_with_in_place)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    const char* key = "write_with_in_place";
+
+    sst::struct_value expected1(false, 7, 3.5);
+    client.send_write_struct_with(10U, key, expected1);
+    ASSERT_TRUE(readerA.exists<sst::struct_value>(key)) << "write_with failed";
+    const boost::optional<const sst::struct_value&> actual1 = readerA.read<sst::struct_value>(key);
+    EXPECT_TRUE(actual1) << "read failed";
+    EXPECT_EQ(expected1, actual1.get()) << "value read is not the value just filled in";
+
+    sst::struct_value expected2(true, 8, 4.5);
+    client.send_write_struct(11U, key, expected2);
+    sst::struct_value expected3(false, 9, 5.5);
+    client.send_write_struct_with(12U, key, expected3);
+    EXPECT_EQ(3U, client.send_get_struct_history_depth(13U, key)) << "write_with did not add a version";
+    const boost::optional<const sst::struct_value&> actual3 = readerA.read<sst::struct_value>(key);
+    EXPECT_TRUE(actual3) << "read failed";
+    EXPECT_EQ(expected3, actual3.get()) << "value read is not the value just filled in";
+    EXPECT_EQ(expected1, actual1.get()) << "incorrect historical value";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, collect_garbage_parallel_ranges)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+
+    std::vector<std::string> keys;
+    for (std::size_t iter = 0; iter < 10U; ++iter)
+    {
+	keys.push_back(str(boost::format("collect_parallel_%1%") % iter));
+	client.send_write_string(10U, keys.back().c_str(), sst::string_value("abc"));
+	client.send_write_string(11U, keys.back().c_str(), sst::string_value("def"));
+	client.send_write_string(12U, keys.back().c_str(), sst::string_value("ghi"));
+    }
+    for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+    {
+	readerA.read<sst::string_value>(iter->c_str());
+    }
+    client.send_process_read_metadata(20U);
+    client.send_process_write_metadata(21U);
+
+    // 10 keys over 4 ranges gives ranges of 3, 3, 2 and 2 keys
+    client.send_collect_garbage_parallel(22U, 4U, 2U);
+    std::size_t collected = 0;
+    for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+    {
+	collected += 3U - client.send_get_string_history_depth(23U, iter->c_str());
+    }
+    EXPECT_EQ(8U, collected) << "each range did not stop after its own attempt limit";
+
+    client.send_collect_garbage_parallel(24U, 4U, 2U);
+    client.send_collect_garbage_parallel(25U, 4U);
+    for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+    {
+	EXPECT_EQ(1U, client.send_get_string_history_depth(26U, iter->c_str())) << "unused values were not collected";
+    }
+
+    client.send_terminate(30U);
+}
+
+TEST(mvcc_mmap_test, write_inline_newest_only)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    const char* key = "write_inline";
+
+    EXPECT_FALSE(readerA.read_inline<sst::struct_value>(key)) << "value read for a key never written";
+    sst::struct_value expected1(false, 7, 3.5);
+    client.send_write_struct_inline(10U, key, expected1);
+    boost::optional<sst::struct_value> actual1 = readerA.read_inline<sst::struct_value>(key);
+    ASSERT_TRUE(actual1) << "read failed";
+    EXPECT_EQ(expected1, actual1.get()) << "value read is not the value just written";
+
+    sst::struct_value expected2(true, 8, 4.5);
+    client.send_write_struct_inline(11U, key, expected2);
+    sst::struct_value expected3(false, 9, 5.5);
+    client.send_write_struct_inline(12U, key, expected3);
+    boost::optional<sst::struct_value> actual3 = readerA.read_inline<sst::struct_value>(key);
+    ASSERT_TRUE(actual3) << "read failed";
+    EXPECT_EQ(expected3, actual3.get()) << "value read is not the newest value written";
+    EXPECT_EQ(0U, readerA.get_last_read_revision()) << "inline read held a reader token";
+
+    client.send_remove_struct_inline(13U, key);
+    EXPECT_FALSE(readerA.read_inline<sst::struct_value>(key)) << "value read for a removed key";
+    client.send_write_struct_inline(14U, key, expected2);
+    boost::optional<sst::struct_value> actual2 = readerA.read_inline<sst::struct_value>(key);
+    ASSERT_TRUE(actual2) << "read failed";
+    EXPECT_EQ(expected2, actual2.get()) << "value read is not the value written after removal";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, write_bulk_single_revision)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+
+    client.send_write_string(10U, "write_bulk_1", sst::string_value("abc"));
+    boost::uint64_t previous_rev = readerA.get_newest_revision<sst::string_value>("write_bulk_1");
+    std::vector<std::string> keys;
+    std::vector<sst::string_value> values;
+    for (std::size_t iter = 0; iter < 5U; ++iter)
+    {
+	keys.push_back(str(boost::format("write_bulk_%1%") % iter));
+	values.push_back(sst::string_value(str(boost::format("value_%1%") % iter).c_str()));
+    }
+    EXPECT_EQ(keys.size(), client.send_write_string_bulk(11U, keys, values)) << "not every pair was loaded";
+
+    boost::uint64_t bulk_rev = readerA.get_newest_revision<sst::string_value>(keys.front().c_str());
+    EXPECT_LT(previous_rev, bulk_rev) << "bulk load revision is not newer than the existing versions";
+    for (std::size_t iter = 0; iter < keys.size(); ++iter)
+    {
+	const boost::optional<const sst::string_value&> actual = readerA.read<sst::string_value>(keys[iter].c_str());
+	EXPECT_TRUE(actual) << "read failed";
+	EXPECT_EQ(values[iter], actual.get()) << "value read is not the value loaded";
+	EXPECT_EQ(bulk_rev, readerA.get_newest_revision<sst::string_value>(keys[iter].c_str())) << "loaded versions do not share one revision";
+    }
+    EXPECT_EQ(2U, client.send_get_string_history_depth(12U, "write_bulk_1")) << "existing key did not get a new version";
+    EXPECT_EQ(keys, client.send_get_registered_keys(13U)) << "loaded keys were not registered";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, write_if_expected_revision)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    const char* key = "write_if";
+
+    sst::string_value expected1("abc");
+    EXPECT_FALSE(client.send_write_string_if(10U, key, expected1, 1U)) << "key never written matched a revision";
+    EXPECT_FALSE(readerA.exists<sst::string_value>(key)) << "failed write_if created the key";
+    EXPECT_TRUE(client.send_write_string_if(11U, key, expected1, 0U)) << "write_if of a new key failed";
+    boost::uint64_t rev1 = readerA.get_newest_revision<sst::string_value>(key);
+
+    sst::string_value expected2("def");
+    EXPECT_FALSE(client.send_write_string_if(12U, key, expected2, 0U)) << "existing key matched no revision";
+    EXPECT_FALSE(client.send_write_string_if(13U, key, expected2, rev1 + 1U)) << "write_if matched a wrong revision";
+    EXPECT_EQ(expected1, readerA.read<sst::string_value>(key).get()) << "failed write_if changed the value";
+    EXPECT_TRUE(client.send_write_string_if(14U, key, expected2, rev1)) << "write_if of the newest revision failed";
+    EXPECT_EQ(expected2, readerA.read<sst::string_value>(key).get()) << "value read is not the value written";
+    boost::uint64_t rev2 = readerA.get_newest_revision<sst::string_value>(key);
+    EXPECT_LT(rev1, rev2) << "write_if did not add a newer version";
+
+    EXPECT_FALSE(client.send_remove_string_if(15U, key, rev1)) << "remove_if matched a stale revision";
+    EXPECT_TRUE(readerA.exists<sst::string_value>(key)) << "failed remove_if removed the key";
+    EXPECT_TRUE(client.send_remove_string_if(16U, key, rev2)) << "remove_if of the newest revision failed";
+    EXPECT_FALSE(readerA.exists<sst::string_value>(key)) << "remove_if did not remove the key";
+    EXPECT_FALSE(client.send_write_string_if(17U, key, expected1, rev2)) << "removed key matched its last revision";
+    EXPECT_TRUE(client.send_write_string_if(18U, key, expected1, 0U)) << "write_if of a removed key failed";
+    EXPECT_EQ(expected1, readerA.read<sst::string_value>(key).get()) << "value read is not the value written";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, write_ttl_expires_on_collect)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    sst::string_value expected("abc");
+
+    client.send_write_string_ttl(10U, "ttl_short", expected, 250U);
+    client.send_write_string_ttl(11U, "ttl_long", expected, 3600U * 1000U);
+    client.send_write_string_ttl(12U, "ttl_rewritten", expected, 250U);
+    client.send_write_string(13U, "ttl_rewritten", expected);
+    client.send_write_string(14U, "ttl_none", expected);
+    client.send_process_read_metadata(15U);
+    client.send_collect_garbage(16U);
+    EXPECT_TRUE(readerA.exists<sst::string_value>("ttl_short")) << "key removed before its time to live passed";
+
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(400));
+    client.send_process_read_metadata(17U);
+    client.send_collect_garbage(18U);
+    EXPECT_FALSE(readerA.exists<sst::string_value>("ttl_short")) << "key not removed after its time to live passed";
+    EXPECT_TRUE(readerA.exists<sst::string_value>("ttl_long")) << "key removed before its time to live passed";
+    EXPECT_TRUE(readerA.exists<sst::string_value>("ttl_rewritten")) << "newer version without time to live was removed";
+    EXPECT_TRUE(readerA.exists<sst::string_value>("ttl_none")) << "key without time to live was removed";
+
+    client.send_write_string(19U, "ttl_short", expected);
+    EXPECT_TRUE(readerA.exists<sst::string_value>("ttl_short")) << "expired key could not be written again";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, changes_since_follows_writes)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    std::vector<sst::mvcc_change> changes;
+
+    EXPECT_TRUE(readerA.changes_since(0U, changes)) << "empty journal reported lost changes";
+    EXPECT_TRUE(changes.empty()) << "empty journal returned changes";
+
+    client.send_write_string(10U, "journal_a", sst::string_value("abc"));
+    client.send_write_string(11U, "journal_b", sst::string_value("abc"));
+    client.send_write_string(12U, "journal_a", sst::string_value("def"));
+    client.send_remove_string(13U, "journal_b");
+    EXPECT_TRUE(readerA.changes_since(0U, changes)) << "journal reported lost changes";
+    ASSERT_EQ(4U, changes.size()) << "not every change was returned";
+    EXPECT_EQ("journal_a", changes[0].key) << "changes are not in revision order";
+    EXPECT_EQ("journal_b", changes[1].key) << "changes are not in revision order";
+    EXPECT_EQ("journal_a", changes[2].key) << "changes are not in revision order";
+    EXPECT_EQ("journal_b", changes[3].key) << "changes are not in revision order";
+    EXPECT_FALSE(changes[2].removed) << "write reported as a removal";
+    EXPECT_TRUE(changes[3].removed) << "removal reported as a write";
+    EXPECT_EQ(readerA.get_newest_revision<sst::string_value>("journal_a"), changes[2].revision) << "change revision is not the version revision";
+    EXPECT_LT(changes[2].revision, changes[3].revision) << "removal is not ordered after the write";
+
+    std::vector<sst::mvcc_change> later;
+    EXPECT_TRUE(readerA.changes_since(changes[1].revision, later)) << "journal reported lost changes";
+    ASSERT_EQ(2U, later.size()) << "changes up to the revision were returned";
+    EXPECT_EQ(changes[2].revision, later[0].revision) << "first change after the revision is missing";
+    later.clear();
+    EXPECT_TRUE(readerA.changes_since(changes.back().revision, later)) << "journal reported lost changes";
+    EXPECT_TRUE(later.empty()) << "changes returned with nothing written since";
+
+    // more changes than the journal holds
+    for (boost::uint32_t iter = 0; iter < 1100U; ++iter)
+    {
+	client.send_write_string(100U + iter, "journal_c", sst::string_value("abc"));
+    }
+    EXPECT_FALSE(readerA.changes_since(changes.back().revision, later)) << "overwritten changes were not reported as lost";
+    EXPECT_TRUE(later.empty()) << "changes returned along with lost ones";
+    boost::uint64_t newest_rev = readerA.get_newest_revision<sst::string_value>("journal_c");
+    EXPECT_EQ(newest_rev, readerA.get_journal_revision()) << "journal revision is not the newest change";
+    EXPECT_TRUE(readerA.changes_since(newest_rev - 1U, later)) << "journal reported lost changes";
+    ASSERT_EQ(1U, later.size()) << "changes up to the revision were returned";
+    EXPECT_EQ(newest_rev, later[0].revision) << "newest change is missing";
+
+    client.send_terminate(1300U);
+}
+
+TEST(mvcc_mmap_test, write_coalesced_until_read)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    const char* key = "coalesced";
+
+    client.send_write_string_coalesced(10U, key, sst::string_value("abc"));
+    boost::uint64_t rev1 = readerA.get_newest_revision<sst::string_value>(key);
+    client.send_write_string_coalesced(11U, key, sst::string_value("def"));
+    client.send_write_string_coalesced(12U, key, sst::string_value("ghi"));
+    EXPECT_EQ(1U, client.send_get_string_history_depth(13U, key)) << "unread versions were not overwritten";
+    EXPECT_LT(rev1, readerA.get_newest_revision<sst::string_value>(key)) << "overwritten version kept its revision";
+
+    const boost::optional<const sst::string_value&> actual = readerA.read<sst::string_value>(key);
+    EXPECT_EQ(sst::string_value("ghi"), actual.get()) << "value read is not the value written";
+    client.send_write_string_coalesced(14U, key, sst::string_value("jkl"));
+    EXPECT_EQ(2U, client.send_get_string_history_depth(15U, key)) << "version already read was overwritten";
+    EXPECT_EQ(sst::string_value("ghi"), actual.get()) << "version already read was changed";
+    client.send_write_string_coalesced(16U, key, sst::string_value("mno"));
+    EXPECT_EQ(2U, client.send_get_string_history_depth(17U, key)) << "unread versions were not overwritten";
+    EXPECT_EQ(sst::string_value("mno"), readerA.read<sst::string_value>(key).get()) << "value read is not the value written";
+
+    client.send_write_string(18U, key, sst::string_value("pqr"));
+    EXPECT_EQ(3U, client.send_get_string_history_depth(19U, key)) << "plain write did not add a version";
+
+    client.send_terminate(20U);
+}
+
+TEST(mvcc_mmap_test, collect_type_enrolled_by_writer)
+{
+    config conf(ipc::mmap, bfs::absolute(bfs::unique_path()).string());
+    const char* key = "enrolled_elsewhere";
+    {
+	// the service only learns of the type once it writes a value of it itself
+	sst::mvcc_mmap_owner owner(bfs::path(conf.name.c_str()), conf.size, conf.readers);
+	owner.write<sst::string_value>(key, sst::string_value("abc"));
+	owner.write<sst::string_value>(key, sst::string_value("def"));
+    }
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_mmap_reader readerA(bfs::path(conf.name.c_str()));
+    EXPECT_EQ(sst::string_value("def"), readerA.read<sst::string_value>(key).get()) << "value read is not the value written";
+
+    client.send_process_read_metadata(10U);
+    client.send_collect_garbage(11U);
+    EXPECT_EQ(2U, client.send_get_string_history_depth(12U, key)) << "key of a type the collecting process does not know was collected";
+
+    client.send_write_string(13U, "enrolling", sst::string_value("abc"));
+    client.send_process_read_metadata(14U);
+    client.send_collect_garbage(15U);
+    EXPECT_EQ(1U, client.send_get_string_history_depth(16U, key)) << "key written by another process was not collected once its type was enrolled";
+    EXPECT_EQ(sst::string_value("def"), readerA.read<sst::string_value>(key).get()) << "newest version was collected";
+
+    client.send_terminate(17U);
+}
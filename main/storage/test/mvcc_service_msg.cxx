@@ -55,28 +55,10 @@ struct_value::struct_value(bool a, boost::int32_t b, double c) :
 	value1(a), value2(b), value3(c)
 { }
 
-struct_value::struct_value(const struct_value& other) :
-	value1(other.value1), value2(other.value2), value3(other.value3)
-{ }
-
 struct_value::struct_value(const write_struct_instr& instr) :
 	value1(instr.value1()), value2(instr.value2()), value3(instr.value3())
 { }
 
-struct_value::~struct_value()
-{ }
-
-struct_value& struct_value::operator=(const struct_value& other)
-{
-    if (this != &other)
-    {
-	value1 = other.value1;
-	value2 = other.value2;
-	value3 = other.value3;
-    }
-    return *this;
-}
-
 struct_value& struct_value::operator=(const write_struct_instr& instr)
 {
     value1 = instr.value1();
@@ -150,7 +132,16 @@ instruction_msg::msg_status instruction_msg::deserialize(const scm::message_sour
 	    (is_get_global_oldest_revision_read() && msg_.has_get_global_oldest_revision_read()) ||
 	    (is_get_registered_keys() && msg_.has_get_registered_keys()) ||
 	    (is_get_string_history_depth() && msg_.has_get_string_history_depth()) ||
-	    (is_get_struct_history_depth() && msg_.has_get_struct_history_depth()))
+	    (is_get_struct_history_depth() && msg_.has_get_struct_history_depth()) ||
+	    (is_write_struct_with() && msg_.has_write_struct_with()) ||
+	    (is_collect_garbage_parallel() && msg_.has_collect_garbage_parallel()) ||
+	    (is_write_struct_inline() && msg_.has_write_struct_inline()) ||
+	    (is_remove_struct_inline() && msg_.has_remove_struct_inline()) ||
+	    (is_write_string_bulk() && msg_.has_write_string_bulk()) ||
+	    (is_write_string_if() && msg_.has_write_string_if()) ||
+	    (is_remove_string_if() && msg_.has_remove_string_if()) ||
+	    (is_write_string_ttl() && msg_.has_write_string_ttl()) ||
+	    (is_write_string_coalesced() && msg_.has_write_string_coalesced()))
 	{
 	    status = WELLFORMED;
 	}
@@ -284,6 +275,60 @@ void instruction_msg::set_get_struct_history_depth(const get_struct_history_dept
     *msg_.mutable_get_struct_history_depth() = instr;
 }
 
+void instruction_msg::set_write_struct_with(const write_struct_instr& instr)
+{
+    msg_.set_opcode(instruction::WRITE_STRUCT_WITH);
+    *msg_.mutable_write_struct_with() = instr;
+}
+
+void instruction_msg::set_collect_garbage_parallel(const collect_garbage_parallel_instr& instr)
+{
+    msg_.set_opcode(instruction::COLLECT_GARBAGE_PARALLEL);
+    *msg_.mutable_collect_garbage_parallel() = instr;
+}
+
+void instruction_msg::set_write_struct_inline(const write_struct_instr& instr)
+{
+    msg_.set_opcode(instruction::WRITE_STRUCT_INLINE);
+    *msg_.mutable_write_struct_inline() = instr;
+}
+
+void instruction_msg::set_remove_struct_inline(const remove_struct_instr& instr)
+{
+    msg_.set_opcode(instruction::REMOVE_STRUCT_INLINE);
+    *msg_.mutable_remove_struct_inline() = instr;
+}
+
+void instruction_msg::set_write_string_bulk(const write_string_bulk_instr& instr)
+{
+    msg_.set_opcode(instruction::WRITE_STRING_BULK);
+    *msg_.mutable_write_string_bulk() = instr;
+}
+
+void instruction_msg::set_write_string_if(const write_string_if_instr& instr)
+{
+    msg_.set_opcode(instruction::WRITE_STRING_IF);
+    *msg_.mutable_write_string_if() = instr;
+}
+
+void instruction_msg::set_remove_string_if(const remove_string_if_instr& instr)
+{
+    msg_.set_opcode(instruction::REMOVE_STRING_IF);
+    *msg_.mutable_remove_string_if() = instr;
+}
+
+void instruction_msg::set_write_string_ttl(const write_string_ttl_instr& instr)
+{
+    msg_.set_opcode(instruction::WRITE_STRING_TTL);
+    *msg_.mutable_write_string_ttl() = instr;
+}
+
+void instruction_msg::set_write_string_coalesced(const write_string_coalesced_instr& instr)
+{
+    msg_.set_opcode(instruction::WRITE_STRING_COALESCED);
+    *msg_.mutable_write_string_coalesced() = instr;
+}
+
 result_msg::result_msg() :
      msg_()
 {
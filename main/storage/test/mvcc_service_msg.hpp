@@ -24,10 +24,7 @@ struct string_value
 struct struct_value
 {
     struct_value(bool a = true, boost::int32_t b = 0, double c = 0.0F);
-    struct_value(const struct_value& other);
     struct_value(const write_struct_instr& instr);
-    ~struct_value();
-    struct_value& operator=(const struct_value& other);
     struct_value& operator=(const write_struct_instr& instr);
     bool operator==(const struct_value& other) const;
     bool operator<(const struct_value& other) const;
@@ -70,6 +67,15 @@ public:
     inline bool is_get_registered_keys() { return msg_.opcode() == supernova::storage::instruction::GET_REGISTERED_KEYS; }
     inline bool is_get_string_history_depth() { return msg_.opcode() == supernova::storage::instruction::GET_STRING_HISTORY_DEPTH; }
     inline bool is_get_struct_history_depth() { return msg_.opcode() == supernova::storage::instruction::GET_STRUCT_HISTORY_DEPTH; }
+    inline bool is_write_struct_with() { return msg_.opcode() == supernova::storage::instruction::WRITE_STRUCT_WITH; }
+    inline bool is_collect_garbage_parallel() { return msg_.opcode() == supernova::storage::instruction::COLLECT_GARBAGE_PARALLEL; }
+    inline bool is_write_struct_inline() { return msg_.opcode() == supernova::storage::instruction::WRITE_STRUCT_INLINE; }
+    inline bool is_remove_struct_inline() { return msg_.opcode() == supernova::storage::instruction::REMOVE_STRUCT_INLINE; }
+    inline bool is_write_string_bulk() { return msg_.opcode() == supernova::storage::instruction::WRITE_STRING_BULK; }
+    inline bool is_write_string_if() { return msg_.opcode() == supernova::storage::instruction::WRITE_STRING_IF; }
+    inline bool is_remove_string_if() { return msg_.opcode() == supernova::storage::instruction::REMOVE_STRING_IF; }
+    inline bool is_write_string_ttl() { return msg_.opcode() == supernova::storage::instruction::WRITE_STRING_TTL; }
+    inline bool is_write_string_coalesced() { return msg_.opcode() == supernova::storage::instruction::WRITE_STRING_COALESCED; }
     inline const supernova::storage::terminate_instr& get_terminate() { return msg_.terminate(); }
     inline const supernova::storage::exists_string_instr& get_exists_string() { return msg_.exists_string(); }
     inline const supernova::storage::exists_struct_instr& get_exists_struct() { return msg_.exists_struct(); }
@@ -91,6 +97,15 @@ public:
     inline const supernova::storage::get_registered_keys_instr& get_get_registered_keys() { return msg_.get_registered_keys(); }
     inline const supernova::storage::get_string_history_depth_instr& get_get_string_history_depth() { return msg_.get_string_history_depth(); }
     inline const supernova::storage::get_struct_history_depth_instr& get_get_struct_history_depth() { return msg_.get_struct_history_depth(); }
+    inline const supernova::storage::write_struct_instr& get_write_struct_with() { return msg_.write_struct_with(); }
+    inline const supernova::storage::collect_garbage_parallel_instr& get_collect_garbage_parallel() { return msg_.collect_garbage_parallel(); }
+    inline const supernova::storage::write_struct_instr& get_write_struct_inline() { return msg_.write_struct_inline(); }
+    inline const supernova::storage::remove_struct_instr& get_remove_struct_inline() { return msg_.remove_struct_inline(); }
+    inline const supernova::storage::write_string_bulk_instr& get_write_string_bulk() { return msg_.write_string_bulk(); }
+    inline const supernova::storage::write_string_if_instr& get_write_string_if() { return msg_.write_string_if(); }
+    inline const supernova::storage::remove_string_if_instr& get_remove_string_if() { return msg_.remove_string_if(); }
+    inline const supernova::storage::write_string_ttl_instr& get_write_string_ttl() { return msg_.write_string_ttl(); }
+    inline const supernova::storage::write_string_coalesced_instr& get_write_string_coalesced() { return msg_.write_string_coalesced(); }
     void set_terminate(const supernova::storage::terminate_instr& instr);
     void set_exists_string(const supernova::storage::exists_string_instr& instr);
     void set_exists_struct(const supernova::storage::exists_struct_instr& instr);
@@ -112,6 +127,15 @@ public:
     void set_get_registered_keys(const supernova::storage::get_registered_keys_instr& instr);
     void set_get_string_history_depth(const supernova::storage::get_string_history_depth_instr& instr);
     void set_get_struct_history_depth(const supernova::storage::get_struct_history_depth_instr& instr);
+    void set_write_struct_with(const supernova::storage::write_struct_instr& instr);
+    void set_collect_garbage_parallel(const supernova::storage::collect_garbage_parallel_instr& instr);
+    void set_write_struct_inline(const supernova::storage::write_struct_instr& instr);
+    void set_remove_struct_inline(const supernova::storage::remove_struct_instr& instr);
+    void set_write_string_bulk(const supernova::storage::write_string_bulk_instr& instr);
+    void set_write_string_if(const supernova::storage::write_string_if_instr& instr);
+    void set_remove_string_if(const supernova::storage::remove_string_if_instr& instr);
+    void set_write_string_ttl(const supernova::storage::write_string_ttl_instr& instr);
+    void set_write_string_coalesced(const supernova::storage::write_string_coalesced_instr& instr);
 private:
     supernova::storage::instruction msg_;
 };
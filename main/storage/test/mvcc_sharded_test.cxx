@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <iostream>
+#include <exception>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <limits>
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/assign/list_of.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <gtest/gtest.h>
+#include <zmq.hpp>
+#include <supernova/core/compiler_extensions.hpp>
+#include <supernova/core/process_utility.hpp>
+#include <supernova/core/tcpip_utility.hpp>
+#include <supernova/communication/request_reply_client.hpp>
+#include "exception.hpp"
+#include "mvcc_sharded.hpp"
+#include "mvcc_sharded.hxx"
+#include "mvcc_service_msg.hpp"
+
+namespace bas = boost::asio;
+namespace bfs = boost::filesystem;
+namespace bpt = boost::posix_time;
+namespace scp = supernova::core::process_utility;
+namespace sct = supernova::core::tcpip_utility;
+namespace scm = supernova::communication;
+namespace sst = supernova::storage;
+
+namespace {
+
+typedef boost::uint16_t port_t;
+
+static const port_t DEFAULT_PORT = 22220U;
+static const size_t DEFAULT_SIZE = 1 << 24;
+static const size_t DEFAULT_SHARDS = 4;
+
+struct config
+{
+    config() : port(DEFAULT_PORT), size(DEFAULT_SIZE), readers(sst::MVCC_READER_LIMIT), shards(DEFAULT_SHARDS) { }
+    config(const std::string& name_, port_t port_ = DEFAULT_PORT, size_t size_ = DEFAULT_SIZE,
+	    sst::reader_token_id readers_ = sst::MVCC_READER_LIMIT, size_t shards_ = DEFAULT_SHARDS) :
+    	name(name_), port(port_), size(size_), readers(readers_), shards(shards_)
+    { }
+    std::string name;
+    port_t port;
+    size_t size;
+    sst::reader_token_id readers;
+    size_t shards;
+};
+
+class service_client
+{
+public:
+    service_client(const config& config);
+    ~service_client();
+    sst::result_msg send(sst::instruction_msg& msg);
+    void send_terminate(boost::uint32_t sequence);
+    void send_write_string(boost::uint32_t sequence, const char* key, const sst::string_value& value);
+    void send_remove_string(boost::uint32_t sequence, const char* key);
+    void send_process_read_metadata(boost::uint32_t sequence, sst::reader_token_id from = 0, sst::reader_token_id to = sst::MVCC_READER_LIMIT);
+    void send_process_write_metadata(boost::uint32_t sequence, std::size_t max_attempts = 0);
+    std::string send_collect_garbage(boost::uint32_t sequence, std::size_t max_attempts = 0);
+    std::vector<std::string> send_get_registered_keys(boost::uint32_t sequence);
+    std::size_t send_get_string_history_depth(boost::uint32_t sequence, const char* key);
+    void send_write_struct_inline(boost::uint32_t sequence, const char* key, const sst::struct_value& value);
+    bool send_write_string_if(boost::uint32_t sequence, const char* key, const sst::string_value& value, boost::uint64_t expected_revision);
+private:
+    bool terminate_sent_;
+    scm::request_reply_client client_;
+};
+
+service_client::service_client(const config& config) :
+    terminate_sent_(false),
+    client_("127.0.0.1", config.port)
+{ }
+
+service_client::~service_client()
+{
+    if (!terminate_sent_)
+    {
+	send_terminate(99U);
+    }
+}
+
+sst::result_msg service_client::send(sst::instruction_msg& instr)
+{
+    sst::result_msg result;
+    scm::request_reply_client::source source(sizeof(result));
+    scm::request_reply_client::sink sink(sizeof(instr));
+    instr.serialize(sink);
+    client_.send(sink, source);
+    sst::result_msg::msg_status status = result.deserialize(source);
+    if (UNLIKELY_EXT(status == sst::result_msg::MALFORMED))
+    {
+	throw std::runtime_error("Received malformed message");
+    }
+    return result;
+}
+
+void service_client::send_terminate(boost::uint32_t sequence)
+{
+    sst::instruction_msg inmsg;
+    sst::terminate_instr instr;
+    instr.set_sequence(sequence);
+    inmsg.set_terminate(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "Unexpected terminate result";
+    EXPECT_EQ(inmsg.get_terminate().sequence(), outmsg.get_confirmation().sequence()) << "Sequence number mismatch";
+    terminate_sent_ = true;
+}
+
+void service_client::send_write_string(boost::uint32_t sequence, const char* key, const sst::string_value& value)
+{
+    sst::instruction_msg inmsg;
+    sst::write_string_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value(value.c_str);
+    inmsg.set_write_string(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected write result";
+    EXPECT_EQ(inmsg.get_write_string().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+
+void service_client::send_remove_string(boost::uint32_t sequence, const char* key)
+{
+    sst::instruction_msg inmsg;
+    sst::remove_string_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    inmsg.set_remove_string(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected remove result";
+    EXPECT_EQ(inmsg.get_remove_string().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+
+void service_client::send_process_read_metadata(boost::uint32_t sequence, sst::reader_token_id from, sst::reader_token_id to)
+{
+    sst::instruction_msg inmsg;
+    sst::process_read_metadata_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_from(from);
+    instr.set_to(to);
+    inmsg.set_process_read_metadata(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected process_read_metadata result";
+    EXPECT_EQ(inmsg.get_process_read_metadata().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+void service_client::send_process_write_metadata(boost::uint32_t sequence, std::size_t max_attempts)
+{
+    sst::instruction_msg inmsg;
+    sst::process_write_metadata_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_max_attempts(max_attempts);
+    inmsg.set_process_write_metadata(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected process_write_metadata result";
+    EXPECT_EQ(inmsg.get_process_write_metadata().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+std::string service_client::send_collect_garbage(boost::uint32_t sequence, std::size_t max_attempts)
+{
+    sst::instruction_msg inmsg;
+    sst::collect_garbage_1_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_max_attempts(max_attempts);
+    inmsg.set_collect_garbage_1(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_key()) << "unexpected collect_garbage_1 result";
+    EXPECT_EQ(inmsg.get_collect_garbage_1().sequence(), outmsg.get_key().sequence()) << "sequence number mismatch";
+    return outmsg.get_key().key();
+}
+
+std::vector<std::string> service_client::send_get_registered_keys(boost::uint32_t sequence)
+{
+    sst::instruction_msg inmsg;
+    sst::get_registered_keys_instr instr;
+    instr.set_sequence(sequence);
+    inmsg.set_get_registered_keys(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_key_list()) << "unexpected get_registered_keys result";
+    EXPECT_EQ(inmsg.get_get_registered_keys().sequence(), outmsg.get_key_list().sequence()) << "sequence number mismatch";
+    std::vector<std::string> result;
+    for (int iter = 0; iter < outmsg.get_key_list().key_list().size(); ++iter)
+    {
+	result.push_back(outmsg.get_key_list().key_list().Get(iter));
+    }
+    return result;
+}
+
+std::size_t service_client::send_get_string_history_depth(boost::uint32_t sequence, const char* key)
+{
+    sst::instruction_msg inmsg;
+    sst::get_string_history_depth_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    inmsg.set_get_string_history_depth(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_size()) << "unexpected get_string_history_depth result";
+    EXPECT_EQ(inmsg.get_get_string_history_depth().sequence(), outmsg.get_size().sequence()) << "sequence number mismatch";
+    return outmsg.get_size().size();
+}
+
+
+void service_client::send_write_struct_inline(boost::uint32_t sequence, const char* key, const sst::struct_value& value)
+{
+    sst::instruction_msg inmsg;
+    sst::write_struct_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value1(value.value1);
+    instr.set_value2(value.value2);
+    instr.set_value3(value.value3);
+    inmsg.set_write_struct_inline(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_confirmation()) << "unexpected write_inline result";
+    EXPECT_EQ(inmsg.get_write_struct_inline().sequence(), outmsg.get_confirmation().sequence()) << "sequence number mismatch";
+}
+
+
+bool service_client::send_write_string_if(boost::uint32_t sequence, const char* key, const sst::string_value& value, boost::uint64_t expected_revision)
+{
+    sst::instruction_msg inmsg;
+    sst::write_string_if_instr instr;
+    instr.set_sequence(sequence);
+    instr.set_key(key);
+    instr.set_value(value.c_str);
+    instr.set_expected_revision(expected_revision);
+    inmsg.set_write_string_if(instr);
+    sst::result_msg outmsg(send(inmsg));
+    EXPECT_TRUE(outmsg.is_predicate()) << "unexpected write_if result";
+    EXPECT_EQ(inmsg.get_write_string_if().sequence(), outmsg.get_predicate().sequence()) << "sequence number mismatch";
+    return outmsg.get_predicate().predicate();
+}
+
+
+
+
+class service_launcher
+{
+public:
+    service_launcher(const config& config);
+    ~service_launcher();
+    int wait();
+private:
+    bool has_terminated;
+    pid_t pid_;
+};
+
+service_launcher::service_launcher(const config& config) :
+    has_terminated(false)
+{
+    static const char SLAVE_NAME[] = "mvcc_sharded_service";
+    boost::array <char, sizeof(SLAVE_NAME)> launcher_name;
+    strncpy(launcher_name.c_array(), SLAVE_NAME, launcher_name.max_size());
+
+    static const char PORT_OPT[] = "--port";
+    boost::array<char, sizeof(PORT_OPT)> port_opt;
+    strncpy(port_opt.c_array(), PORT_OPT, port_opt.max_size());
+
+    boost::array<char, std::numeric_limits<port_t>::digits> port_arg;
+    std::ostringstream port_buf;
+    port_buf << config.port;
+    strncpy(port_arg.c_array(), port_buf.str().c_str(), port_arg.max_size());
+
+    static const char SIZE_OPT[] = "--size";
+    boost::array<char, sizeof(SIZE_OPT)> size_opt;
+    strncpy(size_opt.c_array(), SIZE_OPT, size_opt.max_size());
+
+    boost::array<char, std::numeric_limits<size_t>::digits> size_arg;
+    std::ostringstream size_buf;
+    size_buf << config.size;
+    strncpy(size_arg.c_array(), size_buf.str().c_str(), size_arg.max_size());
+
+    static const char READERS_OPT[] = "--readers";
+    boost::array<char, sizeof(READERS_OPT)> readers_opt;
+    strncpy(readers_opt.c_array(), READERS_OPT, readers_opt.max_size());
+
+    boost::array<char, std::numeric_limits<sst::reader_token_id>::digits> readers_arg;
+    std::ostringstream readers_buf;
+    readers_buf << config.readers;
+    strncpy(readers_arg.c_array(), readers_buf.str().c_str(), readers_arg.max_size());
+
+    static const char SHARDS_OPT[] = "--shards";
+    boost::array<char, sizeof(SHARDS_OPT)> shards_opt;
+    strncpy(shards_opt.c_array(), SHARDS_OPT, shards_opt.max_size());
+
+    boost::array<char, std::numeric_limits<size_t>::digits> shards_arg;
+    std::ostringstream shards_buf;
+    shards_buf << config.shards;
+    strncpy(shards_arg.c_array(), shards_buf.str().c_str(), shards_arg.max_size());
+
+    std::vector<char> name_arg(config.name.size() + 1, '\0');
+    std::copy(config.name.begin(), config.name.end(), name_arg.begin());
+
+    boost::array<char*, 12> arg_list = boost::assign::list_of
+    		(launcher_name.c_array())
+		(port_opt.c_array())(port_arg.c_array())
+		(size_opt.c_array())(size_arg.c_array())
+		(readers_opt.c_array())(readers_arg.c_array())
+		(shards_opt.c_array())(shards_arg.c_array())
+		(&name_arg[0])
+		(0);
+    bfs::path launcher_path = scp::current_exe_path().parent_path() / bfs::path(SLAVE_NAME);
+    // stupid arg_list argument has to be an array of mutable C strings
+    if (posix_spawn(&pid_, launcher_path.string().c_str(), 0, 0, arg_list.c_array(), environ))
+    {
+	throw std::runtime_error("Could not spawn service_launcher");
+    }
+    while (!sct::is_tcp_port_open("127.0.0.1", config.port))
+    {
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+}
+
+service_launcher::~service_launcher()
+{
+    if (!has_terminated)
+    {
+	wait();
+    }
+}
+
+int service_launcher::wait()
+{
+    int exit_code = -1;
+    int status = 0;
+    if (waitpid(pid_, &status, 0) == pid_)
+    {
+	if (WIFEXITED(status))
+	{
+	    exit_code = WEXITSTATUS(status);
+	}
+	has_terminated = true;
+    }
+    return exit_code;
+}
+
+} // anonymous namespace
+
+
+TEST(mvcc_sharded_test, startup_and_shutdown_benchmark)
+{
+    config conf(bfs::unique_path().string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    client.send_terminate(1U);
+}
+
+TEST(mvcc_sharded_test, shard_index_in_range)
+{
+    EXPECT_EQ(sst::mvcc_shard_index("shard_index", 7U), sst::mvcc_shard_index("shard_index", 7U)) << "shard index is not stable";
+    EXPECT_EQ(0U, sst::mvcc_shard_index("shard_index", 1U)) << "single shard index is not zero";
+    for (std::size_t iter = 0; iter < 100U; ++iter)
+    {
+	std::string key(str(boost::format("shard_index_%1%") % iter));
+	EXPECT_GT(DEFAULT_SHARDS, sst::mvcc_shard_index(key.c_str(), DEFAULT_SHARDS)) << "shard index out of range";
+    }
+}
+
+TEST(mvcc_sharded_test, shard_count_discovered)
+{
+    config conf(bfs::unique_path().string(), DEFAULT_PORT, DEFAULT_SIZE, sst::MVCC_READER_LIMIT, 3U);
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_sharded_reader readerA(conf.name);
+    EXPECT_EQ(conf.shards, readerA.get_shard_count()) << "reader did not find every shard";
+    EXPECT_EQ(conf.shards * conf.size, readerA.get_size()) << "size is not the sum of the shard sizes";
+    client.send_terminate(2U);
+}
+
+TEST(mvcc_sharded_test, write_and_read_across_shards)
+{
+    config conf(bfs::unique_path().string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_sharded_reader readerA(conf.name);
+
+    std::vector<std::string> keys;
+    for (std::size_t iter = 0; iter < 32U; ++iter)
+    {
+	keys.push_back(str(boost::format("across_shards_%1%") % iter));
+	client.send_write_string(10U + iter, keys.back().c_str(), sst::string_value(keys.back().c_str()));
+    }
+    for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+    {
+	ASSERT_TRUE(readerA.exists<sst::string_value>(iter->c_str())) << "write failed";
+	const boost::optional<const sst::string_value&> actual = readerA.read<sst::string_value>(iter->c_str());
+	EXPECT_TRUE(actual) << "read failed";
+	EXPECT_EQ(sst::string_value(iter->c_str()), actual.get()) << "read value is not the value just written";
+    }
+    std::vector<std::string> registered(client.send_get_registered_keys(50U));
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(keys, registered) << "registered keys differ from the keys written";
+
+    client.send_remove_string(51U, keys.front().c_str());
+    EXPECT_FALSE(readerA.exists<sst::string_value>(keys.front().c_str())) << "remove failed";
+
+    client.send_terminate(60U);
+}
+
+TEST(mvcc_sharded_test, read_many_across_shards)
+{
+    config conf(bfs::unique_path().string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_sharded_reader readerA(conf.name);
+
+    std::vector<std::string> names;
+    for (std::size_t iter = 0; iter < 16U; ++iter)
+    {
+	names.push_back(str(boost::format("read_many_%1%") % iter));
+	if (iter % 4U)
+	{
+	    client.send_write_string(10U + iter, names.back().c_str(), sst::string_value(names.back().c_str()));
+	}
+    }
+    std::vector<const char*> keys;
+    for (std::vector<std::string>::const_iterator iter = names.begin(); iter != names.end(); ++iter)
+    {
+	keys.push_back(iter->c_str());
+    }
+    std::vector< boost::optional<const sst::string_value&> > actual;
+    EXPECT_EQ(12U, readerA.read_many<sst::string_value>(keys, actual)) << "incorrect number of values read";
+    ASSERT_EQ(keys.size(), actual.size()) << "one result is not returned per key";
+    for (std::size_t iter = 0; iter < keys.size(); ++iter)
+    {
+	if (iter % 4U)
+	{
+	    EXPECT_TRUE(actual[iter]) << "read failed";
+	    EXPECT_EQ(sst::string_value(keys[iter]), actual[iter].get()) << "value is not in the position of its key";
+	}
+	else
+	{
+	    EXPECT_FALSE(actual[iter]) << "value read for a key never written";
+	}
+    }
+
+    client.send_terminate(40U);
+}
+
+TEST(mvcc_sharded_test, collect_garbage_across_shards)
+{
+    config conf(bfs::unique_path().string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_sharded_reader readerA(conf.name);
+
+    std::vector<std::string> keys;
+    for (std::size_t iter = 0; iter < 8U; ++iter)
+    {
+	keys.push_back(str(boost::format("collect_garbage_%1%") % iter));
+	client.send_write_string(10U, keys.back().c_str(), sst::string_value("abc"));
+	client.send_write_string(11U, keys.back().c_str(), sst::string_value("def"));
+	client.send_write_string(12U, keys.back().c_str(), sst::string_value("ghi"));
+    }
+    for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+    {
+	EXPECT_EQ(3U, client.send_get_string_history_depth(20U, iter->c_str())) << "unexpected history depth";
+	readerA.read<sst::string_value>(iter->c_str());
+    }
+    client.send_process_read_metadata(21U);
+    client.send_process_write_metadata(22U);
+    // each pass removes at most the oldest version of every key
+    client.send_collect_garbage(23U);
+    client.send_collect_garbage(24U);
+    for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+    {
+	EXPECT_EQ(1U, client.send_get_string_history_depth(25U, iter->c_str())) << "unused values were not collected";
+	EXPECT_EQ(readerA.get_newest_revision<sst::string_value>(iter->c_str()),
+		readerA.get_oldest_revision<sst::string_value>(iter->c_str())) << "oldest revision not updated after garbage collection";
+    }
+
+    client.send_terminate(30U);
+}
+
+TEST(mvcc_sharded_test, write_inline_across_shards)
+{
+    config conf(bfs::unique_path().string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_sharded_reader readerA(conf.name);
+
+    std::vector<std::string> keys;
+    for (std::size_t iter = 0; iter < 16U; ++iter)
+    {
+	keys.push_back(str(boost::format("write_inline_%1%") % iter));
+	client.send_write_struct_inline(10U + iter, keys.back().c_str(), sst::struct_value(false, iter, 0.5));
+	client.send_write_struct_inline(30U + iter, keys.back().c_str(), sst::struct_value(true, iter, 1.5));
+    }
+    for (std::size_t iter = 0; iter < keys.size(); ++iter)
+    {
+	boost::optional<sst::struct_value> actual = readerA.read_inline<sst::struct_value>(keys[iter].c_str());
+	ASSERT_TRUE(actual) << "read failed";
+	EXPECT_EQ(sst::struct_value(true, iter, 1.5), actual.get()) << "value read is not the newest value written";
+    }
+
+    client.send_terminate(50U);
+}
+
+TEST(mvcc_sharded_test, write_if_across_shards)
+{
+    config conf(bfs::unique_path().string());
+    service_launcher launcher(conf);
+    service_client client(conf);
+    sst::mvcc_sharded_reader readerA(conf.name);
+
+    std::vector<std::string> keys;
+    for (std::size_t iter = 0; iter < 16U; ++iter)
+    {
+	keys.push_back(str(boost::format("write_if_%1%") % iter));
+	EXPECT_TRUE(client.send_write_string_if(10U + iter, keys.back().c_str(), sst::string_value("abc"), 0U)) << "write_if of a new key failed";
+    }
+    for (std::size_t iter = 0; iter < keys.size(); ++iter)
+    {
+	boost::uint64_t revision = readerA.get_newest_revision<sst::string_value>(keys[iter].c_str());
+	EXPECT_FALSE(client.send_write_string_if(30U + iter, keys[iter].c_str(), sst::string_value("def"), revision + 1U)) << "write_if matched a wrong revision";
+	EXPECT_TRUE(client.send_write_string_if(50U + iter, keys[iter].c_str(), sst::string_value("def"), revision)) << "write_if of the newest revision failed";
+	EXPECT_EQ(sst::string_value("def"), readerA.read<sst::string_value>(keys[iter].c_str()).get()) << "value read is not the value written";
+    }
+
+    client.send_terminate(70U);
+}